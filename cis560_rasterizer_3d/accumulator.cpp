@@ -0,0 +1,66 @@
+#include "accumulator.h"
+
+// the index-th element of the van der Corput sequence in the given base, in [0, 1)
+static float radicalInverse(int index, int base)
+{
+    float result = 0.f;
+    float digit = 1.f / base;
+    for(; index > 0; index /= base, digit /= base)
+    {
+        result += (index % base) * digit;
+    }
+    return result;
+}
+
+glm::vec2 Accumulator::Jitter(int sample)
+{
+    if(sample == 0)
+    {
+        return glm::vec2(0.f);
+    }
+    // Halton index 1 is the pixel center again, so sample n uses index n + 1
+    return glm::vec2(radicalInverse(sample + 1, 2), radicalInverse(sample + 1, 3)) - 0.5f;
+}
+
+void Accumulator::Reset(const QImage& frame)
+{
+    m_width = frame.width();
+    m_height = frame.height();
+    m_samples = 0;
+    m_sums.assign(size_t(m_width) * m_height * 3, 0);
+    Add(frame);
+}
+
+void Accumulator::Add(const QImage& frame)
+{
+    unsigned* sum = m_sums.data();
+    for(int y = 0; y < m_height; y++)
+    {
+        const QRgb* row = reinterpret_cast<const QRgb*>(frame.constScanLine(y));
+        for(int x = 0; x < m_width; x++, sum += 3)
+        {
+            sum[0] += qRed(row[x]);
+            sum[1] += qGreen(row[x]);
+            sum[2] += qBlue(row[x]);
+        }
+    }
+    m_samples++;
+}
+
+void Accumulator::Resolve(QImage* target) const
+{
+    if(target->width() != m_width || target->height() != m_height || target->format() != QImage::Format_RGB32)
+    {
+        *target = QImage(m_width, m_height, QImage::Format_RGB32);
+    }
+    const unsigned* sum = m_sums.data();
+    const unsigned half = unsigned(m_samples) / 2;  // rounds to nearest
+    for(int y = 0; y < m_height; y++)
+    {
+        QRgb* row = reinterpret_cast<QRgb*>(target->scanLine(y));
+        for(int x = 0; x < m_width; x++, sum += 3)
+        {
+            row[x] = qRgb((sum[0] + half) / m_samples, (sum[1] + half) / m_samples, (sum[2] + half) / m_samples);
+        }
+    }
+}
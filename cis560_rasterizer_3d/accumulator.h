@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QImage>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Averages frames rendered with different sub-pixel jitter into one antialiased image.
+// Every frame is a further sample of each pixel's footprint, so after n frames the result is
+// n sample supersampling, spread over n cheap frames instead of paid for in each one.
+class Accumulator
+{
+public:
+    // the projection offset, in pixels, to render the given sample with. sample 0 is the
+    // unjittered frame, the rest follow a Halton (2, 3) sequence over the pixel
+    static glm::vec2 Jitter(int sample);
+
+    // starts over with frame as the first sample
+    void Reset(const QImage& frame);
+    // adds a frame of the same size as the first
+    void Add(const QImage& frame);
+    // writes the average of the samples so far into target, reallocating it only if needed
+    void Resolve(QImage* target) const;
+
+    int Samples() const { return m_samples; }
+
+private:
+    int m_width = 0, m_height = 0;
+    int m_samples = 0;
+    std::vector<unsigned> m_sums;  // r, g, b per pixel. fits ACCUMULATION_MAX_SAMPLES of 8 bits easily
+};
@@ -0,0 +1,167 @@
+// The replaceable global allocation functions, counting every operator new of the process into
+// its thread's totals, see AllocationScope. Only the programs that report allocations link this
+// (the cli and the bench), so the others keep their toolchain's allocator. Every form of new
+// and delete is replaced, so each block goes back through the allocator it came from.
+#include "memorystats.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+static void* allocate(size_t size, size_t alignment)
+{
+    CountAllocation(size);
+    size = std::max<size_t>(size, 1);
+    for(;;)
+    {
+#ifdef _WIN32
+        void* p = _aligned_malloc(size, alignment);
+#else
+        void* p = nullptr;
+        if(alignment <= alignof(std::max_align_t))
+        {
+            p = std::malloc(size);
+        }
+        else if(posix_memalign(&p, alignment, size) != 0)
+        {
+            p = nullptr;
+        }
+#endif
+        if(p)
+        {
+            return p;
+        }
+        const std::new_handler handler = std::get_new_handler();
+        if(!handler)
+        {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+static void* allocateNothrow(size_t size, size_t alignment) noexcept
+{
+    try
+    {
+        return allocate(size, alignment);
+    }
+    catch(...)
+    {
+        return nullptr;
+    }
+}
+
+static void release(void* p) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+static constexpr size_t DEFAULT_ALIGNMENT = alignof(std::max_align_t);
+
+void* operator new(size_t size)
+{
+    return allocate(size, DEFAULT_ALIGNMENT);
+}
+
+void* operator new[](size_t size)
+{
+    return allocate(size, DEFAULT_ALIGNMENT);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return allocate(size, size_t(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return allocate(size, size_t(alignment));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocateNothrow(size, DEFAULT_ALIGNMENT);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocateNothrow(size, DEFAULT_ALIGNMENT);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocateNothrow(size, size_t(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocateNothrow(size, size_t(alignment));
+}
+
+void operator delete(void* p) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    release(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    release(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    release(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+    release(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    release(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    release(p);
+}
@@ -0,0 +1,89 @@
+#include "batchrender.h"
+
+#include <QImage>
+#include <QImageWriter>
+#include <QFileInfo>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "rasterizer.h"
+
+QString FramePath(const QString& pattern, int frame)
+{
+    int end = pattern.lastIndexOf(QChar('#'));
+    if(end < 0)
+    {
+        const int dot = pattern.lastIndexOf(QChar('.'));
+        const int slash = pattern.lastIndexOf(QChar('/'));
+        const int at = (dot > slash) ? dot : pattern.length();
+        return pattern.left(at) + QString("_%1").arg(frame, 4, 10, QChar('0')) + pattern.mid(at);
+    }
+    int start = end;
+    while(start > 0 && pattern.at(start - 1) == QChar('#'))
+    {
+        start--;
+    }
+    const int width = end - start + 1;
+    return pattern.left(start) + QString("%1").arg(frame, width, 10, QChar('0')) + pattern.mid(end + 1);
+}
+
+bool RenderCameraPath(const std::shared_ptr<std::vector<Polygon>>& scene,
+                      const std::vector<Light>& lights,
+                      const SceneGraph& graph,
+                      const CameraPath& path,
+                      const QString& pattern,
+                      int width, int height,
+                      int threads,
+                      const PathSettings& settings,
+                      QString* error)
+{
+    std::atomic<int> nextFrame(0);
+    std::mutex errorMutex;
+    QString errors;
+    const float aspect = float(width) / height;
+
+    auto worker = [&]() {
+        // per-worker rasterizer and color target: private z-buffer and framebuffer, shared polygons
+        Rasterizer rasterizer(scene);
+        rasterizer.m_lights = lights;
+        rasterizer.m_sceneGraph = graph;
+        rasterizer.m_renderMode = settings.renderMode;
+        rasterizer.m_shadowFilter = settings.shadowFilter;
+        rasterizer.m_cullBackfaces = settings.cullBackfaces;
+        rasterizer.m_depthPrepass = settings.depthPrepass;
+        rasterizer.SetResolution(width, height);
+        QImage target;
+        for(int i = nextFrame++; i < path.m_frames; i = nextFrame++)
+        {
+            rasterizer.m_camera = path.Frame(i, aspect);
+            rasterizer.RenderScene(&target);
+            QImageWriter writer(FramePath(pattern, i));
+            if(!writer.write(target))
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                errors.append(QString("frame %1: %2\n").arg(i).arg(writer.errorString()));
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    const int n = std::max(1, std::min(threads, path.m_frames));
+    for(int t = 1; t < n; t++)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for(std::thread& w : workers)
+    {
+        w.join();
+    }
+
+    if(!errors.isEmpty())
+    {
+        if(error) *error = errors;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QString>
+#include <memory>
+#include <vector>
+#include "polygon.h"
+#include "camerapath.h"
+#include "light.h"
+#include "rasterizer.h"
+#include "scenegraph.h"
+
+// Where frame i of an image sequence goes. The last run of '#' in pattern is replaced by the
+// zero padded frame number, e.g. "out/frame_####.png". Without any '#', "_0000" style
+// numbering is added before the extension.
+QString FramePath(const QString& pattern, int frame);
+
+// What every frame of a path is drawn with, see the Rasterizer members of the same names
+struct PathSettings
+{
+    RenderMode renderMode = RenderMode::Shaded;
+    int shadowFilter = 1;
+    bool cullBackfaces = false;
+    bool depthPrepass = false;
+};
+
+// Renders every frame of path at width x height and writes frame i to FramePath(pattern, i).
+// Frames are handed out one at a time to `threads` workers. Each worker has its own Rasterizer,
+// and so its own depth and color buffers, over the one shared read-only scene.
+// Returns false and fills *error if any frame failed to write.
+bool RenderCameraPath(const std::shared_ptr<std::vector<Polygon>>& scene,
+                      const std::vector<Light>& lights,
+                      const SceneGraph& graph,
+                      const CameraPath& path,
+                      const QString& pattern,
+                      int width, int height,
+                      int threads,
+                      const PathSettings& settings = PathSettings(),
+                      QString* error = nullptr);
@@ -0,0 +1,13 @@
+# Scene benchmark: renders every shipped scene from a fixed set of camera poses and reports
+# frame time percentiles and throughput as JSON, to compare builds against each other.
+include(../rasterizer_core.pri)
+
+QT -= widgets
+
+TARGET = rasterizer_bench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp \
+    ../allocationcounter.cpp
@@ -0,0 +1,206 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+
+#include "cameraset.h"
+#include "constants.h"
+#include "kernels.h"
+#include "rasterizer.h"
+#include "sceneloader.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double msSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// nearest-rank percentile of an already sorted list
+static double percentile(const std::vector<double>& sorted, double pct)
+{
+    const size_t rank = size_t(std::ceil(pct / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+static QJsonObject benchScene(const QString& path, int warmup, int reps, int poses, int width, int height)
+{
+    QJsonObject result;
+    result.insert("scene", path);
+
+    auto polygons = std::make_shared<std::vector<Polygon>>();
+    std::vector<Light> lights;
+    SceneGraph graph;
+    QString errors;
+    const Clock::time_point loadStart = Clock::now();
+    const bool loaded = LoadScene(path, polygons.get(), &errors, &lights, &graph);
+    result.insert("load_ms", msSince(loadStart));
+    if(!errors.isEmpty())
+    {
+        result.insert("errors", errors.trimmed());
+    }
+    if(!loaded || polygons->empty())
+    {
+        return result;
+    }
+
+    size_t triangles = 0;
+    for(const Polygon& p : *polygons)
+    {
+        triangles += p.m_tris.size();
+    }
+    result.insert("triangles", double(triangles));
+
+    Rasterizer rasterizer(polygons);
+    rasterizer.m_lights = lights;
+    rasterizer.m_sceneGraph = graph;
+    rasterizer.SetResolution(width, height);
+    QImage target;  // reused, like the GUI does
+    std::vector<double> frameMs;
+    double depthOnlyMs = 0;  // the same poses through RenderDepth, for depth-only workloads
+    unsigned long long shadedPixels = 0;
+    RenderStats stageSums;
+    for(const Camera& camera : OrbitCameraSet(*polygons, poses, float(width) / height, &graph))
+    {
+        rasterizer.m_camera = camera;
+        for(int i = 0; i < warmup; i++)
+        {
+            rasterizer.RenderScene(&target);
+        }
+        for(int i = 0; i < reps; i++)
+        {
+            const Clock::time_point start = Clock::now();
+            rasterizer.RenderScene(&target);
+            frameMs.push_back(msSince(start));
+            shadedPixels += rasterizer.m_stats.pixelsShaded;
+            stageSums.transformMs += rasterizer.m_stats.transformMs;
+            stageSums.setupMs += rasterizer.m_stats.setupMs;
+            stageSums.rasterMs += rasterizer.m_stats.rasterMs;
+            stageSums.shadeMs += rasterizer.m_stats.shadeMs;
+            stageSums.shadowMs += rasterizer.m_stats.shadowMs;
+            stageSums.lightMs += rasterizer.m_stats.lightMs;
+            stageSums.clearMs += rasterizer.m_stats.clearMs;
+        }
+        for(int i = 0; i < reps; i++)
+        {
+            const Clock::time_point start = Clock::now();
+            rasterizer.RenderDepth();
+            depthOnlyMs += msSince(start);
+        }
+    }
+    if(frameMs.empty())
+    {
+        return result;
+    }
+
+    const double totalMs = std::accumulate(frameMs.begin(), frameMs.end(), 0.0);
+    std::sort(frameMs.begin(), frameMs.end());
+    QJsonObject frame;
+    frame.insert("min", frameMs.front());
+    frame.insert("p50", percentile(frameMs, 50));
+    frame.insert("p90", percentile(frameMs, 90));
+    frame.insert("p99", percentile(frameMs, 99));
+    frame.insert("max", frameMs.back());
+    frame.insert("mean", totalMs / frameMs.size());
+    QJsonObject stages;
+    stages.insert("clear", stageSums.clearMs / frameMs.size());
+    stages.insert("transform", stageSums.transformMs / frameMs.size());
+    stages.insert("setup", stageSums.setupMs / frameMs.size());
+    stages.insert("raster", stageSums.rasterMs / frameMs.size());
+    stages.insert("shade", stageSums.shadeMs / frameMs.size());
+    stages.insert("shadow", stageSums.shadowMs / frameMs.size());  // 0 once the maps are cached by the warmup
+    stages.insert("light", stageSums.lightMs / frameMs.size());
+    result.insert("frames", int(frameMs.size()));
+    result.insert("frame_ms", frame);
+    result.insert("stage_ms", stages);  // means
+    result.insert("depth_only_ms", depthOnlyMs / frameMs.size());  // mean
+    result.insert("triangles_per_s", triangles * frameMs.size() / (totalMs / 1000.0));
+    result.insert("shaded_pixels_per_s", shadedPixels / (totalMs / 1000.0));
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("rasterizer_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders scenes from a fixed orbit of camera poses and reports frame times as JSON.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("scenes", "Scene JSON files, relative to --scene-dir. Defaults to the shipped scenes.",
+                                 "[scenes...]");
+    QCommandLineOption dirOpt("scene-dir", "Directory the scene paths are relative to.", "dir", ".");
+    QCommandLineOption warmupOpt("warmup", "Untimed frames rendered per pose first.", "count", "2");
+    QCommandLineOption repsOpt("reps", "Timed frames per pose.", "count", "5");
+    QCommandLineOption posesOpt("poses", "Camera poses per scene.", "count", "8");
+    QCommandLineOption widthOpt("width", "Render width in pixels.", "pixels", QString::number(int(SCREEN_WIDTH)));
+    QCommandLineOption heightOpt("height", "Render height in pixels.", "pixels", QString::number(int(SCREEN_HEIGHT)));
+    QCommandLineOption outputOpt({"o", "output"}, "Write the report here instead of stdout.", "file");
+    QCommandLineOption isaOpt("isa", "Instruction set of the raster kernels (scalar, sse4.2, avx2, avx512), "
+                                     "instead of the best one this CPU supports.", "isa");
+    parser.addOption(dirOpt);
+    parser.addOption(warmupOpt);
+    parser.addOption(repsOpt);
+    parser.addOption(posesOpt);
+    parser.addOption(widthOpt);
+    parser.addOption(heightOpt);
+    parser.addOption(outputOpt);
+    parser.addOption(isaOpt);
+    parser.process(a);
+
+    if(parser.isSet(isaOpt) && !SelectKernels(parser.value(isaOpt).toStdString().c_str()))
+    {
+        std::cerr << "--isa " << parser.value(isaOpt).toStdString() << " is unknown or not supported by this CPU" << std::endl;
+        return 1;
+    }
+
+    QStringList scenes = parser.positionalArguments();
+    if(scenes.isEmpty())
+    {
+        scenes = QStringList({"3D_cube.json", "3D_dodecahedron.json", "3D_wahoo.json", "mesh.json", "0/axe.json"});
+    }
+    const int warmup = std::max(0, parser.value(warmupOpt).toInt());
+    const int reps = std::max(1, parser.value(repsOpt).toInt());
+    const int poses = std::max(1, parser.value(posesOpt).toInt());
+    const int width = std::max(1, parser.value(widthOpt).toInt());
+    const int height = std::max(1, parser.value(heightOpt).toInt());
+    const QDir dir(parser.value(dirOpt));
+
+    QJsonArray results;
+    for(const QString& scene : scenes)
+    {
+        std::cerr << "benchmarking " << scene.toStdString() << std::endl;
+        results.append(benchScene(dir.filePath(scene), warmup, reps, poses, width, height));
+    }
+
+    QJsonObject report;
+    report.insert("isa", Kernels().name);
+    report.insert("warmup", warmup);
+    report.insert("repetitions", reps);
+    report.insert("poses", poses);
+    report.insert("width", width);
+    report.insert("height", height);
+    report.insert("scenes", results);
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if(!parser.isSet(outputOpt))
+    {
+        std::cout << json.toStdString();
+        return 0;
+    }
+    QFile out(parser.value(outputOpt));
+    if(!out.open(QIODevice::WriteOnly) || out.write(json) != json.size())
+    {
+        std::cerr << "Could not write " << parser.value(outputOpt).toStdString() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -33,6 +33,27 @@ Camera::Camera(glm::vec4 forward,
     m_aspect_ratio(aspect_ratio)
 {}
 
+Camera Camera::LookAt(glm::vec4 eye,
+                      glm::vec4 target,
+                      glm::vec4 up,
+                      float fov,
+                      float near_clip,
+                      float far_clip,
+                      float aspect_ratio) {
+    // same handedness as the default camera: right = forward x up
+    const glm::vec3 F = glm::normalize(glm::vec3(target - eye));
+    const glm::vec3 R = glm::normalize(glm::cross(F, glm::vec3(up)));
+    const glm::vec3 U = glm::cross(R, F);
+    return Camera(glm::vec4(F, 0.f),
+                  glm::vec4(R, 0.f),
+                  glm::vec4(U, 0.f),
+                  fov,
+                  glm::vec4(glm::vec3(eye), 1.f),
+                  near_clip,
+                  far_clip,
+                  aspect_ratio);
+}
+
 glm::mat4 Camera::viewMatrix() const {
     // use the position, forward, right and up
     const float tx = -glm::dot(m_right, m_position);
@@ -15,6 +15,15 @@ public:
            float,
            float);
 
+    // a camera at eye looking at target, with its up vector as close to up as possible
+    static Camera LookAt(glm::vec4 eye,
+                         glm::vec4 target,
+                         glm::vec4 up,
+                         float fov,
+                         float near_clip,
+                         float far_clip,
+                         float aspect_ratio);
+
     glm::mat4 viewMatrix() const;
     glm::mat4 perspProjMatrix() const;
 
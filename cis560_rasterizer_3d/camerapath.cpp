@@ -0,0 +1,116 @@
+#include "camerapath.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <algorithm>
+
+#include "sceneloader.h"
+
+CameraPath::CameraPath()
+    : m_frames(1), m_smooth(true), m_near_clip(Camera().m_near_clip), m_far_clip(Camera().m_far_clip)
+{}
+
+bool CameraPath::Load(const QString& filename, CameraPath* path, QString* error)
+{
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        if(error) *error = QString("Could not open camera path %1").arg(filename);
+        return false;
+    }
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    QJsonArray keys = root["keyframes"].toArray();
+    if(keys.isEmpty())
+    {
+        if(error) *error = QString("Camera path %1 has no keyframes").arg(filename);
+        return false;
+    }
+
+    *path = CameraPath();
+    path->m_frames = std::max(1, root["frames"].toInt(1));
+    path->m_smooth = root["interpolation"].toString("smooth") != "linear";
+    for(int i = 0; i < keys.size(); i++)
+    {
+        QJsonObject key = keys[i].toObject();
+        Camera c = ReadCamera(key);
+        path->m_near_clip = c.m_near_clip;
+        path->m_far_clip = c.m_far_clip;
+        path->AddKeyframe(c, key["time"].toDouble(i));
+    }
+    return true;
+}
+
+void CameraPath::AddKeyframe(const Camera& c, float time)
+{
+    // (right, up, -forward) is right handed, so it's a proper rotation that quat_cast can take
+    glm::mat3 basis(glm::vec3(c.m_right), glm::vec3(c.m_up), -glm::vec3(c.m_forward));
+    CameraKeyframe key = {time, glm::vec3(c.m_position), glm::quat_cast(basis), c.m_fov};
+    auto it = std::upper_bound(m_keys.begin(), m_keys.end(), time,
+                               [](float t, const CameraKeyframe& k) { return t < k.time; });
+    m_keys.insert(it, key);
+}
+
+static glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1,
+                            const glm::vec3& p2, const glm::vec3& p3, float s)
+{
+    const float s2 = s * s;
+    const float s3 = s2 * s;
+    return 0.5f * ((2.f * p1) + (-p0 + p2) * s
+                   + (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * s2
+                   + (-p0 + 3.f * p1 - 3.f * p2 + p3) * s3);
+}
+
+Camera CameraPath::Evaluate(float t, float aspect_ratio) const
+{
+    const int n = static_cast<int>(m_keys.size());
+    // find the segment [i, i+1] containing t
+    int i = 0;
+    while(i + 1 < n && m_keys[i + 1].time <= t)
+    {
+        i++;
+    }
+    const int j = std::min(i + 1, n - 1);
+    const CameraKeyframe& a = m_keys[i];
+    const CameraKeyframe& b = m_keys[j];
+    const float span = b.time - a.time;
+    const float s = span > 0.f ? glm::clamp((t - a.time) / span, 0.f, 1.f) : 0.f;
+
+    glm::vec3 pos;
+    if(m_smooth)
+    {
+        const glm::vec3& p0 = m_keys[std::max(i - 1, 0)].position;
+        const glm::vec3& p3 = m_keys[std::min(j + 1, n - 1)].position;
+        pos = catmullRom(p0, a.position, b.position, p3, s);
+    }
+    else
+    {
+        pos = glm::mix(a.position, b.position, s);
+    }
+
+    // take the short way around
+    glm::quat qb = b.orientation;
+    if(glm::dot(a.orientation, qb) < 0.f)
+    {
+        qb = -qb;
+    }
+    const glm::mat3 basis = glm::mat3_cast(glm::normalize(glm::slerp(a.orientation, qb, s)));
+
+    return Camera(glm::vec4(-basis[2], 0.f),
+                  glm::vec4(basis[0], 0.f),
+                  glm::vec4(basis[1], 0.f),
+                  glm::mix(a.fov, b.fov, s),
+                  glm::vec4(pos, 1.f),
+                  m_near_clip,
+                  m_far_clip,
+                  aspect_ratio);
+}
+
+Camera CameraPath::Frame(int i, float aspect_ratio) const
+{
+    const float start = m_keys.front().time;
+    const float end = m_keys.back().time;
+    const float s = m_frames > 1 ? float(i) / (m_frames - 1) : 0.f;
+    return Evaluate(start + (end - start) * s, aspect_ratio);
+}
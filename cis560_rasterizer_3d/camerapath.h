@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QString>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include "camera.h"
+
+// One pose of a camera path
+struct CameraKeyframe
+{
+    float time;
+    glm::vec3 position;
+    glm::quat orientation;  // rotates the camera's local axes (right, up, -forward) into world space
+    float fov;
+};
+
+// A keyframed camera animation, loaded from JSON of the form
+// {"frames": N, "interpolation": "smooth" | "linear",
+//  "keyframes": [{"time": t, "eye": [x,y,z], "target": [x,y,z], "up": [x,y,z], "fov": degrees}, ...]}
+// Orientations are slerped, positions are linear or Catmull-Rom ("smooth", the default)
+// and fov is linear. Frames are spread evenly from the first keyframe's time to the last.
+class CameraPath
+{
+public:
+    CameraPath();
+
+    // Returns false and fills *error if the file can't be read or has no keyframes
+    static bool Load(const QString& filename, CameraPath* path, QString* error = nullptr);
+
+    void AddKeyframe(const Camera& c, float time);
+
+    // the camera at time t, clamped to the keyframe range
+    Camera Evaluate(float t, float aspect_ratio) const;
+    // the camera of frame i out of m_frames
+    Camera Frame(int i, float aspect_ratio) const;
+
+    int m_frames;
+    bool m_smooth;
+    float m_near_clip;
+    float m_far_clip;
+    std::vector<CameraKeyframe> m_keys;  // sorted by time
+};
@@ -0,0 +1,52 @@
+#include "cameraset.h"
+
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+
+std::vector<Camera> OrbitCameraSet(const std::vector<Polygon>& scene, int count, float aspect_ratio,
+                                   const SceneGraph* graph)
+{
+    SceneGraph updated;
+    if (graph) {
+        updated = *graph;
+        updated.Update();
+    }
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    for (const Polygon& p : scene) {
+        const glm::mat4& model = updated.World(graph ? p.m_node : -1);
+        for (const glm::vec3& v : p.m_positions) {
+            const glm::vec3 pos(model * glm::vec4(v, 1.f));
+            lo = glm::min(lo, pos);
+            hi = glm::max(hi, pos);
+        }
+    }
+    if (lo.x > hi.x) {  // empty scene
+        lo = hi = glm::vec3(0.f);
+    }
+    const glm::vec3 center = 0.5f * (lo + hi);
+    const float radius = std::max(0.5f * glm::length(hi - lo), 1e-3f);
+
+    const Camera defaults;
+    // far enough back that the bounding sphere fits in the narrower of the two fovs
+    const float halfFov = glm::radians(defaults.m_fov) * 0.5f;
+    const float halfFovX = std::atan(std::tan(halfFov) * aspect_ratio);
+    const float dist = radius / std::sin(std::min(halfFov, halfFovX));
+
+    std::vector<Camera> cameras;
+    for (int i = 0; i < count; i++) {
+        const float azimuth = 2.f * glm::pi<float>() * i / count;
+        const float elevation = glm::radians(i % 2 == 0 ? 20.f : -20.f);
+        const glm::vec3 dir(std::cos(elevation) * std::sin(azimuth),
+                            std::sin(elevation),
+                            std::cos(elevation) * std::cos(azimuth));
+        const glm::vec3 eye = center + dir * dist;
+        cameras.push_back(Camera::LookAt(glm::vec4(eye, 1.f), glm::vec4(center, 1.f), glm::vec4(0, 1, 0, 0),
+                                         defaults.m_fov,
+                                         std::min(defaults.m_near_clip, 0.1f * (dist - radius)),
+                                         std::max(defaults.m_far_clip, 2.f * (dist + radius)),
+                                         aspect_ratio));
+    }
+    return cameras;
+}
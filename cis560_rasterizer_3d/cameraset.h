@@ -0,0 +1,13 @@
+#pragma once
+
+#include <vector>
+#include "camera.h"
+#include "polygon.h"
+#include "scenegraph.h"
+
+// A fixed, reproducible set of count cameras orbiting the scene's bounding sphere, alternating
+// above and below its equator, each framing the whole scene. Only depends on the geometry, so
+// the same scene always gets the same poses, whatever camera it was saved or viewed with.
+// Polygons hanging from graph nodes are framed where the graph puts them.
+std::vector<Camera> OrbitCameraSet(const std::vector<Polygon>& scene, int count = 8, float aspect_ratio = 1.f,
+                                   const SceneGraph* graph = nullptr);
@@ -0,0 +1,18 @@
+# Headless renderer: loads a scene, renders one frame and writes it to disk.
+# Needs no display server, so it runs on render nodes without X/Wayland.
+include(../rasterizer_core.pri)
+
+# --depth writes 16 bit grayscale images, QImage::Format_Grayscale16 came with Qt 5.13
+equals(QT_MAJOR_VERSION, 5):lessThan(QT_MINOR_VERSION, 13) {
+    error("rasterizer_cli needs Qt 5.13 or newer, this is Qt $$QT_VERSION")
+}
+
+QT -= widgets
+
+TARGET = rasterizer_cli
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp \
+    ../allocationcounter.cpp
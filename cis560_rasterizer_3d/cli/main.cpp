@@ -0,0 +1,326 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QImage>
+#include <QImageWriter>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QStringList>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "batchrender.h"
+#include "camera.h"
+#include "camerapath.h"
+#include "constants.h"
+#include "kernels.h"
+#include "rasterizer.h"
+#include "sceneloader.h"
+
+// parses "x,y,z" into a json array so it can go through ReadCamera like a camera file
+static bool parseVec3(const QString& s, QJsonArray* out)
+{
+    QStringList parts = s.split(",");
+    if(parts.size() != 3)
+    {
+        return false;
+    }
+    QJsonArray arr;
+    for(const QString& part : parts)
+    {
+        bool ok = false;
+        arr.append(part.toDouble(&ok));
+        if(!ok) return false;
+    }
+    *out = arr;
+    return true;
+}
+
+static bool parseRenderMode(const QString& s, RenderMode* mode)
+{
+    static const struct { const char* name; RenderMode mode; } modes[] = {
+        {"shaded", RenderMode::Shaded},
+        {"overdraw", RenderMode::Overdraw},
+        {"shaded-count", RenderMode::ShadedCount},
+        {"tile-time", RenderMode::TileTime},
+    };
+    for(const auto& m : modes)
+    {
+        if(s == m.name)
+        {
+            *mode = m.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+// writes the depth m_zbuffer holds after RenderDepth. a .pfm file keeps the floats as they are
+// (bottom row first, as the format wants), infinity where nothing was drawn. anything else gets
+// 16 bit grayscale, black at the nearest depth, almost white at the farthest and white where
+// nothing was drawn
+static bool writeDepth(const Rasterizer& rasterizer, const QString& filename, QString* error)
+{
+    const int width = rasterizer.Width(), height = rasterizer.Height();
+    const std::vector<float>& depth = rasterizer.m_zbuffer;
+    if(filename.endsWith(".pfm", Qt::CaseInsensitive))
+    {
+        QFile file(filename);
+        if(!file.open(QIODevice::WriteOnly))
+        {
+            *error = QString("Could not open %1").arg(filename);
+            return false;
+        }
+        // a negative scale marks the floats as little endian
+        file.write(QString("Pf\n%1 %2\n-1\n").arg(width).arg(height).toLatin1());
+        for(int y = height - 1; y >= 0; y--)
+        {
+            file.write(reinterpret_cast<const char*>(&depth[size_t(y) * width]), qint64(width * sizeof(float)));
+        }
+        return true;
+    }
+
+    const float inf = std::numeric_limits<float>::infinity();
+    float nearest = inf, farthest = 0.f;
+    for(float z : depth)
+    {
+        if(z < inf)
+        {
+            nearest = std::min(nearest, z);
+            farthest = std::max(farthest, z);
+        }
+    }
+    const float scale = farthest > nearest ? 65534.f / (farthest - nearest) : 0.f;
+    QImage image(width, height, QImage::Format_Grayscale16);
+    for(int y = 0; y < height; y++)
+    {
+        quint16* line = reinterpret_cast<quint16*>(image.scanLine(y));
+        for(int x = 0; x < width; x++)
+        {
+            const float z = depth[size_t(y) * width + x];
+            line[x] = z < inf ? quint16(std::lround((z - nearest) * scale)) : quint16(65535);
+        }
+    }
+    QImageWriter writer(filename);
+    if(!writer.write(image))
+    {
+        *error = writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+static int fail(const QString& msg)
+{
+    std::cerr << msg.toStdString() << std::endl;
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    // QCoreApplication, not QApplication: no platform plugin or display is needed
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("rasterizer_cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders a scene JSON file without a GUI: one frame, or with --path\n"
+                                     "an image sequence along a keyframed camera path.");
+    parser.addHelpOption();
+    QCommandLineOption sceneOpt("scene", "Scene JSON file to render.", "file");
+    QCommandLineOption outputOpt({"o", "output"}, "Image to write. The format follows the extension.", "file");
+    QCommandLineOption cameraOpt("camera", "Camera JSON file: {\"eye\", \"target\", \"up\", \"fov\", \"near\", \"far\"}.", "file");
+    QCommandLineOption eyeOpt("eye", "Camera position, overrides the camera file.", "x,y,z");
+    QCommandLineOption targetOpt("target", "Point the camera looks at, overrides the camera file.", "x,y,z");
+    QCommandLineOption upOpt("up", "Camera up vector, overrides the camera file.", "x,y,z");
+    QCommandLineOption fovOpt("fov", "Vertical field of view in degrees, overrides the camera file.", "degrees");
+    QCommandLineOption widthOpt("width", "Output width in pixels.", "pixels", QString::number(int(SCREEN_WIDTH)));
+    QCommandLineOption heightOpt("height", "Output height in pixels.", "pixels", QString::number(int(SCREEN_HEIGHT)));
+    QCommandLineOption pathOpt("path", "Camera keyframe JSON file. Renders its frames as an image sequence named after --output, "
+                                       "where a run of '#' in the name becomes the frame number.", "file");
+    QCommandLineOption threadsOpt("threads", "Worker threads for --path, each rendering whole frames.", "count",
+                                  QString::number(QThread::idealThreadCount()));
+    QCommandLineOption statsOpt("stats", "Print the render statistics of the frame to stderr.");
+    QCommandLineOption memoryOpt("memory", "Print the memory the scene and the renderer hold after the frame, by category "
+                                           "and per object, to stderr.");
+    QCommandLineOption cullOpt("cull-backfaces", "Skip triangles facing away from the camera.");
+    QCommandLineOption prepassOpt("depth-prepass", "Lay down the scene's depth first, so each pixel is only shaded once.");
+    QCommandLineOption depthOpt("depth", "Write the depth along the view axis instead of the shaded image, rendered "
+                                         "depth-only. A .pfm output keeps the floats, other formats get 16 bit grayscale.");
+    QCommandLineOption shadowFilterOpt("shadow-filter", QString("Radius of the percentage closer filter over the shadow maps, "
+                                                                "0 for hard shadows, up to %1.").arg(SHADOW_MAX_FILTER),
+                                       "texels", "1");
+    QCommandLineOption modeOpt("mode", "What to draw: shaded, or a heatmap of overdraw (depth tests per pixel), "
+                                       "shaded-count (fragments shaded per pixel) or tile-time.", "mode", "shaded");
+    QStringList isas;
+    for(const char* name : SupportedKernelISAs())
+    {
+        isas.append(name);
+    }
+    QCommandLineOption isaOpt("isa", QString("Instruction set of the raster kernels, instead of the best one this CPU "
+                                             "supports (%1).").arg(isas.join(", ")), "isa");
+    parser.addOption(sceneOpt);
+    parser.addOption(outputOpt);
+    parser.addOption(cameraOpt);
+    parser.addOption(eyeOpt);
+    parser.addOption(targetOpt);
+    parser.addOption(upOpt);
+    parser.addOption(fovOpt);
+    parser.addOption(widthOpt);
+    parser.addOption(heightOpt);
+    parser.addOption(pathOpt);
+    parser.addOption(threadsOpt);
+    parser.addOption(statsOpt);
+    parser.addOption(memoryOpt);
+    parser.addOption(cullOpt);
+    parser.addOption(prepassOpt);
+    parser.addOption(depthOpt);
+    parser.addOption(shadowFilterOpt);
+    parser.addOption(modeOpt);
+    parser.addOption(isaOpt);
+    parser.process(a);
+
+    if(!parser.isSet(sceneOpt) || !parser.isSet(outputOpt))
+    {
+        return fail("--scene and --output are required (see --help)");
+    }
+
+    bool okW = false, okH = false;
+    const int width = parser.value(widthOpt).toInt(&okW);
+    const int height = parser.value(heightOpt).toInt(&okH);
+    if(!okW || !okH || width <= 0 || height <= 0)
+    {
+        return fail("--width and --height must be positive integers");
+    }
+
+    bool okFilter = false;
+    const int shadowFilter = parser.value(shadowFilterOpt).toInt(&okFilter);
+    if(!okFilter || shadowFilter < 0 || shadowFilter > SHADOW_MAX_FILTER)
+    {
+        return fail(QString("--shadow-filter must be between 0 and %1").arg(SHADOW_MAX_FILTER));
+    }
+
+    RenderMode mode;
+    if(!parseRenderMode(parser.value(modeOpt), &mode))
+    {
+        return fail(QString("Unknown --mode %1").arg(parser.value(modeOpt)));
+    }
+    if(parser.isSet(isaOpt) && !SelectKernels(parser.value(isaOpt).toStdString().c_str()))
+    {
+        return fail(QString("--isa %1 is unknown or not supported by this CPU").arg(parser.value(isaOpt)));
+    }
+
+    // camera: start from the file (if any), then apply the individual overrides
+    QJsonObject camJson;
+    if(parser.isSet(cameraOpt))
+    {
+        QFile camFile(parser.value(cameraOpt));
+        if(!camFile.open(QIODevice::ReadOnly))
+        {
+            return fail(QString("Could not open camera file %1").arg(parser.value(cameraOpt)));
+        }
+        camJson = QJsonDocument::fromJson(camFile.readAll()).object();
+    }
+    const QCommandLineOption* vecOpts[] = {&eyeOpt, &targetOpt, &upOpt};
+    const char* vecKeys[] = {"eye", "target", "up"};
+    for(int i = 0; i < 3; i++)
+    {
+        if(!parser.isSet(*vecOpts[i])) continue;
+        QJsonArray v;
+        if(!parseVec3(parser.value(*vecOpts[i]), &v))
+        {
+            return fail(QString("--%1 expects x,y,z").arg(vecKeys[i]));
+        }
+        camJson.insert(vecKeys[i], v);
+    }
+    if(parser.isSet(fovOpt))
+    {
+        camJson.insert("fov", parser.value(fovOpt).toDouble());
+    }
+
+    CameraPath path;
+    QString errors;
+    if(parser.isSet(pathOpt) && !CameraPath::Load(parser.value(pathOpt), &path, &errors))
+    {
+        return fail(errors);
+    }
+
+    // loaded once, then shared read-only by every rasterizer
+    auto polygons = std::make_shared<std::vector<Polygon>>();
+    std::vector<Light> lights;
+    SceneGraph graph;
+    if(!LoadScene(parser.value(sceneOpt), polygons.get(), &errors, &lights, &graph))
+    {
+        return fail(errors);
+    }
+    if(!errors.isEmpty())
+    {
+        std::cerr << errors.toStdString();
+    }
+
+    if(parser.isSet(pathOpt))
+    {
+        if(parser.isSet(depthOpt))
+        {
+            return fail("--depth renders a single frame, not a --path");
+        }
+        if(parser.isSet(memoryOpt) || parser.isSet(statsOpt))
+        {
+            return fail("--memory and --stats report on a single frame, not a --path");
+        }
+        const int threads = std::max(1, parser.value(threadsOpt).toInt());
+        PathSettings settings;
+        settings.renderMode = mode;
+        settings.shadowFilter = shadowFilter;
+        settings.cullBackfaces = parser.isSet(cullOpt);
+        settings.depthPrepass = parser.isSet(prepassOpt);
+        if(!RenderCameraPath(polygons, lights, graph, path, parser.value(outputOpt), width, height, threads,
+                             settings, &errors))
+        {
+            return fail(errors);
+        }
+        return 0;
+    }
+
+    Rasterizer rasterizer(polygons);
+    rasterizer.m_camera = ReadCamera(camJson, float(width) / height);
+    rasterizer.m_lights = lights;
+    rasterizer.m_sceneGraph = graph;
+    rasterizer.m_cullBackfaces = parser.isSet(cullOpt);
+    rasterizer.m_shadowFilter = shadowFilter;
+    rasterizer.m_depthPrepass = parser.isSet(prepassOpt);
+    rasterizer.m_renderMode = mode;
+    rasterizer.SetResolution(width, height);
+    if(parser.isSet(depthOpt))
+    {
+        rasterizer.RenderDepth();
+        if(parser.isSet(statsOpt))
+        {
+            rasterizer.m_stats.Print(std::cerr);
+        }
+        if(parser.isSet(memoryOpt))
+        {
+            rasterizer.Memory().Print(std::cerr);
+        }
+        return writeDepth(rasterizer, parser.value(outputOpt), &errors) ? 0 : fail(errors);
+    }
+    QImage image = rasterizer.RenderScene();
+    if(parser.isSet(statsOpt))
+    {
+        rasterizer.m_stats.Print(std::cerr);
+    }
+    if(parser.isSet(memoryOpt))
+    {
+        rasterizer.Memory().Print(std::cerr);
+    }
+
+    QImageWriter writer(parser.value(outputOpt));
+    if(!writer.write(image))
+    {
+        return fail(writer.errorString());
+    }
+    return 0;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+// the default render resolution, see Rasterizer::SetResolution
 // float to avoid bad initialization or rounding?
 constexpr float SCREEN_WIDTH = 512;
 constexpr float SCREEN_HEIGHT = 512;
@@ -8,3 +9,37 @@ constexpr float EPS = 1e-3f;
 
 constexpr float TRANSLATE_STEP = 0.5f;
 constexpr float ROTATE_STEP = 5;  // degrees
+
+// scene lights, see Rasterizer::m_lights
+constexpr int LIGHT_TILE_SIZE = 16;    // pixels per side of the tiles lights are culled against
+constexpr float LIGHT_AMBIENT = 0.1f;  // light every lit pixel gets regardless of the lights
+
+// shadow maps, see Rasterizer::m_shadowFilter
+constexpr int SHADOW_MAP_SIZE = 512;          // texels per side of a spot light's depth map
+constexpr int SHADOW_CUBE_SIZE = 256;         // the same for each of the six faces around a point light
+constexpr int SHADOW_MAX_LIGHTS = 4;          // lights past this many cast no shadows, so the cost stays bounded
+constexpr int SHADOW_MAX_FILTER = 3;          // the widest filter, 7x7 taps
+constexpr float SHADOW_MAX_SPOT_DEG = 60;     // wider spot lights get a cube like point lights
+constexpr float SHADOW_NEAR_RATIO = 0.01f;    // near plane of a light's views, relative to its range
+constexpr float SHADOW_OFFSET_TEXELS = 1.5f;  // how far receivers move off their surface and towards the light, against acne
+
+// heatmap render modes
+constexpr int HEATMAP_TILE_SIZE = 32;  // pixels per side of a tile in the tile time mode
+constexpr float HEATMAP_MAX_COUNT = 8;  // per-pixel count shown as the hottest color
+
+// dynamic resolution, see DynamicResolution
+constexpr double DYNRES_TARGET_MS = 1000.0 / 30;  // frame time the interactive preview aims for
+constexpr float DYNRES_MIN_SCALE = 0.25f;          // never below a quarter of the resolution per side
+constexpr float DYNRES_SCALE_STEP = 1.f / 16;      // scales are multiples of this, so target sizes repeat
+constexpr int DYNRES_REFINE_DELAY_MS = 150;        // idle time before a scaled down view is redone at full size
+
+// temporal reprojection, see Rasterizer::m_temporal
+constexpr int TEMPORAL_TILE_SIZE = 8;         // triangles only covering fully reused tiles are skipped
+constexpr int TEMPORAL_REFRESH_FRAMES = 16;   // reprojected frames in a row before a full one
+constexpr float TEMPORAL_MAX_INVALID = 0.3f;  // fraction of the frame newly uncovered above which a full frame is cheaper
+constexpr float TEMPORAL_MAX_LIGHT_DEG = 10;  // the light follows the camera, so turning further than this makes old shading wrong
+
+constexpr float PROGRESSIVE_PREVIEW_SCALE = 0.25f;  // resolution per side of the first progressive stage
+
+constexpr int ACCUMULATION_MAX_SAMPLES = 64;     // jittered frames averaged while idle, then it stops
+constexpr int ACCUMULATION_DELAY_MS = 150;       // idle time before the first one
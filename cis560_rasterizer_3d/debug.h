@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include <iostream>
+#include <QRgb>
 #include "polygon.h"
 #include "camera.h"
 
@@ -52,14 +53,26 @@ inline void printCamera(const Camera& c) {
 
 }
 
-inline void drawBoundingBox(const Triangle& t, QImage& result) {
-    if (t.offScreen) return;
-    for (int x = t.m_boundingBox.minX; x < t.m_boundingBox.maxX; x++) {
-        result.setPixelColor(x, (int)t.m_boundingBox.minY, QColor(0,255,0));
-        result.setPixelColor(x, (int)t.m_boundingBox.maxY, QColor(0,255,0));
+inline void drawBoundingBox(const BoundingBox& bb, QImage& result) {
+    for (int x = bb.minX; x < bb.maxX; x++) {
+        result.setPixelColor(x, (int)bb.minY, QColor(0,255,0));
+        result.setPixelColor(x, (int)bb.maxY, QColor(0,255,0));
     }
-    for (int y = t.m_boundingBox.minY; y < t.m_boundingBox.maxY; y++) {
-        result.setPixelColor((int)t.m_boundingBox.minX, y, QColor(0,255,0));
-        result.setPixelColor((int)t.m_boundingBox.maxX, y, QColor(0,255,0));
+    for (int y = bb.minY; y < bb.maxY; y++) {
+        result.setPixelColor((int)bb.minX, y, QColor(0,255,0));
+        result.setPixelColor((int)bb.maxX, y, QColor(0,255,0));
+    }
+}
+
+// blue -> cyan -> green -> yellow -> red as t goes from 0 to 1
+inline QRgb heatmapColor(float t) {
+    t = glm::clamp(t, 0.f, 1.f) * 4.f;
+    const int seg = std::min(int(t), 3);
+    const int f = int((t - seg) * 255.f + 0.5f);
+    switch (seg) {
+    case 0:  return qRgb(0, f, 255);
+    case 1:  return qRgb(0, 255, 255 - f);
+    case 2:  return qRgb(f, 255, 0);
+    default: return qRgb(255, 255 - f, 0);
     }
 }
@@ -0,0 +1,42 @@
+#include "dynamicresolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+DynamicResolution::DynamicResolution(double target_ms)
+    : m_targetMs(target_ms), m_averageMs(0), m_scale(1.f)
+{}
+
+void DynamicResolution::SetTarget(double ms)
+{
+    m_targetMs = ms;
+}
+
+bool DynamicResolution::FrameDone(double ms)
+{
+    m_averageMs = (m_averageMs == 0) ? ms : 0.7 * m_averageMs + 0.3 * ms;
+    const double ratio = m_targetMs / std::max(m_averageMs, 1e-3);
+    // a dead band, so noise around the target doesn't flip between two sizes
+    if(ratio > 0.9 && ratio < 1.25)
+    {
+        return false;
+    }
+
+    // most of the frame time goes with the pixel count, which goes with the square of the scale
+    const float ideal = m_scale * float(std::sqrt(ratio));
+    const float stepped = std::round(ideal / DYNRES_SCALE_STEP) * DYNRES_SCALE_STEP;
+    const float scale = std::min(1.f, std::max(DYNRES_MIN_SCALE, stepped));
+    if(scale == m_scale)
+    {
+        return false;
+    }
+    m_scale = scale;
+    m_averageMs = 0;  // the old times say little about the new size
+    return true;
+}
+
+void DynamicResolution::Reset()
+{
+    m_scale = 1.f;
+    m_averageMs = 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "constants.h"
+
+// Picks the fraction of the full resolution (per side) to render at so frames take about a
+// target time. Fed the time of every frame, it scales down quickly when frames run long and
+// back up once there is clear headroom, in DYNRES_SCALE_STEP steps so it doesn't hunt.
+class DynamicResolution
+{
+public:
+    explicit DynamicResolution(double target_ms = DYNRES_TARGET_MS);
+
+    void SetTarget(double ms);
+
+    // the scale to render the next frame at, in [DYNRES_MIN_SCALE, 1]
+    float Scale() const { return m_scale; }
+
+    // reports how long a frame rendered at Scale() took. returns true if Scale() changed
+    bool FrameDone(double ms);
+
+    // back to full resolution, forgetting the frame times seen so far
+    void Reset();
+
+private:
+    double m_targetMs;
+    double m_averageMs;  // smoothed time of the frames at the current scale, 0 before the first
+    float m_scale;
+};
@@ -0,0 +1,77 @@
+#include "framearena.h"
+
+#include <algorithm>
+#include <new>
+
+// every allocation starts on a cache line, so no two threads' or arrays' data share one and
+// the kernels' vector loads never straddle more lines than they must
+static constexpr size_t ALIGNMENT = 64;
+// the smallest block, so a first frame doesn't go through a string of tiny ones
+static constexpr size_t MIN_BLOCK_SIZE = size_t(1) << 18;
+
+void FrameArena::Free::operator()(unsigned char* p) const
+{
+    ::operator delete(p, std::align_val_t(ALIGNMENT));
+}
+
+void FrameArena::addBlock(size_t bytes)
+{
+    Block block;
+    block.data.reset(static_cast<unsigned char*>(::operator new(bytes, std::align_val_t(ALIGNMENT))));
+    block.size = bytes;
+    m_blocks.push_back(std::move(block));
+}
+
+void* FrameArena::allocate(size_t bytes)
+{
+    bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    // what's left of a block too small for it goes unused until the next Reset or Rewind
+    while(m_block < m_blocks.size() && m_offset + bytes > m_blocks[m_block].size)
+    {
+        m_block++;
+        m_offset = 0;
+    }
+    if(m_block == m_blocks.size())
+    {
+        // at least doubling, so a growing frame needs only a few
+        addBlock(std::max({bytes, Capacity(), MIN_BLOCK_SIZE}));
+    }
+    void* p = m_blocks[m_block].data.get() + m_offset;
+    m_offset += bytes;
+
+    size_t used = m_offset;
+    for(size_t i = 0; i < m_block; i++)
+    {
+        used += m_blocks[i].size;
+    }
+    m_peak = std::max(m_peak, used);
+    return p;
+}
+
+void FrameArena::Rewind(const Marker& marker)
+{
+    m_block = marker.block;
+    m_offset = marker.offset;
+}
+
+void FrameArena::Reset()
+{
+    if(m_blocks.size() > 1)
+    {
+        const size_t total = Capacity();
+        m_blocks.clear();
+        addBlock(total);
+    }
+    m_block = 0;
+    m_offset = 0;
+}
+
+size_t FrameArena::Capacity() const
+{
+    size_t total = 0;
+    for(const Block& b : m_blocks)
+    {
+        total += b.size;
+    }
+    return total;
+}
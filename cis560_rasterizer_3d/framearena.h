@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// A linear allocator for the scratch memory of one frame. Allocating bumps an offset, and
+// Reset drops everything at once, so nothing is freed piece by piece. It belongs to a single
+// thread: every Rasterizer has its own, and so does every thread rendering with one.
+// Memory is only ever asked for when a frame needs more than any frame before, and a frame that
+// spilled into extra blocks gets them merged into one for the next, so a steady stream of
+// similar frames runs in a single block without touching the global allocator.
+class FrameArena
+{
+public:
+    // where the arena is at, for Rewind
+    struct Marker
+    {
+        size_t block = 0;
+        size_t offset = 0;
+    };
+
+    // frees what was allocated since its construction when it goes out of scope
+    class Scope
+    {
+    public:
+        explicit Scope(FrameArena& arena) : m_arena(arena), m_marker(arena.Mark()) {}
+        ~Scope() { m_arena.Rewind(m_marker); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        FrameArena& m_arena;
+        Marker m_marker;
+    };
+
+    // room for n Ts, cache line aligned. it stays valid until the next Reset, or a Rewind to
+    // before it. nothing is constructed, so types with constructors (glm's) are placement new'd
+    // into it, and nothing is ever destroyed
+    template <typename T>
+    T* Allocate(size_t n)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is dropped without destructors");
+        return static_cast<T*>(allocate(n * sizeof(T)));
+    }
+
+    Marker Mark() const { return {m_block, m_offset}; }
+    // frees everything allocated since the marker was taken
+    void Rewind(const Marker& marker);
+    // frees everything. the blocks are kept, merged into one if the frame needed several
+    void Reset();
+
+    size_t Capacity() const;                      // bytes held, in use or not
+    size_t PeakBytes() const { return m_peak; }  // the most ever in use at once
+
+private:
+    struct Free
+    {
+        void operator()(unsigned char* p) const;
+    };
+    struct Block
+    {
+        std::unique_ptr<unsigned char[], Free> data;
+        size_t size;
+    };
+
+    void* allocate(size_t bytes);
+    void addBlock(size_t bytes);
+
+    std::vector<Block> m_blocks;
+    size_t m_block = 0;   // the block being allocated from
+    size_t m_offset = 0;  // into it
+    size_t m_peak = 0;
+};
@@ -0,0 +1,39 @@
+#include "frameitem.h"
+#include <QPainter>
+
+FrameItem::FrameItem(QGraphicsItem* parent)
+    : QGraphicsItem(parent), mp_image(nullptr), m_size(0, 0)
+{}
+
+void FrameItem::SetImage(const QImage* image, const QSize& size)
+{
+    // the scene has to hear about a size change before it happens
+    if(size != m_size)
+    {
+        prepareGeometryChange();
+    }
+    mp_image = image;
+    m_size = size;
+    update();
+}
+
+QRectF FrameItem::boundingRect() const
+{
+    return QRectF(0, 0, m_size.width(), m_size.height());
+}
+
+void FrameItem::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*)
+{
+    if(!mp_image || mp_image->isNull())
+    {
+        return;
+    }
+    if(mp_image->size() == m_size)
+    {
+        painter->drawImage(0, 0, *mp_image);
+        return;
+    }
+    // upscaled on the fly, which is cheaper than any copy
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    painter->drawImage(boundingRect(), *mp_image);
+}
@@ -0,0 +1,25 @@
+#ifndef FRAMEITEM_H
+#define FRAMEITEM_H
+
+#include <QGraphicsItem>
+#include <QImage>
+
+// Paints an image owned by someone else, e.g. a render target, without copying it into a pixmap,
+// stretched to a display size when the image was rendered smaller.
+// The owner keeps the image alive and calls SetImage again (or update()) after changing it
+class FrameItem : public QGraphicsItem
+{
+public:
+    explicit FrameItem(QGraphicsItem* parent = nullptr);
+
+    void SetImage(const QImage* image, const QSize& size);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) override;
+
+private:
+    const QImage* mp_image;
+    QSize m_size;
+};
+
+#endif // FRAMEITEM_H
@@ -0,0 +1,433 @@
+#include "gltfloader.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QByteArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t GLB_MAGIC = 0x46546C67;       // "glTF"
+constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;  // "JSON"
+constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;   // "BIN\0"
+
+// glTF componentType values
+enum ComponentType {
+    BYTE = 5120, UNSIGNED_BYTE = 5121, SHORT = 5122, UNSIGNED_SHORT = 5123,
+    UNSIGNED_INT = 5125, FLOAT = 5126
+};
+
+constexpr int MODE_TRIANGLES = 4;
+
+struct Span {
+    const uchar* data = nullptr;
+    size_t length = 0;
+};
+
+// a typed, strided window onto a buffer. nothing is copied out of the buffer until it's read
+struct Accessor {
+    const uchar* data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;
+    int componentType = 0;
+    int components = 0;
+    bool normalized = false;
+
+    bool valid() const { return data != nullptr || count == 0; }
+
+    // component c of element i, converted to float (normalized integers map to [0,1] / [-1,1])
+    float get(size_t i, int c) const {
+        const uchar* e = data + i * stride;
+        switch (componentType) {
+        case FLOAT:          { float v;    std::memcpy(&v, e + 4 * c, 4); return v; }
+        case UNSIGNED_BYTE:  { uint8_t v = e[c];                              return normalized ? v / 255.f : v; }
+        case BYTE:           { int8_t v = static_cast<int8_t>(e[c]);          return normalized ? glm::max(v / 127.f, -1.f) : v; }
+        case UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, e + 2 * c, 2); return normalized ? v / 65535.f : v; }
+        case SHORT:          { int16_t v;  std::memcpy(&v, e + 2 * c, 2); return normalized ? glm::max(v / 32767.f, -1.f) : v; }
+        case UNSIGNED_INT:   { uint32_t v; std::memcpy(&v, e + 4 * c, 4); return static_cast<float>(v); }
+        }
+        return 0.f;
+    }
+
+    uint32_t index(size_t i) const {
+        const uchar* e = data + i * stride;
+        switch (componentType) {
+        case UNSIGNED_BYTE:  return e[0];
+        case UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, e, 2); return v; }
+        case UNSIGNED_INT:   { uint32_t v; std::memcpy(&v, e, 4); return v; }
+        }
+        return 0;
+    }
+
+    // true if element i is c packed floats, i.e. the stream can be read without conversion
+    bool isPackedFloat(int c) const {
+        return componentType == FLOAT && components == c && stride == sizeof(float) * c;
+    }
+};
+
+int componentSize(int componentType) {
+    switch (componentType) {
+    case BYTE: case UNSIGNED_BYTE: return 1;
+    case SHORT: case UNSIGNED_SHORT: return 2;
+    case UNSIGNED_INT: case FLOAT: return 4;
+    }
+    return 0;
+}
+
+int componentCount(const QString& type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT4") return 16;
+    return 0;
+}
+
+class GLTFReader {
+public:
+    GLTFReader(const QJsonObject& doc, std::vector<Span> buffers)
+        : m_doc(doc), m_buffers(std::move(buffers))
+    {}
+
+    Span bufferView(int idx) const {
+        const QJsonArray views = m_doc["bufferViews"].toArray();
+        if (idx < 0 || idx >= views.size()) return Span();
+        const QJsonObject v = views[idx].toObject();
+        const int buf = v["buffer"].toInt();
+        if (buf < 0 || buf >= static_cast<int>(m_buffers.size())) return Span();
+        const size_t offset = static_cast<size_t>(v["byteOffset"].toDouble(0));
+        const size_t length = static_cast<size_t>(v["byteLength"].toDouble(0));
+        if (offset + length > m_buffers[buf].length) return Span();
+        return Span{m_buffers[buf].data + offset, length};
+    }
+
+    Accessor accessor(int idx) const {
+        Accessor a;
+        const QJsonArray accessors = m_doc["accessors"].toArray();
+        if (idx < 0 || idx >= accessors.size()) return a;
+        const QJsonObject acc = accessors[idx].toObject();
+        a.count = static_cast<size_t>(acc["count"].toDouble(0));
+        a.componentType = acc["componentType"].toInt();
+        a.components = componentCount(acc["type"].toString());
+        a.normalized = acc["normalized"].toBool(false);
+        const size_t elemSize = componentSize(a.componentType) * a.components;
+        if (elemSize == 0 || !acc.contains("bufferView")) return a;  // sparse-only accessors aren't supported
+
+        const int viewIdx = acc["bufferView"].toInt();
+        const Span view = bufferView(viewIdx);
+        const size_t offset = static_cast<size_t>(acc["byteOffset"].toDouble(0));
+        const size_t viewStride = static_cast<size_t>(
+            m_doc["bufferViews"].toArray()[viewIdx].toObject()["byteStride"].toDouble(0));
+        a.stride = viewStride ? viewStride : elemSize;
+        if (a.count > 0 && offset + (a.count - 1) * a.stride + elemSize > view.length) return a;
+        a.data = view.data + offset;
+        return a;
+    }
+
+    // decodes the image behind texture textureIdx (embedded in a bufferView). null if it can't be decoded
+    QImage* image(int textureIdx) const {
+        const QJsonArray textures = m_doc["textures"].toArray();
+        if (textureIdx < 0 || textureIdx >= textures.size()) return nullptr;
+        const int source = textures[textureIdx].toObject()["source"].toInt(-1);
+        const QJsonArray images = m_doc["images"].toArray();
+        if (source < 0 || source >= images.size()) return nullptr;
+        const QJsonObject img = images[source].toObject();
+        if (!img.contains("bufferView")) return nullptr;
+        const Span view = bufferView(img["bufferView"].toInt());
+        if (!view.data) return nullptr;
+        QImage* result = new QImage(QImage::fromData(view.data, static_cast<int>(view.length)));
+        if (result->isNull()) {
+            delete result;
+            return nullptr;
+        }
+        return result;
+    }
+
+    static glm::mat4 localTransform(const QJsonObject& node) {
+        if (node.contains("matrix")) {
+            const QJsonArray m = node["matrix"].toArray();
+            float values[16];
+            for (int i = 0; i < 16; i++) values[i] = m[i].toDouble(i % 5 == 0 ? 1 : 0);
+            return glm::make_mat4(values);  // both column major
+        }
+        glm::mat4 result(1.f);
+        if (node.contains("translation")) {
+            const QJsonArray t = node["translation"].toArray();
+            result = glm::translate(result, glm::vec3(t[0].toDouble(), t[1].toDouble(), t[2].toDouble()));
+        }
+        if (node.contains("rotation")) {
+            const QJsonArray r = node["rotation"].toArray();  // x, y, z, w
+            result = result * glm::mat4_cast(glm::quat(r[3].toDouble(1), r[0].toDouble(), r[1].toDouble(), r[2].toDouble()));
+        }
+        if (node.contains("scale")) {
+            const QJsonArray s = node["scale"].toArray();
+            result = glm::scale(result, glm::vec3(s[0].toDouble(1), s[1].toDouble(1), s[2].toDouble(1)));
+        }
+        return result;
+    }
+
+    // appends every triangle primitive under node (and its children) to p
+    bool addNode(int nodeIdx, const glm::mat4& parent, Polygon& p, QString* error, int depth = 0) {
+        const QJsonArray nodes = m_doc["nodes"].toArray();
+        if (nodeIdx < 0 || nodeIdx >= nodes.size() || depth > 64) {
+            *error = "glTF node hierarchy is invalid";
+            return false;
+        }
+        const QJsonObject node = nodes[nodeIdx].toObject();
+        const glm::mat4 world = parent * localTransform(node);
+
+        if (node.contains("mesh")) {
+            const QJsonArray meshes = m_doc["meshes"].toArray();
+            const int meshIdx = node["mesh"].toInt(-1);
+            if (meshIdx < 0 || meshIdx >= meshes.size()) {
+                *error = QString("glTF node %1 references missing mesh %2").arg(nodeIdx).arg(meshIdx);
+                return false;
+            }
+            const QJsonObject mesh = meshes[meshIdx].toObject();
+            const QJsonArray prims = mesh["primitives"].toArray();
+            for (int i = 0; i < prims.size(); i++) {
+                if (!addPrimitive(prims[i].toObject(), world, p, error)) return false;
+            }
+        }
+        const QJsonArray children = node["children"].toArray();
+        for (int i = 0; i < children.size(); i++) {
+            if (!addNode(children[i].toInt(), world, p, error, depth + 1)) return false;
+        }
+        return true;
+    }
+
+    bool addPrimitive(const QJsonObject& prim, const glm::mat4& world, Polygon& p, QString* error) {
+        if (prim["mode"].toInt(MODE_TRIANGLES) != MODE_TRIANGLES) return true;  // points/lines aren't drawable
+
+        const QJsonObject attribs = prim["attributes"].toObject();
+        const Accessor pos = accessor(attribs["POSITION"].toInt(-1));
+        if (!pos.valid() || pos.count == 0 || pos.components != 3) {
+            *error = "glTF primitive has no usable POSITION accessor";
+            return false;
+        }
+        const Accessor nor = attribs.contains("NORMAL") ? accessor(attribs["NORMAL"].toInt()) : Accessor();
+        const Accessor uv = attribs.contains("TEXCOORD_0") ? accessor(attribs["TEXCOORD_0"].toInt()) : Accessor();
+        const bool hasNormals = nor.data && nor.count == pos.count && nor.components == 3;
+        const bool hasUVs = uv.data && uv.count == pos.count && uv.components == 2;
+
+        const size_t base = p.VertexCount();
+        p.ResizeVertices(base + pos.count);
+        const glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(world)));
+        const bool packed = pos.isPackedFloat(3) && (!hasNormals || nor.isPackedFloat(3)) && (!hasUVs || uv.isPackedFloat(2));
+
+        for (size_t i = 0; i < pos.count; i++) {
+            glm::vec3 P, N(0.f);
+            glm::vec2 T(0.f);
+            if (packed) {
+                // layouts match: read the packed floats in place
+                const float* fp = reinterpret_cast<const float*>(pos.data) + 3 * i;
+                P = glm::vec3(fp[0], fp[1], fp[2]);
+                if (hasNormals) {
+                    const float* fn = reinterpret_cast<const float*>(nor.data) + 3 * i;
+                    N = glm::vec3(fn[0], fn[1], fn[2]);
+                }
+                if (hasUVs) {
+                    const float* ft = reinterpret_cast<const float*>(uv.data) + 2 * i;
+                    T = glm::vec2(ft[0], ft[1]);
+                }
+            } else {
+                P = glm::vec3(pos.get(i, 0), pos.get(i, 1), pos.get(i, 2));
+                if (hasNormals) N = glm::vec3(nor.get(i, 0), nor.get(i, 1), nor.get(i, 2));
+                if (hasUVs) T = glm::vec2(uv.get(i, 0), uv.get(i, 1));
+            }
+            if (hasNormals) N = glm::normalize(normalMat * N);
+            // glTF puts the uv origin at the top left, GetImageColor expects it at the bottom left
+            p.m_positions[base + i] = glm::vec3(world * glm::vec4(P, 1.f));
+            p.m_attributes[base + i] = {PackNormal(N), PackUV(glm::vec2(T.x, 1.f - T.y))};
+        }
+
+        const size_t triBase = p.m_tris.size();
+        if (prim.contains("indices")) {
+            const Accessor idx = accessor(prim["indices"].toInt());
+            if (!idx.valid() || idx.components != 1) {
+                *error = "glTF primitive has an invalid index accessor";
+                return false;
+            }
+            p.m_tris.resize(triBase + idx.count / 3);
+            Triangle* tris = p.m_tris.data() + triBase;
+            const bool packedU32 = idx.componentType == UNSIGNED_INT && idx.stride == 4;
+            for (size_t t = 0; t < idx.count / 3; t++) {
+                if (packedU32) {
+                    std::memcpy(tris[t].m_indices, idx.data + 12 * t, 12);
+                } else {
+                    for (int k = 0; k < 3; k++) tris[t].m_indices[k] = idx.index(3 * t + k);
+                }
+                for (int k = 0; k < 3; k++) {
+                    if (tris[t].m_indices[k] >= pos.count) {
+                        *error = "glTF index is out of range";
+                        return false;
+                    }
+                    tris[t].m_indices[k] += static_cast<unsigned int>(base);
+                }
+            }
+        } else {
+            p.m_tris.resize(triBase + pos.count / 3);
+            for (size_t t = 0; t < pos.count / 3; t++) {
+                for (int k = 0; k < 3; k++) {
+                    p.m_tris[triBase + t].m_indices[k] = static_cast<unsigned int>(base + 3 * t + k);
+                }
+            }
+        }
+
+        if (!hasNormals) {
+            // no normals in the file: use area weighted face normals
+            std::vector<glm::vec3> normals(pos.count, glm::vec3(0.f));
+            for (size_t t = triBase; t < p.m_tris.size(); t++) {
+                const unsigned int* idx = p.m_tris[t].m_indices;
+                const glm::vec3 n = glm::cross(p.m_positions[idx[1]] - p.m_positions[idx[0]],
+                                               p.m_positions[idx[2]] - p.m_positions[idx[0]]);
+                for (int k = 0; k < 3; k++) normals[idx[k] - base] += n;
+            }
+            for (size_t i = 0; i < pos.count; i++) {
+                p.m_attributes[base + i].normal = PackNormal(normals[i]);
+            }
+        }
+
+        // a Polygon has a single texture, so the first textured material wins
+        if (m_texture < 0 && prim.contains("material")) {
+            const QJsonArray materials = m_doc["materials"].toArray();
+            const int materialIdx = prim["material"].toInt(-1);
+            if (materialIdx < 0 || materialIdx >= materials.size()) {
+                *error = QString("glTF primitive references missing material %1").arg(materialIdx);
+                return false;
+            }
+            const QJsonObject mat = materials[materialIdx].toObject();
+            const QJsonObject pbr = mat["pbrMetallicRoughness"].toObject();
+            if (pbr.contains("baseColorTexture")) {
+                m_texture = pbr["baseColorTexture"].toObject()["index"].toInt(-1);
+            }
+            if (mat.contains("normalTexture")) {
+                m_normalMap = mat["normalTexture"].toObject()["index"].toInt(-1);
+            }
+        }
+        return true;
+    }
+
+    // sets p's texture and normal map once every primitive is in, since the normal map derives
+    // tangents for the vertices p has at that point
+    void setMaterial(Polygon& p) {
+        if (m_texture >= 0) p.SetTexture(image(m_texture));
+        if (m_normalMap >= 0) p.SetNormalMap(image(m_normalMap));
+    }
+
+private:
+    QJsonObject m_doc;
+    std::vector<Span> m_buffers;
+    int m_texture = -1, m_normalMap = -1;  // glTF texture indices
+};
+
+}  // namespace
+
+bool LoadGLTFFile(const QString& file, Polygon& p, QString* error) {
+    QString err;
+    auto fail = [error, &err](const QString& msg) {
+        if (error) *error = msg.isEmpty() ? err : msg;
+        return false;
+    };
+
+    QFile f(file);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return fail(QString("Could not open glTF file %1").arg(file));
+    }
+    const qint64 size = f.size();
+    const uchar* data = f.map(0, size);
+    QByteArray fallback;
+    if (!data) {
+        fallback = f.readAll();
+        data = reinterpret_cast<const uchar*>(fallback.constData());
+    }
+
+    QByteArray json;
+    std::vector<Span> buffers;
+    std::vector<QByteArray> externalBuffers;  // owns .gltf buffers that don't live in the mapped file
+
+    uint32_t header[3] = {0, 0, 0};
+    if (size >= 12) std::memcpy(header, data, 12);
+    if (header[0] == GLB_MAGIC) {
+        if (header[1] != 2 || header[2] > size) return fail("Unsupported or truncated GLB file");
+        Span bin;
+        for (size_t off = 12; off + 8 <= header[2];) {
+            uint32_t chunk[2];
+            std::memcpy(chunk, data + off, 8);
+            if (off + 8 + chunk[0] > header[2]) return fail("Truncated GLB chunk");
+            if (chunk[1] == GLB_CHUNK_JSON && json.isEmpty()) {
+                json = QByteArray::fromRawData(reinterpret_cast<const char*>(data + off + 8), chunk[0]);
+            } else if (chunk[1] == GLB_CHUNK_BIN && !bin.data) {
+                bin = Span{data + off + 8, chunk[0]};
+            }
+            off += 8 + ((chunk[0] + 3) & ~3u);
+        }
+        buffers.push_back(bin);  // buffer 0 of a GLB is its BIN chunk
+    } else {
+        json = QByteArray::fromRawData(reinterpret_cast<const char*>(data), static_cast<int>(size));
+    }
+
+    QJsonParseError parseError;
+    const QJsonDocument jdoc = QJsonDocument::fromJson(json, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !jdoc.isObject()) {
+        return fail(QString("Invalid glTF JSON in %1").arg(file));
+    }
+    const QJsonObject doc = jdoc.object();
+
+    // .gltf buffers are external files or data URIs
+    const QJsonArray bufferDefs = doc["buffers"].toArray();
+    externalBuffers.reserve(bufferDefs.size());
+    for (int i = static_cast<int>(buffers.size()); i < bufferDefs.size(); i++) {
+        const QString uri = bufferDefs[i].toObject()["uri"].toString();
+        QByteArray bytes;
+        const int comma = uri.indexOf(",");
+        if (uri.startsWith("data:") && comma >= 0) {
+            bytes = QByteArray::fromBase64(uri.mid(comma + 1).toUtf8());
+        } else if (!uri.isEmpty()) {
+            QFile bufFile(QFileInfo(file).absoluteDir().filePath(uri));
+            if (!bufFile.open(QIODevice::ReadOnly)) return fail(QString("Could not open glTF buffer %1").arg(uri));
+            bytes = bufFile.readAll();
+        }
+        externalBuffers.push_back(bytes);
+        buffers.push_back(Span{reinterpret_cast<const uchar*>(externalBuffers.back().constData()),
+                               static_cast<size_t>(externalBuffers.back().size())});
+    }
+
+    GLTFReader reader(doc, std::move(buffers));
+    const QJsonArray scenes = doc["scenes"].toArray();
+    QJsonArray roots;
+    if (!scenes.isEmpty()) {
+        const int scene = doc["scene"].toInt(0);
+        if (scene < 0 || scene >= scenes.size()) {
+            if (fallback.isEmpty()) f.unmap(const_cast<uchar*>(data));
+            return fail(QString("glTF default scene %1 doesn't exist in %2").arg(scene).arg(file));
+        }
+        roots = scenes[scene].toObject()["nodes"].toArray();
+    } else {
+        // no scene list: every node is drawn from the root
+        for (int i = 0; i < doc["nodes"].toArray().size(); i++) roots.append(i);
+    }
+    // a file that turns out broken halfway leaves p as it found it
+    const size_t vertexCount = p.VertexCount(), triangleCount = p.m_tris.size();
+    for (int i = 0; i < roots.size(); i++) {
+        if (!reader.addNode(roots[i].toInt(), glm::mat4(1.f), p, &err)) {
+            p.ResizeVertices(vertexCount);
+            p.m_tris.resize(triangleCount);
+            if (fallback.isEmpty()) f.unmap(const_cast<uchar*>(data));
+            return fail(QString());
+        }
+    }
+    reader.setMaterial(p);  // the images may live in the mapped file too
+
+    if (fallback.isEmpty()) f.unmap(const_cast<uchar*>(data));
+    return true;
+}
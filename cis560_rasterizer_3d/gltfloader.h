@@ -0,0 +1,11 @@
+#pragma once
+
+#include <QString>
+#include "polygon.h"
+
+// Loads every triangle primitive of the default scene of a glTF 2.0 file (binary .glb, or .gltf
+// with external or base64 buffers) into p, with node transforms baked into world space.
+// Vertex streams are read in place from the mapped file, and the base color / normal textures of
+// the first material are decoded from the embedded images into p's texture and normal map.
+// Returns false and fills *error if the file can't be read or isn't valid glTF.
+bool LoadGLTFFile(const QString& file, Polygon& p, QString* error = nullptr);
@@ -0,0 +1,329 @@
+#include "kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+// the scalar kernels are the reference the SIMD variants follow operation for operation,
+// so they all round the same way
+
+static void transformScalar(const glm::vec3* positions, size_t n, const glm::mat4& view_proj, float width, float height,
+                            glm::vec4* clip, glm::vec4* screen)
+{
+    for (size_t i = 0; i < n; i++) {
+        const glm::vec4 c = view_proj * glm::vec4(positions[i], 1.f);
+        const glm::vec4 ndc = c / c.w;
+        clip[i] = c;
+        screen[i] = glm::vec4((ndc.x + 1) * (width/2),
+                              (1 - ndc.y) * (height/2),
+                              ndc.z,
+                              1.f);
+    }
+}
+
+static int rasterSpanScalar(const SpanSetup& s, int y, int x0, int x1, float* zrow, int row_offset,
+                            const FragmentArrays& out, int count)
+{
+    const float fy = float(y) - s.oy;
+    const float base0 = s.c[0] + s.dy[0] * fy;
+    const float base1 = s.c[1] + s.dy[1] * fy;
+    const float base2 = s.c[2] + s.dy[2] * fy;
+    for (int x = x0; x < x1; x++) {
+        const float fx = float(x) - s.ox;
+        const float p0 = (base0 + s.dx[0] * fx) * s.invz[0];
+        const float p1 = (base1 + s.dx[1] * fx) * s.invz[1];
+        const float p2 = (base2 + s.dx[2] * fx) * s.invz[2];
+        const float z = 1.f / ((p0 + p1) + p2);
+        if (z < zrow[x]) {
+            zrow[x] = z;
+            out.pixel[count] = row_offset + x;
+            out.w0[count] = p0 * z;
+            out.w1[count] = p1 * z;
+            out.w2[count] = p2 * z;
+            count++;
+        }
+    }
+    return count;
+}
+
+static int depthSpanScalar(const SpanSetup& s, int y, int x0, int x1, float* zrow)
+{
+    const float fy = float(y) - s.oy;
+    const float base0 = s.c[0] + s.dy[0] * fy;
+    const float base1 = s.c[1] + s.dy[1] * fy;
+    const float base2 = s.c[2] + s.dy[2] * fy;
+    int passed = 0;
+    for (int x = x0; x < x1; x++) {
+        const float fx = float(x) - s.ox;
+        const float p0 = (base0 + s.dx[0] * fx) * s.invz[0];
+        const float p1 = (base1 + s.dx[1] * fx) * s.invz[1];
+        const float p2 = (base2 + s.dx[2] * fx) * s.invz[2];
+        const float z = 1.f / ((p0 + p1) + p2);
+        if (z < zrow[x]) {
+            zrow[x] = z;
+            passed++;
+        }
+    }
+    return passed;
+}
+
+static inline int toChannel(float c)
+{
+    return int(std::min(std::max(c, 0.f), 255.f) + 0.5f);
+}
+
+template <unsigned F>
+static void shadeScalar(const ShadeSetup& s, const TextureView& tex, const NormalMapView& nor, const GBufferView& g,
+                        const FragmentArrays& frags, int begin, int end, QRgb* color)
+{
+    for (int k = begin; k < end; k++) {
+        const float w0 = frags.w0[k], w1 = frags.w1[k], w2 = frags.w2[k];
+        float u = 0.f, v = 0.f;
+        if constexpr ((F & (SHADE_TEXTURE | SHADE_NORMAL_MAP)) != 0) {
+            u = (w0 * s.u[0] + w1 * s.u[1]) + w2 * s.u[2];
+            v = (w0 * s.v[0] + w1 * s.v[1]) + w2 * s.v[2];
+        }
+        // the normal map's normal in the tangent frame
+        float nx = 0.f, ny = 0.f, nz = 1.f;
+        if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+            // nearest texel like the texture. outside the map the normal is left alone
+            float fx = nor.width * u;
+            float fy = nor.height * (1.f - v);
+            fx = fx < nor.width - 1.f ? fx : nor.width - 1.f;
+            fy = fy < nor.height - 1.f ? fy : nor.height - 1.f;
+            const int X = int(fx), Y = int(fy);
+            const unsigned t = (X >= 0 && Y >= 0) ? nor.texels[Y * nor.width + X] : 0;
+            nx = float(int8_t(t)) * (1.f / 127.f);
+            ny = float(int8_t(t >> 8)) * (1.f / 127.f);
+            nz = std::sqrt(std::max((1.f - nx * nx) - ny * ny, 0.f));
+        }
+        float lambda = 1.f;
+        if constexpr ((F & SHADE_GBUFFER) != 0) {
+            const int pixel = frags.pixel[k];
+            for (int a = 0; a < 3; a++) {
+                float n = (w0 * s.n[a][0] + w1 * s.n[a][1]) + w2 * s.n[a][2];
+                if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+                    const float t = (w0 * s.t[a][0] + w1 * s.t[a][1]) + w2 * s.t[a][2];
+                    const float b = (w0 * s.b[a][0] + w1 * s.b[a][1]) + w2 * s.b[a][2];
+                    n = (nx * t + ny * b) + nz * n;
+                }
+                g.normal[a][pixel] = n;
+                g.position[a][pixel] = (w0 * s.p[a][0] + w1 * s.p[a][1]) + w2 * s.p[a][2];
+            }
+        } else {
+            float ndl = (w0 * s.ndl[0] + w1 * s.ndl[1]) + w2 * s.ndl[2];
+            if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+                const float tdl = (w0 * s.tdl[0] + w1 * s.tdl[1]) + w2 * s.tdl[2];
+                const float bdl = (w0 * s.bdl[0] + w1 * s.bdl[1]) + w2 * s.bdl[2];
+                ndl = (nx * tdl + ny * bdl) + nz * ndl;
+            }
+            lambda = std::min(std::max(ndl, 0.f), 1.f) * 0.7f + 0.3f;
+        }
+
+        float r = 255.f, g = 255.f, b = 255.f;
+        if constexpr ((F & SHADE_TEXTURE) != 0) {
+            // nearest texel. outside the texture reads as black, like QImage::pixel
+            float fx = tex.width * u;
+            float fy = tex.height * (1.f - v);
+            fx = fx < tex.width - 1.f ? fx : tex.width - 1.f;
+            fy = fy < tex.height - 1.f ? fy : tex.height - 1.f;
+            const int X = int(fx), Y = int(fy);
+            const QRgb texel = (X >= 0 && Y >= 0) ? tex.bits[Y * tex.stride + X] : 0;
+            r = float(qRed(texel));
+            g = float(qGreen(texel));
+            b = float(qBlue(texel));
+        }
+        if constexpr ((F & SHADE_VERTEX_COLOR) != 0) {
+            r = r * ((w0 * s.rgb[0][0] + w1 * s.rgb[0][1]) + w2 * s.rgb[0][2]);
+            g = g * ((w0 * s.rgb[1][0] + w1 * s.rgb[1][1]) + w2 * s.rgb[1][2]);
+            b = b * ((w0 * s.rgb[2][0] + w1 * s.rgb[2][1]) + w2 * s.rgb[2][2]);
+        }
+        color[frags.pixel[k]] = qRgb(toChannel(r * lambda), toChannel(g * lambda), toChannel(b * lambda));
+    }
+}
+
+// the comparisons follow the SIMD max/min instructions, which return the second operand on ties
+static inline float maxf(float a, float b) { return a > b ? a : b; }
+static inline float minf(float a, float b) { return a < b ? a : b; }
+
+static void lightScalar(const LightSetup* lights, const int* indices, int count, float ambient, const GBufferView& g,
+                        const float* depth, int width, int x0, int y0, int x1, int y1, QRgb* color)
+{
+    for (int y = y0; y < y1; y++) {
+        for (int i = y * width + x0; i < y * width + x1; i++) {
+            const float z = depth[i];
+            if (!(z > 0.f && z < std::numeric_limits<float>::infinity())) {
+                continue;
+            }
+            float nx = g.normal[0][i], ny = g.normal[1][i], nz = g.normal[2][i];
+            const float len = std::sqrt((nx * nx + ny * ny) + nz * nz);
+            const float inv = len > 0.f ? 1.f / len : 0.f;
+            nx = nx * inv;
+            ny = ny * inv;
+            nz = nz * inv;
+            const float px = g.position[0][i], py = g.position[1][i], pz = g.position[2][i];
+
+            float r = ambient, gr = ambient, b = ambient;
+            for (int j = 0; j < count; j++) {
+                const LightSetup& l = lights[indices[j]];
+                float lx = l.pos[0] - px, ly = l.pos[1] - py, lz = l.pos[2] - pz;
+                const float d = std::sqrt((lx * lx + ly * ly) + lz * lz);
+                const float invd = 1.f / maxf(d, 1e-6f);
+                lx = lx * invd;
+                ly = ly * invd;
+                lz = lz * invd;
+                const float ndl = maxf((nx * lx + ny * ly) + nz * lz, 0.f);
+                // a squared falloff that reaches zero at the range
+                const float fade = maxf(1.f - d * l.invRange, 0.f);
+                const float cone = minf(maxf((((lx * l.axis[0] + ly * l.axis[1]) + lz * l.axis[2]) - l.coneCos)
+                                             * l.coneScale, 0.f), 1.f);
+                float k = ((ndl * fade) * fade) * cone;
+                if (l.shadow) {
+                    k = k * l.shadow[i];
+                }
+                r = r + l.color[0] * k;
+                gr = gr + l.color[1] * k;
+                b = b + l.color[2] * k;
+            }
+            const QRgb albedo = color[i];
+            color[i] = qRgb(toChannel(float(qRed(albedo)) * r), toChannel(float(qGreen(albedo)) * gr),
+                            toChannel(float(qBlue(albedo)) * b));
+        }
+    }
+}
+
+static void shadowScalar(const ShadowSetup& s, const GBufferView& g, const float* depth, int width,
+                         int x0, int y0, int x1, int y1, float* visibility)
+{
+    const float* m = s.viewProj;
+    const float half = 0.5f * float(s.size);
+    const float taps = 1.f / float((2 * s.radius + 1) * (2 * s.radius + 1));
+    for (int y = y0; y < y1; y++) {
+        for (int i = y * width + x0; i < y * width + x1; i++) {
+            const float z = depth[i];
+            if (!(z > 0.f && z < std::numeric_limits<float>::infinity())) {
+                continue;
+            }
+            float nx = g.normal[0][i], ny = g.normal[1][i], nz = g.normal[2][i];
+            const float len = std::sqrt((nx * nx + ny * ny) + nz * nz);
+            const float inv = len > 0.f ? 1.f / len : 0.f;
+            nx = nx * inv;
+            ny = ny * inv;
+            nz = nz * inv;
+            float px = g.position[0][i], py = g.position[1][i], pz = g.position[2][i];
+            float lx = s.lightPos[0] - px, ly = s.lightPos[1] - py, lz = s.lightPos[2] - pz;
+            const float d = std::sqrt((lx * lx + ly * ly) + lz * lz);
+            const float invd = 1.f / maxf(d, 1e-6f);
+            // a texel covers more of the surface the further it is from the light
+            const float off = d * s.offset;
+            px = px + (nx + lx * invd) * off;
+            py = py + (ny + ly * invd) * off;
+            pz = pz + (nz + lz * invd) * off;
+
+            const float cx = ((m[0] * px + m[4] * py) + m[8] * pz) + m[12];
+            const float cy = ((m[1] * px + m[5] * py) + m[9] * pz) + m[13];
+            const float cw = ((m[3] * px + m[7] * py) + m[11] * pz) + m[15];
+            if (!(cw > 0.f && std::abs(cx) <= cw && std::abs(cy) <= cw)) {
+                continue;
+            }
+            const float invw = 1.f / cw;
+            // the map's texels sit on integer coordinates, like the pixels
+            const int tu = int(std::floor((cx * invw + 1.f) * half + 0.5f));
+            const int tv = int(std::floor((1.f - cy * invw) * half + 0.5f));
+            int lit = 0;
+            for (int dy = -s.radius; dy <= s.radius; dy++) {
+                const int row = std::min(std::max(tv + dy, 0), s.size - 1) * s.size;
+                for (int dx = -s.radius; dx <= s.radius; dx++) {
+                    lit += cw <= s.depth[row + std::min(std::max(tu + dx, 0), s.size - 1)];
+                }
+            }
+            visibility[i] = float(lit) * taps;
+        }
+    }
+}
+
+static const RasterKernels s_scalar = {"scalar", transformScalar, rasterSpanScalar, depthSpanScalar, SHADE_KERNELS(shadeScalar), lightScalar, shadowScalar};
+
+#ifdef RASTERIZER_X86_KERNELS
+extern const RasterKernels g_kernelsSSE42;
+extern const RasterKernels g_kernelsAVX2;
+extern const RasterKernels g_kernelsAVX512;
+
+static bool supported(const RasterKernels* k)
+{
+    __builtin_cpu_init();
+    if (k == &g_kernelsSSE42) return __builtin_cpu_supports("sse4.2");
+    if (k == &g_kernelsAVX2) return __builtin_cpu_supports("avx2");
+    if (k == &g_kernelsAVX512) return __builtin_cpu_supports("avx512f");
+    return true;
+}
+
+static const RasterKernels* const s_all[] = {&s_scalar, &g_kernelsSSE42, &g_kernelsAVX2, &g_kernelsAVX512};
+#else
+static bool supported(const RasterKernels*) { return true; }
+static const RasterKernels* const s_all[] = {&s_scalar};
+#endif
+
+static const RasterKernels* findKernels(const char* isa)
+{
+    for (const RasterKernels* k : s_all) {
+        if (std::strcmp(k->name, isa) == 0 && supported(k)) {
+            return k;
+        }
+    }
+    return nullptr;
+}
+
+static const RasterKernels* bestKernels()
+{
+    if (const char* forced = std::getenv("RASTERIZER_ISA")) {
+        if (const RasterKernels* k = findKernels(forced)) {
+            return k;
+        }
+        std::cerr << "RASTERIZER_ISA=" << forced << " is unknown or not supported by this CPU, ignoring it" << std::endl;
+    }
+    const RasterKernels* best = &s_scalar;
+    for (const RasterKernels* k : s_all) {
+        if (supported(k)) {
+            best = k;
+        }
+    }
+    return best;
+}
+
+static std::atomic<const RasterKernels*> s_current{nullptr};
+
+const RasterKernels& Kernels()
+{
+    const RasterKernels* k = s_current.load(std::memory_order_acquire);
+    if (!k) {
+        // racing first calls all come up with the same answer
+        k = bestKernels();
+        s_current.store(k, std::memory_order_release);
+    }
+    return *k;
+}
+
+bool SelectKernels(const char* isa)
+{
+    const RasterKernels* k = findKernels(isa);
+    if (k) {
+        s_current.store(k, std::memory_order_release);
+    }
+    return k != nullptr;
+}
+
+std::vector<const char*> SupportedKernelISAs()
+{
+    std::vector<const char*> names;
+    for (const RasterKernels* k : s_all) {
+        if (supported(k)) {
+            names.push_back(k->name);
+        }
+    }
+    return names;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <QRgb>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+#include "polygon.h"
+
+// The rasterizer's inner loops, compiled for several instruction sets into the same binary.
+// Kernels() picks the best variant the CPU supports the first time it is called; the environment
+// variable RASTERIZER_ISA (scalar, sse4.2, avx2, avx512) or SelectKernels overrides the choice.
+// Every variant produces the same pixels, they only differ in speed.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RASTERIZER_X86_KERNELS 1
+#endif
+
+// The screen space barycentric coordinates of a triangle,
+// lambda_i(x, y) = c[i] + dx[i]*(x - ox) + dy[i]*(y - oy),
+// relative to an origin on the triangle so that small triangles far from (0,0) stay precise.
+struct SpanSetup
+{
+    float ox, oy;
+    float c[3], dx[3], dy[3];
+    float invz[3];  // 1 / ndc z of the corners, for the perspective correction
+};
+
+// Structure-of-arrays storage the raster kernel appends fragments to: the pixel index and
+// the perspective correct weights of the three corners, so an attribute is w0*a0 + w1*a1 + w2*a2
+struct FragmentArrays
+{
+    int* pixel;
+    float* w0;
+    float* w1;
+    float* w2;
+};
+
+// a raster kernel may write this many entries past the fragments it reports
+constexpr int KERNEL_FRAGMENT_SLACK = 16;
+
+// What a shading kernel variant reads of the triangle and writes per fragment. Every
+// combination is compiled into its own kernel, which interpolates only what it uses and has no
+// per-fragment branches, see RasterKernels::shade
+enum ShadeFeatures : unsigned
+{
+    SHADE_TEXTURE = 1,       // samples the texture at the interpolated uv
+    SHADE_NORMAL_MAP = 2,    // takes the normal from the normal map, at the same uv
+    SHADE_VERTEX_COLOR = 4,  // multiplies the color by the interpolated vertex colors
+    SHADE_GBUFFER = 8,       // leaves the color unlit, and writes the normal and position for the light pass
+    SHADE_VARIANTS = 16
+};
+
+// the variants of a shading kernel template, in the order RasterKernels::shade lists them
+#define SHADE_KERNELS(kernel) \
+    {kernel<0>, kernel<1>, kernel<2>, kernel<3>, kernel<4>, kernel<5>, kernel<6>, kernel<7>, \
+     kernel<8>, kernel<9>, kernel<10>, kernel<11>, kernel<12>, kernel<13>, kernel<14>, kernel<15>}
+
+// What the shading kernel needs of one triangle's corners. only the parts its features use are set
+struct ShadeSetup
+{
+    float u[3], v[3];
+    float rgb[3][3];  // the vertex colors over 255, [channel][corner]
+    float ndl[3];  // dot(normal, direction to the light)
+    float tdl[3], bdl[3];  // the same for the tangent and bitangent, only set with a normal map
+    // only set when shading into a g-buffer: the world space normal, tangent, bitangent and
+    // position of the corners, axis by axis
+    float n[3][3], t[3][3], b[3][3], p[3][3];  // [axis][corner]
+};
+
+// A texture in QImage::Format_RGB32, or bits == nullptr for plain white
+struct TextureView
+{
+    const QRgb* bits;
+    int width, height;
+    int stride;  // in pixels
+};
+
+// A PackedNormalMap, or texels == nullptr for none. its texels are padded by one, so a lane
+// can read four bytes at any of them
+struct NormalMapView
+{
+    const uint16_t* texels;
+    int width, height;
+};
+
+// Per-pixel planes the shading kernel fills for the light pass, or normal[0] == nullptr to
+// light with the headlight right away. the normal is interpolated but not normalized
+struct GBufferView
+{
+    float* normal[3];
+    float* position[3];
+};
+
+// One light as the light pass evaluates it. a point light is a spot light whose cone lets
+// everything through
+struct LightSetup
+{
+    float pos[3];
+    float color[3];
+    float invRange;
+    float axis[3];    // from the light's target back to the light, so it lines up with the light vector
+    float coneCos;    // cosine of the outer angle
+    float coneScale;  // 1 / (cosine of the inner angle - coneCos)
+    const float* shadow;  // the fraction of it each pixel sees, indexed like the depth, or nullptr if it casts no shadows
+};
+
+// One view of a shadow casting light: a size x size depth map rendered from the light, and how
+// to look it up with percentage closer filtering
+struct ShadowSetup
+{
+    float viewProj[16];  // column major, like glm
+    float lightPos[3];
+    float offset;  // how far a receiver moves off its surface and towards the light, per unit of distance to it
+    const float* depth;  // view depths, infinity where nothing was drawn, see Rasterizer::RenderDepth
+    int size;
+    int radius;  // the filter takes (2*radius + 1)^2 taps around the nearest texel
+};
+
+struct RasterKernels
+{
+    const char* name;
+
+    // clip[i] = view_proj * (positions[i], 1) and screen[i] = clip[i] / w mapped to a width x height
+    // pixel grid, for n vertices (screen z is the ndc depth, screen w is 1)
+    void (*transform)(const glm::vec3* positions, size_t n, const glm::mat4& view_proj, float width, float height,
+                      glm::vec4* clip, glm::vec4* screen);
+
+    // depth tests pixels [x0, x1) of row y against zrow, which starts at pixel index row_offset,
+    // and writes the depths that pass. Passing fragments are appended to out from index count on.
+    // Returns the new count
+    int (*rasterSpan)(const SpanSetup& s, int y, int x0, int x1, float* zrow, int row_offset,
+                      const FragmentArrays& out, int count);
+
+    // rasterSpan for depth-only passes: the same depth test, writing the same depths, but no
+    // fragments. Returns how many pixels passed
+    int (*depthSpan)(const SpanSetup& s, int y, int x0, int x1, float* zrow);
+
+    // lights and colors fragments [begin, end) of one triangle into the color buffer, one variant
+    // per combination of ShadeFeatures. the color starts out white, and is the texel with a
+    // texture, times the vertex color with vertex colors. with a normal map, the sampled normal
+    // (x, y, sqrt(1 - x^2 - y^2)) replaces the interpolated one. with a g-buffer the color is left
+    // unlit, and the normal and position go into g instead
+    void (*shade[SHADE_VARIANTS])(const ShadeSetup& s, const TextureView& tex, const NormalMapView& nor,
+                                  const GBufferView& g, const FragmentArrays& frags, int begin, int end, QRgb* color);
+
+    // the light pass over pixels [x0, x1) x [y0, y1) of a width wide frame, whose color holds
+    // the unlit albedo: adds up ambient and lights[indices[0..count)] and multiplies them in.
+    // pixels whose depth isn't strictly between 0 and infinity are left alone
+    void (*light)(const LightSetup* lights, const int* indices, int count, float ambient, const GBufferView& g,
+                  const float* depth, int width, int x0, int y0, int x1, int y1, QRgb* color);
+
+    // for the pixels of [x0, x1) x [y0, y1) the view's frustum contains, writes the fraction of
+    // the filter taps around them the map has nothing in front of to visibility, indexed like depth.
+    // leaves the other pixels alone, as well as those whose depth isn't strictly between 0 and infinity
+    void (*shadow)(const ShadowSetup& s, const GBufferView& g, const float* depth, int width,
+                   int x0, int y0, int x1, int y1, float* visibility);
+};
+
+// the kernels in use
+const RasterKernels& Kernels();
+
+// switches to the named variant. Returns false, changing nothing, if the name is unknown or
+// the CPU can't run it
+bool SelectKernels(const char* isa);
+
+// names of the variants this CPU can run, slowest first
+std::vector<const char*> SupportedKernelISAs();
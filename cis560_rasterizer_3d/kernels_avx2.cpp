@@ -0,0 +1,420 @@
+// AVX2 variants of the raster kernels, eight lanes wide. Built with a target attribute rather
+// than a compiler flag, so the rest of the binary still runs on older CPUs. FMA is deliberately
+// not enabled: fused multiply-adds would round differently from the other variants.
+#include "kernels.h"
+
+#ifdef RASTERIZER_X86_KERNELS
+
+#include <immintrin.h>
+#include <algorithm>
+#include <limits>
+
+#define KERNEL __attribute__((target("avx2")))
+
+// for every 8-bit lane mask, the permutation that moves the set lanes to the front
+struct LeftPackTable
+{
+    alignas(32) int idx[256][8];
+    LeftPackTable()
+    {
+        for (int m = 0; m < 256; m++) {
+            int n = 0;
+            for (int i = 0; i < 8; i++) {
+                if (m & (1 << i)) idx[m][n++] = i;
+            }
+            while (n < 8) idx[m][n++] = 0;
+        }
+    }
+};
+static const LeftPackTable s_leftPack;
+
+KERNEL static void transformAVX2(const glm::vec3* positions, size_t n, const glm::mat4& view_proj, float width, float height,
+                                 glm::vec4* clip, glm::vec4* screen)
+{
+    // two vertices per register, one in each 128-bit half
+    const __m256 c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&view_proj[0][0]));
+    const __m256 c1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&view_proj[1][0]));
+    const __m256 c2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&view_proj[2][0]));
+    const __m256 c3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&view_proj[3][0]));
+    const __m256 flip = _mm256_setr_ps(1.f, -1.f, 1.f, 0.f, 1.f, -1.f, 1.f, 0.f);
+    const __m256 shift = _mm256_setr_ps(1.f, 1.f, 0.f, 1.f, 1.f, 1.f, 0.f, 1.f);
+    const __m256 scale = _mm256_setr_ps(width/2, height/2, 1.f, 1.f,
+                                        width/2, height/2, 1.f, 1.f);
+    // the six floats of two positions, spread to (x0, y0, z0, z0, x1, y1, z1, z1). the masked
+    // loads never touch the floats past the last position, here or in the odd vertex after the loop
+    const __m256i six = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, 0, 0);
+    const __m128i three = _mm_setr_epi32(-1, -1, -1, 0);
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 2, 3, 4, 5, 5);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const __m256 p = _mm256_permutevar8x32_ps(_mm256_maskload_ps(&positions[i].x, six), spread);
+        const __m256 a0 = _mm256_add_ps(_mm256_mul_ps(c0, _mm256_permute_ps(p, 0x00)),
+                                        _mm256_mul_ps(c1, _mm256_permute_ps(p, 0x55)));
+        // w is 1, so its column is added as is
+        const __m256 a1 = _mm256_add_ps(_mm256_mul_ps(c2, _mm256_permute_ps(p, 0xAA)), c3);
+        const __m256 c = _mm256_add_ps(a0, a1);
+        const __m256 ndc = _mm256_div_ps(c, _mm256_permute_ps(c, 0xFF));
+        const __m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ndc, flip), shift), scale);
+        _mm_storeu_ps(&clip[i][0], _mm256_castps256_ps128(c));
+        _mm_storeu_ps(&clip[i + 1][0], _mm256_extractf128_ps(c, 1));
+        _mm_storeu_ps(&screen[i][0], _mm256_castps256_ps128(s));
+        _mm_storeu_ps(&screen[i + 1][0], _mm256_extractf128_ps(s, 1));
+    }
+    if (i < n) {
+        const __m128 p = _mm_maskload_ps(&positions[i].x, three);
+        const __m128 a0 = _mm_add_ps(_mm_mul_ps(_mm256_castps256_ps128(c0), _mm_permute_ps(p, 0x00)),
+                                     _mm_mul_ps(_mm256_castps256_ps128(c1), _mm_permute_ps(p, 0x55)));
+        const __m128 a1 = _mm_add_ps(_mm_mul_ps(_mm256_castps256_ps128(c2), _mm_permute_ps(p, 0xAA)),
+                                     _mm256_castps256_ps128(c3));
+        const __m128 c = _mm_add_ps(a0, a1);
+        const __m128 ndc = _mm_div_ps(c, _mm_permute_ps(c, 0xFF));
+        _mm_storeu_ps(&clip[i][0], c);
+        _mm_storeu_ps(&screen[i][0], _mm_mul_ps(_mm_add_ps(_mm_mul_ps(ndc, _mm256_castps256_ps128(flip)),
+                                                           _mm256_castps256_ps128(shift)),
+                                                _mm256_castps256_ps128(scale)));
+    }
+}
+
+KERNEL static int rasterSpanAVX2(const SpanSetup& s, int y, int x0, int x1, float* zrow, int row_offset,
+                                 const FragmentArrays& out, int count)
+{
+    const float fy = float(y) - s.oy;
+    const __m256 base0 = _mm256_set1_ps(s.c[0] + s.dy[0] * fy);
+    const __m256 base1 = _mm256_set1_ps(s.c[1] + s.dy[1] * fy);
+    const __m256 base2 = _mm256_set1_ps(s.c[2] + s.dy[2] * fy);
+    const __m256 dx0 = _mm256_set1_ps(s.dx[0]), dx1 = _mm256_set1_ps(s.dx[1]), dx2 = _mm256_set1_ps(s.dx[2]);
+    const __m256 iz0 = _mm256_set1_ps(s.invz[0]), iz1 = _mm256_set1_ps(s.invz[1]), iz2 = _mm256_set1_ps(s.invz[2]);
+    const __m256 ox = _mm256_set1_ps(s.ox);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 one = _mm256_set1_ps(1.f);
+
+    for (int x = x0; x < x1; x += 8) {
+        // lanes past x1 are masked off, also for the loads, so the last row can't be overrun
+        const __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(x1 - x), lane);
+        const __m256i xi = _mm256_add_epi32(_mm256_set1_epi32(x), lane);
+        const __m256 fx = _mm256_sub_ps(_mm256_cvtepi32_ps(xi), ox);
+        const __m256 p0 = _mm256_mul_ps(_mm256_add_ps(base0, _mm256_mul_ps(dx0, fx)), iz0);
+        const __m256 p1 = _mm256_mul_ps(_mm256_add_ps(base1, _mm256_mul_ps(dx1, fx)), iz1);
+        const __m256 p2 = _mm256_mul_ps(_mm256_add_ps(base2, _mm256_mul_ps(dx2, fx)), iz2);
+        const __m256 z = _mm256_div_ps(one, _mm256_add_ps(_mm256_add_ps(p0, p1), p2));
+        const __m256 zold = _mm256_maskload_ps(zrow + x, active);
+        const __m256 pass = _mm256_and_ps(_mm256_cmp_ps(z, zold, _CMP_LT_OQ), _mm256_castsi256_ps(active));
+        const int mask = _mm256_movemask_ps(pass);
+        if (!mask) {
+            continue;
+        }
+        _mm256_maskstore_ps(zrow + x, _mm256_castps_si256(pass), z);
+
+        // left-pack the passing lanes and store all eight; the slack absorbs the extra ones
+        const __m256i perm = _mm256_load_si256(reinterpret_cast<const __m256i*>(s_leftPack.idx[mask]));
+        const __m256i pixel = _mm256_add_epi32(xi, _mm256_set1_epi32(row_offset));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.pixel + count), _mm256_permutevar8x32_epi32(pixel, perm));
+        _mm256_storeu_ps(out.w0 + count, _mm256_permutevar8x32_ps(_mm256_mul_ps(p0, z), perm));
+        _mm256_storeu_ps(out.w1 + count, _mm256_permutevar8x32_ps(_mm256_mul_ps(p1, z), perm));
+        _mm256_storeu_ps(out.w2 + count, _mm256_permutevar8x32_ps(_mm256_mul_ps(p2, z), perm));
+        count += __builtin_popcount(mask);
+    }
+    return count;
+}
+
+KERNEL static int depthSpanAVX2(const SpanSetup& s, int y, int x0, int x1, float* zrow)
+{
+    const float fy = float(y) - s.oy;
+    const __m256 base0 = _mm256_set1_ps(s.c[0] + s.dy[0] * fy);
+    const __m256 base1 = _mm256_set1_ps(s.c[1] + s.dy[1] * fy);
+    const __m256 base2 = _mm256_set1_ps(s.c[2] + s.dy[2] * fy);
+    const __m256 dx0 = _mm256_set1_ps(s.dx[0]), dx1 = _mm256_set1_ps(s.dx[1]), dx2 = _mm256_set1_ps(s.dx[2]);
+    const __m256 iz0 = _mm256_set1_ps(s.invz[0]), iz1 = _mm256_set1_ps(s.invz[1]), iz2 = _mm256_set1_ps(s.invz[2]);
+    const __m256 ox = _mm256_set1_ps(s.ox);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 one = _mm256_set1_ps(1.f);
+
+    int passed = 0;
+    for (int x = x0; x < x1; x += 8) {
+        const __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(x1 - x), lane);
+        const __m256 fx = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x), lane)), ox);
+        const __m256 p0 = _mm256_mul_ps(_mm256_add_ps(base0, _mm256_mul_ps(dx0, fx)), iz0);
+        const __m256 p1 = _mm256_mul_ps(_mm256_add_ps(base1, _mm256_mul_ps(dx1, fx)), iz1);
+        const __m256 p2 = _mm256_mul_ps(_mm256_add_ps(base2, _mm256_mul_ps(dx2, fx)), iz2);
+        const __m256 z = _mm256_div_ps(one, _mm256_add_ps(_mm256_add_ps(p0, p1), p2));
+        const __m256 pass = _mm256_and_ps(_mm256_cmp_ps(z, _mm256_maskload_ps(zrow + x, active), _CMP_LT_OQ),
+                                          _mm256_castsi256_ps(active));
+        _mm256_maskstore_ps(zrow + x, _mm256_castps_si256(pass), z);
+        passed += __builtin_popcount(_mm256_movemask_ps(pass));
+    }
+    return passed;
+}
+
+// w0*c[0] + w1*c[1] + w2*c[2], in the scalar kernel's order
+KERNEL static inline __m256 interpolate(__m256 w0, __m256 w1, __m256 w2, const float* c)
+{
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w0, _mm256_set1_ps(c[0])), _mm256_mul_ps(w1, _mm256_set1_ps(c[1]))),
+                         _mm256_mul_ps(w2, _mm256_set1_ps(c[2])));
+}
+
+template <unsigned F>
+KERNEL static void shadeAVX2(const ShadeSetup& s, const TextureView& tex, const NormalMapView& nor, const GBufferView& gbuf,
+                             const FragmentArrays& frags, int begin, int end, QRgb* color)
+{
+    const __m256 u0 = _mm256_set1_ps(s.u[0]), u1 = _mm256_set1_ps(s.u[1]), u2 = _mm256_set1_ps(s.u[2]);
+    const __m256 v0 = _mm256_set1_ps(s.v[0]), v1 = _mm256_set1_ps(s.v[1]), v2 = _mm256_set1_ps(s.v[2]);
+    const __m256 n0 = _mm256_set1_ps(s.ndl[0]), n1 = _mm256_set1_ps(s.ndl[1]), n2 = _mm256_set1_ps(s.ndl[2]);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f), half = _mm256_set1_ps(0.5f);
+    const __m256 max255 = _mm256_set1_ps(255.f);
+    const __m256 texW = _mm256_set1_ps(float(tex.width)), texH = _mm256_set1_ps(float(tex.height));
+    const __m256 texMaxX = _mm256_set1_ps(tex.width - 1.f), texMaxY = _mm256_set1_ps(tex.height - 1.f);
+    const __m256i stride = _mm256_set1_epi32(tex.stride);
+    const __m256i byte = _mm256_set1_epi32(0xFF);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 t0 = _mm256_set1_ps(s.tdl[0]), t1 = _mm256_set1_ps(s.tdl[1]), t2 = _mm256_set1_ps(s.tdl[2]);
+    const __m256 b0 = _mm256_set1_ps(s.bdl[0]), b1 = _mm256_set1_ps(s.bdl[1]), b2 = _mm256_set1_ps(s.bdl[2]);
+    const __m256 norW = _mm256_set1_ps(float(nor.width)), norH = _mm256_set1_ps(float(nor.height));
+    const __m256 norMaxX = _mm256_set1_ps(nor.width - 1.f), norMaxY = _mm256_set1_ps(nor.height - 1.f);
+    const __m256i norStride = _mm256_set1_epi32(nor.width);
+    const __m256 snorm = _mm256_set1_ps(1.f / 127.f);
+
+    for (int k = begin; k < end; k += 8) {
+        const int n = std::min(8, end - k);
+        const __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(n), lane);
+        const __m256 w0 = _mm256_maskload_ps(frags.w0 + k, active);
+        const __m256 w1 = _mm256_maskload_ps(frags.w1 + k, active);
+        const __m256 w2 = _mm256_maskload_ps(frags.w2 + k, active);
+        __m256 u = zero, v = zero;
+        if constexpr ((F & (SHADE_TEXTURE | SHADE_NORMAL_MAP)) != 0) {
+            u = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w0, u0), _mm256_mul_ps(w1, u1)), _mm256_mul_ps(w2, u2));
+            v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w0, v0), _mm256_mul_ps(w1, v1)), _mm256_mul_ps(w2, v2));
+        }
+        __m256 nx = zero, ny = zero, nz = one;
+        if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+            const __m256i X = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_mul_ps(norW, u), norMaxX));
+            const __m256i Y = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_mul_ps(norH, _mm256_sub_ps(one, v)), norMaxY));
+            const __m256i inside = _mm256_and_si256(active, _mm256_cmpgt_epi32(_mm256_or_si256(X, Y), _mm256_set1_epi32(-1)));
+            // four bytes from each two byte texel, the upper two belong to the next one
+            const __m256i t = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(nor.texels),
+                                                          _mm256_add_epi32(_mm256_mullo_epi32(Y, norStride), X), inside, 2);
+            nx = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(t, 24), 24)), snorm);
+            ny = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(t, 16), 24)), snorm);
+            nz = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_sub_ps(one, _mm256_mul_ps(nx, nx)),
+                                                            _mm256_mul_ps(ny, ny)), zero));
+        }
+        __m256 lambda = one;
+        if constexpr ((F & SHADE_GBUFFER) != 0) {
+            for (int a = 0; a < 3; a++) {
+                __m256 normal = interpolate(w0, w1, w2, s.n[a]);
+                if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+                    normal = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, interpolate(w0, w1, w2, s.t[a])),
+                                                         _mm256_mul_ps(ny, interpolate(w0, w1, w2, s.b[a]))),
+                                           _mm256_mul_ps(nz, normal));
+                }
+                alignas(32) float out[2][8];
+                _mm256_store_ps(out[0], normal);
+                _mm256_store_ps(out[1], interpolate(w0, w1, w2, s.p[a]));
+                for (int i = 0; i < n; i++) {
+                    gbuf.normal[a][frags.pixel[k + i]] = out[0][i];
+                    gbuf.position[a][frags.pixel[k + i]] = out[1][i];
+                }
+            }
+        } else {
+            __m256 ndl = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w0, n0), _mm256_mul_ps(w1, n1)), _mm256_mul_ps(w2, n2));
+            if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+                const __m256 tdl = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w0, t0), _mm256_mul_ps(w1, t1)), _mm256_mul_ps(w2, t2));
+                const __m256 bdl = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w0, b0), _mm256_mul_ps(w1, b1)), _mm256_mul_ps(w2, b2));
+                ndl = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, tdl), _mm256_mul_ps(ny, bdl)), _mm256_mul_ps(nz, ndl));
+            }
+            lambda = _mm256_add_ps(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(ndl, zero), one), _mm256_set1_ps(0.7f)),
+                                   _mm256_set1_ps(0.3f));
+        }
+
+        __m256 r = max255, g = max255, b = max255;
+        if constexpr ((F & SHADE_TEXTURE) != 0) {
+            const __m256i X = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_mul_ps(texW, u), texMaxX));
+            const __m256i Y = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_mul_ps(texH, _mm256_sub_ps(one, v)), texMaxY));
+            const __m256i inside = _mm256_and_si256(active, _mm256_cmpgt_epi32(_mm256_or_si256(X, Y), _mm256_set1_epi32(-1)));
+            const __m256i t = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(tex.bits),
+                                                          _mm256_add_epi32(_mm256_mullo_epi32(Y, stride), X), inside, 4);
+            r = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(t, 16), byte));
+            g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(t, 8), byte));
+            b = _mm256_cvtepi32_ps(_mm256_and_si256(t, byte));
+        }
+        if constexpr ((F & SHADE_VERTEX_COLOR) != 0) {
+            r = _mm256_mul_ps(r, interpolate(w0, w1, w2, s.rgb[0]));
+            g = _mm256_mul_ps(g, interpolate(w0, w1, w2, s.rgb[1]));
+            b = _mm256_mul_ps(b, interpolate(w0, w1, w2, s.rgb[2]));
+        }
+        const __m256i ri = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(r, lambda), zero), max255), half));
+        const __m256i gi = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(g, lambda), zero), max255), half));
+        const __m256i bi = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(b, lambda), zero), max255), half));
+        const __m256i packed = _mm256_or_si256(_mm256_or_si256(_mm256_set1_epi32(int(0xFF000000)), _mm256_slli_epi32(ri, 16)),
+                                               _mm256_or_si256(_mm256_slli_epi32(gi, 8), bi));
+        // no scatter before AVX-512
+        alignas(32) QRgb rgb[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(rgb), packed);
+        for (int i = 0; i < n; i++) {
+            color[frags.pixel[k + i]] = rgb[i];
+        }
+    }
+}
+
+KERNEL static void lightAVX2(const LightSetup* lights, const int* indices, int count, float ambient, const GBufferView& g,
+                             const float* depth, int width, int x0, int y0, int x1, int y1, QRgb* color)
+{
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f), half = _mm256_set1_ps(0.5f);
+    const __m256 max255 = _mm256_set1_ps(255.f);
+    const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 minDist = _mm256_set1_ps(1e-6f);
+    const __m256i byte = _mm256_set1_epi32(0xFF);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x += 8) {
+            const int i = y * width + x;
+            const __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(x1 - x), lane);
+            // masked off lanes read a depth of 0, so they count as empty
+            const __m256 z = _mm256_maskload_ps(depth + i, active);
+            const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(z, zero, _CMP_GT_OQ), _mm256_cmp_ps(z, inf, _CMP_LT_OQ));
+            if (_mm256_testz_ps(valid, valid)) {
+                continue;
+            }
+            __m256 nx = _mm256_maskload_ps(g.normal[0] + i, active);
+            __m256 ny = _mm256_maskload_ps(g.normal[1] + i, active);
+            __m256 nz = _mm256_maskload_ps(g.normal[2] + i, active);
+            const __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)),
+                                                            _mm256_mul_ps(nz, nz)));
+            const __m256 inv = _mm256_and_ps(_mm256_cmp_ps(len, zero, _CMP_GT_OQ), _mm256_div_ps(one, len));
+            nx = _mm256_mul_ps(nx, inv);
+            ny = _mm256_mul_ps(ny, inv);
+            nz = _mm256_mul_ps(nz, inv);
+            const __m256 px = _mm256_maskload_ps(g.position[0] + i, active);
+            const __m256 py = _mm256_maskload_ps(g.position[1] + i, active);
+            const __m256 pz = _mm256_maskload_ps(g.position[2] + i, active);
+
+            __m256 r = _mm256_set1_ps(ambient), gr = r, b = r;
+            for (int j = 0; j < count; j++) {
+                const LightSetup& l = lights[indices[j]];
+                __m256 lx = _mm256_sub_ps(_mm256_set1_ps(l.pos[0]), px);
+                __m256 ly = _mm256_sub_ps(_mm256_set1_ps(l.pos[1]), py);
+                __m256 lz = _mm256_sub_ps(_mm256_set1_ps(l.pos[2]), pz);
+                const __m256 d = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)),
+                                                              _mm256_mul_ps(lz, lz)));
+                const __m256 invd = _mm256_div_ps(one, _mm256_max_ps(d, minDist));
+                lx = _mm256_mul_ps(lx, invd);
+                ly = _mm256_mul_ps(ly, invd);
+                lz = _mm256_mul_ps(lz, invd);
+                const __m256 ndl = _mm256_max_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, lx), _mm256_mul_ps(ny, ly)),
+                                                               _mm256_mul_ps(nz, lz)), zero);
+                const __m256 fade = _mm256_max_ps(_mm256_sub_ps(one, _mm256_mul_ps(d, _mm256_set1_ps(l.invRange))), zero);
+                const __m256 along = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, _mm256_set1_ps(l.axis[0])),
+                                                                 _mm256_mul_ps(ly, _mm256_set1_ps(l.axis[1]))),
+                                                   _mm256_mul_ps(lz, _mm256_set1_ps(l.axis[2])));
+                const __m256 cone = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(along, _mm256_set1_ps(l.coneCos)),
+                                                                              _mm256_set1_ps(l.coneScale)), zero), one);
+                __m256 k = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(ndl, fade), fade), cone);
+                if (l.shadow) {
+                    k = _mm256_mul_ps(k, _mm256_maskload_ps(l.shadow + i, active));
+                }
+                r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(l.color[0]), k));
+                gr = _mm256_add_ps(gr, _mm256_mul_ps(_mm256_set1_ps(l.color[1]), k));
+                b = _mm256_add_ps(b, _mm256_mul_ps(_mm256_set1_ps(l.color[2]), k));
+            }
+
+            int* pixels = reinterpret_cast<int*>(color + i);
+            const __m256i albedo = _mm256_maskload_epi32(pixels, active);
+            r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(albedo, 16), byte)), r);
+            gr = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(albedo, 8), byte)), gr);
+            b = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(albedo, byte)), b);
+            const __m256i ri = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_min_ps(_mm256_max_ps(r, zero), max255), half));
+            const __m256i gi = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_min_ps(_mm256_max_ps(gr, zero), max255), half));
+            const __m256i bi = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_min_ps(_mm256_max_ps(b, zero), max255), half));
+            _mm256_maskstore_epi32(pixels, _mm256_castps_si256(valid),
+                                   _mm256_or_si256(_mm256_or_si256(_mm256_set1_epi32(int(0xFF000000)), _mm256_slli_epi32(ri, 16)),
+                                                   _mm256_or_si256(_mm256_slli_epi32(gi, 8), bi)));
+        }
+    }
+}
+
+KERNEL static void shadowAVX2(const ShadowSetup& s, const GBufferView& g, const float* depth, int width,
+                              int x0, int y0, int x1, int y1, float* visibility)
+{
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f), half = _mm256_set1_ps(0.5f);
+    const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 minDist = _mm256_set1_ps(1e-6f);
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    const __m256 mapHalf = _mm256_set1_ps(0.5f * float(s.size));
+    const __m256 offset = _mm256_set1_ps(s.offset);
+    const __m256 taps = _mm256_set1_ps(1.f / float((2 * s.radius + 1) * (2 * s.radius + 1)));
+    const __m256i last = _mm256_set1_epi32(s.size - 1), izero = _mm256_setzero_si256();
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 m[16];
+    for (int e = 0; e < 16; e++) {
+        m[e] = _mm256_set1_ps(s.viewProj[e]);
+    }
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x += 8) {
+            const int i = y * width + x;
+            const __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(x1 - x), lane);
+            const __m256 z = _mm256_maskload_ps(depth + i, active);
+            const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(z, zero, _CMP_GT_OQ), _mm256_cmp_ps(z, inf, _CMP_LT_OQ));
+            if (_mm256_testz_ps(valid, valid)) {
+                continue;
+            }
+            __m256 nx = _mm256_maskload_ps(g.normal[0] + i, active);
+            __m256 ny = _mm256_maskload_ps(g.normal[1] + i, active);
+            __m256 nz = _mm256_maskload_ps(g.normal[2] + i, active);
+            const __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)),
+                                                            _mm256_mul_ps(nz, nz)));
+            const __m256 inv = _mm256_and_ps(_mm256_cmp_ps(len, zero, _CMP_GT_OQ), _mm256_div_ps(one, len));
+            nx = _mm256_mul_ps(nx, inv);
+            ny = _mm256_mul_ps(ny, inv);
+            nz = _mm256_mul_ps(nz, inv);
+            __m256 px = _mm256_maskload_ps(g.position[0] + i, active);
+            __m256 py = _mm256_maskload_ps(g.position[1] + i, active);
+            __m256 pz = _mm256_maskload_ps(g.position[2] + i, active);
+            const __m256 lx = _mm256_sub_ps(_mm256_set1_ps(s.lightPos[0]), px);
+            const __m256 ly = _mm256_sub_ps(_mm256_set1_ps(s.lightPos[1]), py);
+            const __m256 lz = _mm256_sub_ps(_mm256_set1_ps(s.lightPos[2]), pz);
+            const __m256 d = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)),
+                                                          _mm256_mul_ps(lz, lz)));
+            const __m256 invd = _mm256_div_ps(one, _mm256_max_ps(d, minDist));
+            const __m256 off = _mm256_mul_ps(d, offset);
+            px = _mm256_add_ps(px, _mm256_mul_ps(_mm256_add_ps(nx, _mm256_mul_ps(lx, invd)), off));
+            py = _mm256_add_ps(py, _mm256_mul_ps(_mm256_add_ps(ny, _mm256_mul_ps(ly, invd)), off));
+            pz = _mm256_add_ps(pz, _mm256_mul_ps(_mm256_add_ps(nz, _mm256_mul_ps(lz, invd)), off));
+
+            const __m256 cx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], px), _mm256_mul_ps(m[4], py)),
+                                                          _mm256_mul_ps(m[8], pz)), m[12]);
+            const __m256 cy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[1], px), _mm256_mul_ps(m[5], py)),
+                                                          _mm256_mul_ps(m[9], pz)), m[13]);
+            const __m256 cw = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[3], px), _mm256_mul_ps(m[7], py)),
+                                                          _mm256_mul_ps(m[11], pz)), m[15]);
+            const __m256 inside = _mm256_and_ps(_mm256_and_ps(valid, _mm256_cmp_ps(cw, zero, _CMP_GT_OQ)),
+                                                _mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(sign, cx), cw, _CMP_LE_OQ),
+                                                              _mm256_cmp_ps(_mm256_andnot_ps(sign, cy), cw, _CMP_LE_OQ)));
+            if (_mm256_testz_ps(inside, inside)) {
+                continue;
+            }
+            const __m256 invw = _mm256_div_ps(one, cw);
+            const __m256i tu = _mm256_cvttps_epi32(_mm256_floor_ps(
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(cx, invw), one), mapHalf), half)));
+            const __m256i tv = _mm256_cvttps_epi32(_mm256_floor_ps(
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(cy, invw)), mapHalf), half)));
+            // clamped, the taps of lanes outside the view stay in the map too
+            __m256 lit = zero;
+            for (int dy = -s.radius; dy <= s.radius; dy++) {
+                const __m256i row = _mm256_mullo_epi32(
+                        _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(tv, _mm256_set1_epi32(dy)), izero), last),
+                        _mm256_set1_epi32(s.size));
+                for (int dx = -s.radius; dx <= s.radius; dx++) {
+                    const __m256i col = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(tu, _mm256_set1_epi32(dx)), izero), last);
+                    const __m256 tap = _mm256_i32gather_ps(s.depth, _mm256_add_epi32(row, col), 4);
+                    lit = _mm256_add_ps(lit, _mm256_and_ps(_mm256_cmp_ps(cw, tap, _CMP_LE_OQ), one));
+                }
+            }
+            _mm256_maskstore_ps(visibility + i, _mm256_castps_si256(inside), _mm256_mul_ps(lit, taps));
+        }
+    }
+}
+
+extern const RasterKernels g_kernelsAVX2 = {"avx2", transformAVX2, rasterSpanAVX2, depthSpanAVX2, SHADE_KERNELS(shadeAVX2), lightAVX2, shadowAVX2};
+
+#endif
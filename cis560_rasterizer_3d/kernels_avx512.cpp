@@ -0,0 +1,377 @@
+// AVX-512 variants of the raster kernels, sixteen lanes wide, using mask registers for the
+// span ends and compress / scatter stores for the fragments. Built with a target attribute
+// rather than a compiler flag, so the rest of the binary still runs on older CPUs.
+#include "kernels.h"
+
+#ifdef RASTERIZER_X86_KERNELS
+
+#include <immintrin.h>
+#include <algorithm>
+#include <limits>
+
+#define KERNEL __attribute__((target("avx512f")))
+
+#if defined(__GNUC__) && !defined(__clang__)
+// gcc 12's own avx512 intrinsics trip its uninitialized warnings in every kernel (gcc bug 105593)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+KERNEL static void transformAVX512(const glm::vec3* positions, size_t n, const glm::mat4& view_proj, float width, float height,
+                                   glm::vec4* clip, glm::vec4* screen)
+{
+    // four vertices per register, one in each 128-bit quarter
+    const __m512 c0 = _mm512_broadcast_f32x4(_mm_loadu_ps(&view_proj[0][0]));
+    const __m512 c1 = _mm512_broadcast_f32x4(_mm_loadu_ps(&view_proj[1][0]));
+    const __m512 c2 = _mm512_broadcast_f32x4(_mm_loadu_ps(&view_proj[2][0]));
+    const __m512 c3 = _mm512_broadcast_f32x4(_mm_loadu_ps(&view_proj[3][0]));
+    const __m512 flip = _mm512_broadcast_f32x4(_mm_setr_ps(1.f, -1.f, 1.f, 0.f));
+    const __m512 shift = _mm512_broadcast_f32x4(_mm_setr_ps(1.f, 1.f, 0.f, 1.f));
+    const __m512 scale = _mm512_broadcast_f32x4(_mm_setr_ps(width/2, height/2, 1.f, 1.f));
+    // the twelve floats of four positions, spread to one per quarter as (x, y, z, z)
+    const __m512i spread = _mm512_setr_epi32(0, 1, 2, 2, 3, 4, 5, 5, 6, 7, 8, 8, 9, 10, 11, 11);
+    for (size_t i = 0; i < n; i += 4) {
+        const int m = int(std::min<size_t>(4, n - i));
+        const __m512 p = _mm512_permutexvar_ps(spread, _mm512_maskz_loadu_ps(__mmask16((1u << (3 * m)) - 1), &positions[i].x));
+        const __m512 a0 = _mm512_add_ps(_mm512_mul_ps(c0, _mm512_permute_ps(p, 0x00)),
+                                        _mm512_mul_ps(c1, _mm512_permute_ps(p, 0x55)));
+        // w is 1, so its column is added as is
+        const __m512 a1 = _mm512_add_ps(_mm512_mul_ps(c2, _mm512_permute_ps(p, 0xAA)), c3);
+        const __m512 c = _mm512_add_ps(a0, a1);
+        const __m512 ndc = _mm512_div_ps(c, _mm512_permute_ps(c, 0xFF));
+        const __m512 s = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(ndc, flip), shift), scale);
+        const __mmask16 valid = __mmask16((1u << (4 * m)) - 1);
+        _mm512_mask_storeu_ps(&clip[i][0], valid, c);
+        _mm512_mask_storeu_ps(&screen[i][0], valid, s);
+    }
+}
+
+KERNEL static int rasterSpanAVX512(const SpanSetup& s, int y, int x0, int x1, float* zrow, int row_offset,
+                                   const FragmentArrays& out, int count)
+{
+    const float fy = float(y) - s.oy;
+    const __m512 base0 = _mm512_set1_ps(s.c[0] + s.dy[0] * fy);
+    const __m512 base1 = _mm512_set1_ps(s.c[1] + s.dy[1] * fy);
+    const __m512 base2 = _mm512_set1_ps(s.c[2] + s.dy[2] * fy);
+    const __m512 dx0 = _mm512_set1_ps(s.dx[0]), dx1 = _mm512_set1_ps(s.dx[1]), dx2 = _mm512_set1_ps(s.dx[2]);
+    const __m512 iz0 = _mm512_set1_ps(s.invz[0]), iz1 = _mm512_set1_ps(s.invz[1]), iz2 = _mm512_set1_ps(s.invz[2]);
+    const __m512 ox = _mm512_set1_ps(s.ox);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512 one = _mm512_set1_ps(1.f);
+
+    for (int x = x0; x < x1; x += 16) {
+        const __mmask16 active = _mm512_cmpgt_epi32_mask(_mm512_set1_epi32(x1 - x), lane);
+        const __m512i xi = _mm512_add_epi32(_mm512_set1_epi32(x), lane);
+        const __m512 fx = _mm512_sub_ps(_mm512_cvtepi32_ps(xi), ox);
+        const __m512 p0 = _mm512_mul_ps(_mm512_add_ps(base0, _mm512_mul_ps(dx0, fx)), iz0);
+        const __m512 p1 = _mm512_mul_ps(_mm512_add_ps(base1, _mm512_mul_ps(dx1, fx)), iz1);
+        const __m512 p2 = _mm512_mul_ps(_mm512_add_ps(base2, _mm512_mul_ps(dx2, fx)), iz2);
+        const __m512 z = _mm512_div_ps(one, _mm512_add_ps(_mm512_add_ps(p0, p1), p2));
+        const __m512 zold = _mm512_maskz_loadu_ps(active, zrow + x);
+        const __mmask16 pass = _mm512_mask_cmp_ps_mask(active, z, zold, _CMP_LT_OQ);
+        if (!pass) {
+            continue;
+        }
+        _mm512_mask_storeu_ps(zrow + x, pass, z);
+        _mm512_mask_compressstoreu_epi32(out.pixel + count, pass, _mm512_add_epi32(xi, _mm512_set1_epi32(row_offset)));
+        _mm512_mask_compressstoreu_ps(out.w0 + count, pass, _mm512_mul_ps(p0, z));
+        _mm512_mask_compressstoreu_ps(out.w1 + count, pass, _mm512_mul_ps(p1, z));
+        _mm512_mask_compressstoreu_ps(out.w2 + count, pass, _mm512_mul_ps(p2, z));
+        count += __builtin_popcount(pass);
+    }
+    return count;
+}
+
+KERNEL static int depthSpanAVX512(const SpanSetup& s, int y, int x0, int x1, float* zrow)
+{
+    const float fy = float(y) - s.oy;
+    const __m512 base0 = _mm512_set1_ps(s.c[0] + s.dy[0] * fy);
+    const __m512 base1 = _mm512_set1_ps(s.c[1] + s.dy[1] * fy);
+    const __m512 base2 = _mm512_set1_ps(s.c[2] + s.dy[2] * fy);
+    const __m512 dx0 = _mm512_set1_ps(s.dx[0]), dx1 = _mm512_set1_ps(s.dx[1]), dx2 = _mm512_set1_ps(s.dx[2]);
+    const __m512 iz0 = _mm512_set1_ps(s.invz[0]), iz1 = _mm512_set1_ps(s.invz[1]), iz2 = _mm512_set1_ps(s.invz[2]);
+    const __m512 ox = _mm512_set1_ps(s.ox);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512 one = _mm512_set1_ps(1.f);
+
+    int passed = 0;
+    for (int x = x0; x < x1; x += 16) {
+        const __mmask16 active = _mm512_cmpgt_epi32_mask(_mm512_set1_epi32(x1 - x), lane);
+        const __m512 fx = _mm512_sub_ps(_mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_set1_epi32(x), lane)), ox);
+        const __m512 p0 = _mm512_mul_ps(_mm512_add_ps(base0, _mm512_mul_ps(dx0, fx)), iz0);
+        const __m512 p1 = _mm512_mul_ps(_mm512_add_ps(base1, _mm512_mul_ps(dx1, fx)), iz1);
+        const __m512 p2 = _mm512_mul_ps(_mm512_add_ps(base2, _mm512_mul_ps(dx2, fx)), iz2);
+        const __m512 z = _mm512_div_ps(one, _mm512_add_ps(_mm512_add_ps(p0, p1), p2));
+        const __mmask16 pass = _mm512_mask_cmp_ps_mask(active, z, _mm512_maskz_loadu_ps(active, zrow + x), _CMP_LT_OQ);
+        _mm512_mask_storeu_ps(zrow + x, pass, z);
+        passed += __builtin_popcount(pass);
+    }
+    return passed;
+}
+
+// w0*c[0] + w1*c[1] + w2*c[2], in the scalar kernel's order
+KERNEL static inline __m512 interpolate(__m512 w0, __m512 w1, __m512 w2, const float* c)
+{
+    return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(w0, _mm512_set1_ps(c[0])), _mm512_mul_ps(w1, _mm512_set1_ps(c[1]))),
+                         _mm512_mul_ps(w2, _mm512_set1_ps(c[2])));
+}
+
+template <unsigned F>
+KERNEL static void shadeAVX512(const ShadeSetup& s, const TextureView& tex, const NormalMapView& nor, const GBufferView& gbuf,
+                               const FragmentArrays& frags, int begin, int end, QRgb* color)
+{
+    const __m512 u0 = _mm512_set1_ps(s.u[0]), u1 = _mm512_set1_ps(s.u[1]), u2 = _mm512_set1_ps(s.u[2]);
+    const __m512 v0 = _mm512_set1_ps(s.v[0]), v1 = _mm512_set1_ps(s.v[1]), v2 = _mm512_set1_ps(s.v[2]);
+    const __m512 n0 = _mm512_set1_ps(s.ndl[0]), n1 = _mm512_set1_ps(s.ndl[1]), n2 = _mm512_set1_ps(s.ndl[2]);
+    const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.f), half = _mm512_set1_ps(0.5f);
+    const __m512 max255 = _mm512_set1_ps(255.f);
+    const __m512 texW = _mm512_set1_ps(float(tex.width)), texH = _mm512_set1_ps(float(tex.height));
+    const __m512 texMaxX = _mm512_set1_ps(tex.width - 1.f), texMaxY = _mm512_set1_ps(tex.height - 1.f);
+    const __m512i stride = _mm512_set1_epi32(tex.stride);
+    const __m512i byte = _mm512_set1_epi32(0xFF);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512 t0 = _mm512_set1_ps(s.tdl[0]), t1 = _mm512_set1_ps(s.tdl[1]), t2 = _mm512_set1_ps(s.tdl[2]);
+    const __m512 b0 = _mm512_set1_ps(s.bdl[0]), b1 = _mm512_set1_ps(s.bdl[1]), b2 = _mm512_set1_ps(s.bdl[2]);
+    const __m512 norW = _mm512_set1_ps(float(nor.width)), norH = _mm512_set1_ps(float(nor.height));
+    const __m512 norMaxX = _mm512_set1_ps(nor.width - 1.f), norMaxY = _mm512_set1_ps(nor.height - 1.f);
+    const __m512i norStride = _mm512_set1_epi32(nor.width);
+    const __m512 snorm = _mm512_set1_ps(1.f / 127.f);
+
+    for (int k = begin; k < end; k += 16) {
+        const __mmask16 active = _mm512_cmpgt_epi32_mask(_mm512_set1_epi32(end - k), lane);
+        const __m512 w0 = _mm512_maskz_loadu_ps(active, frags.w0 + k);
+        const __m512 w1 = _mm512_maskz_loadu_ps(active, frags.w1 + k);
+        const __m512 w2 = _mm512_maskz_loadu_ps(active, frags.w2 + k);
+        __m512 u = zero, v = zero;
+        if constexpr ((F & (SHADE_TEXTURE | SHADE_NORMAL_MAP)) != 0) {
+            u = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(w0, u0), _mm512_mul_ps(w1, u1)), _mm512_mul_ps(w2, u2));
+            v = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(w0, v0), _mm512_mul_ps(w1, v1)), _mm512_mul_ps(w2, v2));
+        }
+        const __m512i pixel = _mm512_maskz_loadu_epi32(active, frags.pixel + k);
+        __m512 nx = zero, ny = zero, nz = one;
+        if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+            const __m512i X = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_mul_ps(norW, u), norMaxX));
+            const __m512i Y = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_mul_ps(norH, _mm512_sub_ps(one, v)), norMaxY));
+            const __mmask16 inside = _mm512_mask_cmpgt_epi32_mask(active, _mm512_or_si512(X, Y), _mm512_set1_epi32(-1));
+            // four bytes from each two byte texel, the upper two belong to the next one
+            const __m512i t = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), inside,
+                                                          _mm512_add_epi32(_mm512_mullo_epi32(Y, norStride), X),
+                                                          reinterpret_cast<const int*>(nor.texels), 2);
+            nx = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_srai_epi32(_mm512_slli_epi32(t, 24), 24)), snorm);
+            ny = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_srai_epi32(_mm512_slli_epi32(t, 16), 24)), snorm);
+            nz = _mm512_sqrt_ps(_mm512_max_ps(_mm512_sub_ps(_mm512_sub_ps(one, _mm512_mul_ps(nx, nx)),
+                                                            _mm512_mul_ps(ny, ny)), zero));
+        }
+        __m512 lambda = one;
+        if constexpr ((F & SHADE_GBUFFER) != 0) {
+            for (int a = 0; a < 3; a++) {
+                __m512 normal = interpolate(w0, w1, w2, s.n[a]);
+                if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+                    normal = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(nx, interpolate(w0, w1, w2, s.t[a])),
+                                                         _mm512_mul_ps(ny, interpolate(w0, w1, w2, s.b[a]))),
+                                           _mm512_mul_ps(nz, normal));
+                }
+                _mm512_mask_i32scatter_ps(gbuf.normal[a], active, pixel, normal, 4);
+                _mm512_mask_i32scatter_ps(gbuf.position[a], active, pixel, interpolate(w0, w1, w2, s.p[a]), 4);
+            }
+        } else {
+            __m512 ndl = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(w0, n0), _mm512_mul_ps(w1, n1)), _mm512_mul_ps(w2, n2));
+            if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+                const __m512 tdl = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(w0, t0), _mm512_mul_ps(w1, t1)), _mm512_mul_ps(w2, t2));
+                const __m512 bdl = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(w0, b0), _mm512_mul_ps(w1, b1)), _mm512_mul_ps(w2, b2));
+                ndl = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(nx, tdl), _mm512_mul_ps(ny, bdl)), _mm512_mul_ps(nz, ndl));
+            }
+            lambda = _mm512_add_ps(_mm512_mul_ps(_mm512_min_ps(_mm512_max_ps(ndl, zero), one), _mm512_set1_ps(0.7f)),
+                                   _mm512_set1_ps(0.3f));
+        }
+
+        __m512 r = max255, g = max255, b = max255;
+        if constexpr ((F & SHADE_TEXTURE) != 0) {
+            const __m512i X = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_mul_ps(texW, u), texMaxX));
+            const __m512i Y = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_mul_ps(texH, _mm512_sub_ps(one, v)), texMaxY));
+            const __mmask16 inside = _mm512_mask_cmpgt_epi32_mask(active, _mm512_or_si512(X, Y), _mm512_set1_epi32(-1));
+            const __m512i t = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), inside,
+                                                          _mm512_add_epi32(_mm512_mullo_epi32(Y, stride), X),
+                                                          reinterpret_cast<const int*>(tex.bits), 4);
+            r = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(t, 16), byte));
+            g = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(t, 8), byte));
+            b = _mm512_cvtepi32_ps(_mm512_and_si512(t, byte));
+        }
+        if constexpr ((F & SHADE_VERTEX_COLOR) != 0) {
+            r = _mm512_mul_ps(r, interpolate(w0, w1, w2, s.rgb[0]));
+            g = _mm512_mul_ps(g, interpolate(w0, w1, w2, s.rgb[1]));
+            b = _mm512_mul_ps(b, interpolate(w0, w1, w2, s.rgb[2]));
+        }
+        const __m512i ri = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(r, lambda), zero), max255), half));
+        const __m512i gi = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(g, lambda), zero), max255), half));
+        const __m512i bi = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(b, lambda), zero), max255), half));
+        const __m512i packed = _mm512_or_si512(_mm512_or_si512(_mm512_set1_epi32(int(0xFF000000)), _mm512_slli_epi32(ri, 16)),
+                                               _mm512_or_si512(_mm512_slli_epi32(gi, 8), bi));
+        _mm512_mask_i32scatter_epi32(reinterpret_cast<int*>(color), active, pixel, packed, 4);
+    }
+}
+
+KERNEL static void lightAVX512(const LightSetup* lights, const int* indices, int count, float ambient, const GBufferView& g,
+                               const float* depth, int width, int x0, int y0, int x1, int y1, QRgb* color)
+{
+    const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.f), half = _mm512_set1_ps(0.5f);
+    const __m512 max255 = _mm512_set1_ps(255.f);
+    const __m512 inf = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+    const __m512 minDist = _mm512_set1_ps(1e-6f);
+    const __m512i byte = _mm512_set1_epi32(0xFF);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x += 16) {
+            const int i = y * width + x;
+            const __mmask16 active = _mm512_cmpgt_epi32_mask(_mm512_set1_epi32(x1 - x), lane);
+            const __m512 z = _mm512_maskz_loadu_ps(active, depth + i);
+            const __mmask16 valid = _mm512_mask_cmp_ps_mask(_mm512_cmp_ps_mask(z, zero, _CMP_GT_OQ), z, inf, _CMP_LT_OQ);
+            if (!valid) {
+                continue;
+            }
+            __m512 nx = _mm512_maskz_loadu_ps(active, g.normal[0] + i);
+            __m512 ny = _mm512_maskz_loadu_ps(active, g.normal[1] + i);
+            __m512 nz = _mm512_maskz_loadu_ps(active, g.normal[2] + i);
+            const __m512 len = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(nx, nx), _mm512_mul_ps(ny, ny)),
+                                                            _mm512_mul_ps(nz, nz)));
+            const __m512 inv = _mm512_maskz_div_ps(_mm512_cmp_ps_mask(len, zero, _CMP_GT_OQ), one, len);
+            nx = _mm512_mul_ps(nx, inv);
+            ny = _mm512_mul_ps(ny, inv);
+            nz = _mm512_mul_ps(nz, inv);
+            const __m512 px = _mm512_maskz_loadu_ps(active, g.position[0] + i);
+            const __m512 py = _mm512_maskz_loadu_ps(active, g.position[1] + i);
+            const __m512 pz = _mm512_maskz_loadu_ps(active, g.position[2] + i);
+
+            __m512 r = _mm512_set1_ps(ambient), gr = r, b = r;
+            for (int j = 0; j < count; j++) {
+                const LightSetup& l = lights[indices[j]];
+                __m512 lx = _mm512_sub_ps(_mm512_set1_ps(l.pos[0]), px);
+                __m512 ly = _mm512_sub_ps(_mm512_set1_ps(l.pos[1]), py);
+                __m512 lz = _mm512_sub_ps(_mm512_set1_ps(l.pos[2]), pz);
+                const __m512 d = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(lx, lx), _mm512_mul_ps(ly, ly)),
+                                                              _mm512_mul_ps(lz, lz)));
+                const __m512 invd = _mm512_div_ps(one, _mm512_max_ps(d, minDist));
+                lx = _mm512_mul_ps(lx, invd);
+                ly = _mm512_mul_ps(ly, invd);
+                lz = _mm512_mul_ps(lz, invd);
+                const __m512 ndl = _mm512_max_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(nx, lx), _mm512_mul_ps(ny, ly)),
+                                                               _mm512_mul_ps(nz, lz)), zero);
+                const __m512 fade = _mm512_max_ps(_mm512_sub_ps(one, _mm512_mul_ps(d, _mm512_set1_ps(l.invRange))), zero);
+                const __m512 along = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(lx, _mm512_set1_ps(l.axis[0])),
+                                                                 _mm512_mul_ps(ly, _mm512_set1_ps(l.axis[1]))),
+                                                   _mm512_mul_ps(lz, _mm512_set1_ps(l.axis[2])));
+                const __m512 cone = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_sub_ps(along, _mm512_set1_ps(l.coneCos)),
+                                                                              _mm512_set1_ps(l.coneScale)), zero), one);
+                __m512 k = _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(ndl, fade), fade), cone);
+                if (l.shadow) {
+                    k = _mm512_mul_ps(k, _mm512_maskz_loadu_ps(active, l.shadow + i));
+                }
+                r = _mm512_add_ps(r, _mm512_mul_ps(_mm512_set1_ps(l.color[0]), k));
+                gr = _mm512_add_ps(gr, _mm512_mul_ps(_mm512_set1_ps(l.color[1]), k));
+                b = _mm512_add_ps(b, _mm512_mul_ps(_mm512_set1_ps(l.color[2]), k));
+            }
+
+            const __m512i albedo = _mm512_maskz_loadu_epi32(active, color + i);
+            r = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(albedo, 16), byte)), r);
+            gr = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(albedo, 8), byte)), gr);
+            b = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_and_si512(albedo, byte)), b);
+            const __m512i ri = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_min_ps(_mm512_max_ps(r, zero), max255), half));
+            const __m512i gi = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_min_ps(_mm512_max_ps(gr, zero), max255), half));
+            const __m512i bi = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_min_ps(_mm512_max_ps(b, zero), max255), half));
+            _mm512_mask_storeu_epi32(color + i, valid,
+                                     _mm512_or_si512(_mm512_or_si512(_mm512_set1_epi32(int(0xFF000000)), _mm512_slli_epi32(ri, 16)),
+                                                     _mm512_or_si512(_mm512_slli_epi32(gi, 8), bi)));
+        }
+    }
+}
+
+KERNEL static void shadowAVX512(const ShadowSetup& s, const GBufferView& g, const float* depth, int width,
+                                int x0, int y0, int x1, int y1, float* visibility)
+{
+    const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.f), half = _mm512_set1_ps(0.5f);
+    const __m512 inf = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+    const __m512 minDist = _mm512_set1_ps(1e-6f);
+    const __m512 mapHalf = _mm512_set1_ps(0.5f * float(s.size));
+    const __m512 offset = _mm512_set1_ps(s.offset);
+    const __m512 taps = _mm512_set1_ps(1.f / float((2 * s.radius + 1) * (2 * s.radius + 1)));
+    const __m512i last = _mm512_set1_epi32(s.size - 1), izero = _mm512_setzero_si512();
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512 m[16];
+    for (int e = 0; e < 16; e++) {
+        m[e] = _mm512_set1_ps(s.viewProj[e]);
+    }
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x += 16) {
+            const int i = y * width + x;
+            const __mmask16 active = _mm512_cmpgt_epi32_mask(_mm512_set1_epi32(x1 - x), lane);
+            const __m512 z = _mm512_maskz_loadu_ps(active, depth + i);
+            const __mmask16 valid = _mm512_mask_cmp_ps_mask(_mm512_cmp_ps_mask(z, zero, _CMP_GT_OQ), z, inf, _CMP_LT_OQ);
+            if (!valid) {
+                continue;
+            }
+            __m512 nx = _mm512_maskz_loadu_ps(active, g.normal[0] + i);
+            __m512 ny = _mm512_maskz_loadu_ps(active, g.normal[1] + i);
+            __m512 nz = _mm512_maskz_loadu_ps(active, g.normal[2] + i);
+            const __m512 len = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(nx, nx), _mm512_mul_ps(ny, ny)),
+                                                            _mm512_mul_ps(nz, nz)));
+            const __m512 inv = _mm512_maskz_div_ps(_mm512_cmp_ps_mask(len, zero, _CMP_GT_OQ), one, len);
+            nx = _mm512_mul_ps(nx, inv);
+            ny = _mm512_mul_ps(ny, inv);
+            nz = _mm512_mul_ps(nz, inv);
+            __m512 px = _mm512_maskz_loadu_ps(active, g.position[0] + i);
+            __m512 py = _mm512_maskz_loadu_ps(active, g.position[1] + i);
+            __m512 pz = _mm512_maskz_loadu_ps(active, g.position[2] + i);
+            const __m512 lx = _mm512_sub_ps(_mm512_set1_ps(s.lightPos[0]), px);
+            const __m512 ly = _mm512_sub_ps(_mm512_set1_ps(s.lightPos[1]), py);
+            const __m512 lz = _mm512_sub_ps(_mm512_set1_ps(s.lightPos[2]), pz);
+            const __m512 d = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(lx, lx), _mm512_mul_ps(ly, ly)),
+                                                          _mm512_mul_ps(lz, lz)));
+            const __m512 invd = _mm512_div_ps(one, _mm512_max_ps(d, minDist));
+            const __m512 off = _mm512_mul_ps(d, offset);
+            px = _mm512_add_ps(px, _mm512_mul_ps(_mm512_add_ps(nx, _mm512_mul_ps(lx, invd)), off));
+            py = _mm512_add_ps(py, _mm512_mul_ps(_mm512_add_ps(ny, _mm512_mul_ps(ly, invd)), off));
+            pz = _mm512_add_ps(pz, _mm512_mul_ps(_mm512_add_ps(nz, _mm512_mul_ps(lz, invd)), off));
+
+            const __m512 cx = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(m[0], px), _mm512_mul_ps(m[4], py)),
+                                                          _mm512_mul_ps(m[8], pz)), m[12]);
+            const __m512 cy = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(m[1], px), _mm512_mul_ps(m[5], py)),
+                                                          _mm512_mul_ps(m[9], pz)), m[13]);
+            const __m512 cw = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(m[3], px), _mm512_mul_ps(m[7], py)),
+                                                          _mm512_mul_ps(m[11], pz)), m[15]);
+            __mmask16 inside = _mm512_mask_cmp_ps_mask(valid, cw, zero, _CMP_GT_OQ);
+            inside = _mm512_mask_cmp_ps_mask(inside, _mm512_abs_ps(cx), cw, _CMP_LE_OQ);
+            inside = _mm512_mask_cmp_ps_mask(inside, _mm512_abs_ps(cy), cw, _CMP_LE_OQ);
+            if (!inside) {
+                continue;
+            }
+            const __m512 invw = _mm512_div_ps(one, cw);
+            const __m512i tu = _mm512_cvttps_epi32(_mm512_floor_ps(
+                    _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(cx, invw), one), mapHalf), half)));
+            const __m512i tv = _mm512_cvttps_epi32(_mm512_floor_ps(
+                    _mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(one, _mm512_mul_ps(cy, invw)), mapHalf), half)));
+            __m512 lit = zero;
+            for (int dy = -s.radius; dy <= s.radius; dy++) {
+                const __m512i row = _mm512_mullo_epi32(
+                        _mm512_min_epi32(_mm512_max_epi32(_mm512_add_epi32(tv, _mm512_set1_epi32(dy)), izero), last),
+                        _mm512_set1_epi32(s.size));
+                for (int dx = -s.radius; dx <= s.radius; dx++) {
+                    const __m512i col = _mm512_min_epi32(_mm512_max_epi32(_mm512_add_epi32(tu, _mm512_set1_epi32(dx)), izero), last);
+                    const __m512 tap = _mm512_mask_i32gather_ps(zero, inside, _mm512_add_epi32(row, col), s.depth, 4);
+                    lit = _mm512_mask_add_ps(lit, _mm512_mask_cmp_ps_mask(inside, cw, tap, _CMP_LE_OQ), lit, one);
+                }
+            }
+            _mm512_mask_storeu_ps(visibility + i, inside, _mm512_mul_ps(lit, taps));
+        }
+    }
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+extern const RasterKernels g_kernelsAVX512 = {"avx512", transformAVX512, rasterSpanAVX512, depthSpanAVX512, SHADE_KERNELS(shadeAVX512), lightAVX512, shadowAVX512};
+
+#endif
@@ -0,0 +1,437 @@
+// SSE4.2 variants of the raster kernels, four lanes wide. Built with a target attribute rather
+// than a compiler flag, so the rest of the binary still runs on older CPUs.
+#include "kernels.h"
+
+#ifdef RASTERIZER_X86_KERNELS
+
+#include <immintrin.h>
+#include <algorithm>
+#include <limits>
+
+#define KERNEL __attribute__((target("sse4.2")))
+
+// (x, y, z, 0), without reading past the position's three floats
+KERNEL static inline __m128 loadPosition(const glm::vec3& p)
+{
+    return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(&p.x)), _mm_load_ss(&p.z));
+}
+
+KERNEL static void transformSSE42(const glm::vec3* positions, size_t n, const glm::mat4& view_proj, float width, float height,
+                                  glm::vec4* clip, glm::vec4* screen)
+{
+    const __m128 c0 = _mm_loadu_ps(&view_proj[0][0]);
+    const __m128 c1 = _mm_loadu_ps(&view_proj[1][0]);
+    const __m128 c2 = _mm_loadu_ps(&view_proj[2][0]);
+    const __m128 c3 = _mm_loadu_ps(&view_proj[3][0]);
+    // (x, y, z, w) -> (x + 1, 1 - y, z, 1) * (W/2, H/2, 1, 1)
+    const __m128 flip = _mm_setr_ps(1.f, -1.f, 1.f, 0.f);
+    const __m128 shift = _mm_setr_ps(1.f, 1.f, 0.f, 1.f);
+    const __m128 scale = _mm_setr_ps(width/2, height/2, 1.f, 1.f);
+    for (size_t i = 0; i < n; i++) {
+        const __m128 p = loadPosition(positions[i]);
+        const __m128 a0 = _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(p, p, 0x00)),
+                                     _mm_mul_ps(c1, _mm_shuffle_ps(p, p, 0x55)));
+        // w is 1, so its column is added as is
+        const __m128 a1 = _mm_add_ps(_mm_mul_ps(c2, _mm_shuffle_ps(p, p, 0xAA)), c3);
+        const __m128 c = _mm_add_ps(a0, a1);
+        const __m128 ndc = _mm_div_ps(c, _mm_shuffle_ps(c, c, 0xFF));
+        _mm_storeu_ps(&clip[i][0], c);
+        _mm_storeu_ps(&screen[i][0], _mm_mul_ps(_mm_add_ps(_mm_mul_ps(ndc, flip), shift), scale));
+    }
+}
+
+KERNEL static int rasterSpanSSE42(const SpanSetup& s, int y, int x0, int x1, float* zrow, int row_offset,
+                                  const FragmentArrays& out, int count)
+{
+    const float fy = float(y) - s.oy;
+    const __m128 base0 = _mm_set1_ps(s.c[0] + s.dy[0] * fy);
+    const __m128 base1 = _mm_set1_ps(s.c[1] + s.dy[1] * fy);
+    const __m128 base2 = _mm_set1_ps(s.c[2] + s.dy[2] * fy);
+    const __m128 dx0 = _mm_set1_ps(s.dx[0]), dx1 = _mm_set1_ps(s.dx[1]), dx2 = _mm_set1_ps(s.dx[2]);
+    const __m128 iz0 = _mm_set1_ps(s.invz[0]), iz1 = _mm_set1_ps(s.invz[1]), iz2 = _mm_set1_ps(s.invz[2]);
+    const __m128 ox = _mm_set1_ps(s.ox);
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128 one = _mm_set1_ps(1.f);
+
+    int x = x0;
+    for (; x + 4 <= x1; x += 4) {
+        const __m128 fx = _mm_sub_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x), lane)), ox);
+        const __m128 p0 = _mm_mul_ps(_mm_add_ps(base0, _mm_mul_ps(dx0, fx)), iz0);
+        const __m128 p1 = _mm_mul_ps(_mm_add_ps(base1, _mm_mul_ps(dx1, fx)), iz1);
+        const __m128 p2 = _mm_mul_ps(_mm_add_ps(base2, _mm_mul_ps(dx2, fx)), iz2);
+        const __m128 z = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(p0, p1), p2));
+        const __m128 zold = _mm_loadu_ps(zrow + x);
+        const __m128 pass = _mm_cmplt_ps(z, zold);
+        int mask = _mm_movemask_ps(pass);
+        if (!mask) {
+            continue;
+        }
+        _mm_storeu_ps(zrow + x, _mm_blendv_ps(zold, z, pass));
+
+        alignas(16) float w0[4], w1[4], w2[4];
+        _mm_store_ps(w0, _mm_mul_ps(p0, z));
+        _mm_store_ps(w1, _mm_mul_ps(p1, z));
+        _mm_store_ps(w2, _mm_mul_ps(p2, z));
+        for (; mask; mask &= mask - 1) {
+            const int i = __builtin_ctz(mask);
+            out.pixel[count] = row_offset + x + i;
+            out.w0[count] = w0[i];
+            out.w1[count] = w1[i];
+            out.w2[count] = w2[i];
+            count++;
+        }
+    }
+    // the last few pixels, one at a time with the same arithmetic
+    for (; x < x1; x++) {
+        const __m128 fx = _mm_set_ss(float(x) - s.ox);
+        const __m128 p0 = _mm_mul_ss(_mm_add_ss(base0, _mm_mul_ss(dx0, fx)), iz0);
+        const __m128 p1 = _mm_mul_ss(_mm_add_ss(base1, _mm_mul_ss(dx1, fx)), iz1);
+        const __m128 p2 = _mm_mul_ss(_mm_add_ss(base2, _mm_mul_ss(dx2, fx)), iz2);
+        const __m128 z = _mm_div_ss(one, _mm_add_ss(_mm_add_ss(p0, p1), p2));
+        const float zf = _mm_cvtss_f32(z);
+        if (zf < zrow[x]) {
+            zrow[x] = zf;
+            out.pixel[count] = row_offset + x;
+            out.w0[count] = _mm_cvtss_f32(_mm_mul_ss(p0, z));
+            out.w1[count] = _mm_cvtss_f32(_mm_mul_ss(p1, z));
+            out.w2[count] = _mm_cvtss_f32(_mm_mul_ss(p2, z));
+            count++;
+        }
+    }
+    return count;
+}
+
+KERNEL static int depthSpanSSE42(const SpanSetup& s, int y, int x0, int x1, float* zrow)
+{
+    const float fy = float(y) - s.oy;
+    const __m128 base0 = _mm_set1_ps(s.c[0] + s.dy[0] * fy);
+    const __m128 base1 = _mm_set1_ps(s.c[1] + s.dy[1] * fy);
+    const __m128 base2 = _mm_set1_ps(s.c[2] + s.dy[2] * fy);
+    const __m128 dx0 = _mm_set1_ps(s.dx[0]), dx1 = _mm_set1_ps(s.dx[1]), dx2 = _mm_set1_ps(s.dx[2]);
+    const __m128 iz0 = _mm_set1_ps(s.invz[0]), iz1 = _mm_set1_ps(s.invz[1]), iz2 = _mm_set1_ps(s.invz[2]);
+    const __m128 ox = _mm_set1_ps(s.ox);
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128 one = _mm_set1_ps(1.f);
+
+    int passed = 0;
+    int x = x0;
+    for (; x + 4 <= x1; x += 4) {
+        const __m128 fx = _mm_sub_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x), lane)), ox);
+        const __m128 p0 = _mm_mul_ps(_mm_add_ps(base0, _mm_mul_ps(dx0, fx)), iz0);
+        const __m128 p1 = _mm_mul_ps(_mm_add_ps(base1, _mm_mul_ps(dx1, fx)), iz1);
+        const __m128 p2 = _mm_mul_ps(_mm_add_ps(base2, _mm_mul_ps(dx2, fx)), iz2);
+        const __m128 z = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(p0, p1), p2));
+        const __m128 zold = _mm_loadu_ps(zrow + x);
+        const __m128 pass = _mm_cmplt_ps(z, zold);
+        _mm_storeu_ps(zrow + x, _mm_blendv_ps(zold, z, pass));
+        passed += __builtin_popcount(_mm_movemask_ps(pass));
+    }
+    for (; x < x1; x++) {
+        const __m128 fx = _mm_set_ss(float(x) - s.ox);
+        const __m128 p0 = _mm_mul_ss(_mm_add_ss(base0, _mm_mul_ss(dx0, fx)), iz0);
+        const __m128 p1 = _mm_mul_ss(_mm_add_ss(base1, _mm_mul_ss(dx1, fx)), iz1);
+        const __m128 p2 = _mm_mul_ss(_mm_add_ss(base2, _mm_mul_ss(dx2, fx)), iz2);
+        const float z = _mm_cvtss_f32(_mm_div_ss(one, _mm_add_ss(_mm_add_ss(p0, p1), p2)));
+        if (z < zrow[x]) {
+            zrow[x] = z;
+            passed++;
+        }
+    }
+    return passed;
+}
+
+// w0*c[0] + w1*c[1] + w2*c[2], in the scalar kernel's order
+KERNEL static inline __m128 interpolate(__m128 w0, __m128 w1, __m128 w2, const float* c)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(c[0])), _mm_mul_ps(w1, _mm_set1_ps(c[1]))),
+                      _mm_mul_ps(w2, _mm_set1_ps(c[2])));
+}
+
+template <unsigned F>
+KERNEL static void shadeSSE42(const ShadeSetup& s, const TextureView& tex, const NormalMapView& nor, const GBufferView& gbuf,
+                              const FragmentArrays& frags, int begin, int end, QRgb* color)
+{
+    const __m128 u0 = _mm_set1_ps(s.u[0]), u1 = _mm_set1_ps(s.u[1]), u2 = _mm_set1_ps(s.u[2]);
+    const __m128 v0 = _mm_set1_ps(s.v[0]), v1 = _mm_set1_ps(s.v[1]), v2 = _mm_set1_ps(s.v[2]);
+    const __m128 n0 = _mm_set1_ps(s.ndl[0]), n1 = _mm_set1_ps(s.ndl[1]), n2 = _mm_set1_ps(s.ndl[2]);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), half = _mm_set1_ps(0.5f);
+    const __m128 max255 = _mm_set1_ps(255.f);
+    const __m128 texW = _mm_set1_ps(float(tex.width)), texH = _mm_set1_ps(float(tex.height));
+    const __m128 texMaxX = _mm_set1_ps(tex.width - 1.f), texMaxY = _mm_set1_ps(tex.height - 1.f);
+    const __m128 t0 = _mm_set1_ps(s.tdl[0]), t1 = _mm_set1_ps(s.tdl[1]), t2 = _mm_set1_ps(s.tdl[2]);
+    const __m128 b0 = _mm_set1_ps(s.bdl[0]), b1 = _mm_set1_ps(s.bdl[1]), b2 = _mm_set1_ps(s.bdl[2]);
+    const __m128 norW = _mm_set1_ps(float(nor.width)), norH = _mm_set1_ps(float(nor.height));
+    const __m128 norMaxX = _mm_set1_ps(nor.width - 1.f), norMaxY = _mm_set1_ps(nor.height - 1.f);
+    const __m128 snorm = _mm_set1_ps(1.f / 127.f);
+
+    for (int k = begin; k < end; k += 4) {
+        const int n = std::min(4, end - k);
+        alignas(16) float w[3][4] = {};
+        for (int i = 0; i < n; i++) {
+            w[0][i] = frags.w0[k + i];
+            w[1][i] = frags.w1[k + i];
+            w[2][i] = frags.w2[k + i];
+        }
+        const __m128 w0 = _mm_load_ps(w[0]), w1 = _mm_load_ps(w[1]), w2 = _mm_load_ps(w[2]);
+        __m128 u = zero, v = zero;
+        if constexpr ((F & (SHADE_TEXTURE | SHADE_NORMAL_MAP)) != 0) {
+            u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, u0), _mm_mul_ps(w1, u1)), _mm_mul_ps(w2, u2));
+            v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, v0), _mm_mul_ps(w1, v1)), _mm_mul_ps(w2, v2));
+        }
+        __m128 nx = zero, ny = zero, nz = one;
+        if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+            alignas(16) int X[4], Y[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(X),
+                            _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(norW, u), norMaxX)));
+            _mm_store_si128(reinterpret_cast<__m128i*>(Y),
+                            _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(norH, _mm_sub_ps(one, v)), norMaxY)));
+            alignas(16) int texels[4];
+            for (int i = 0; i < 4; i++) {
+                texels[i] = (i < n && X[i] >= 0 && Y[i] >= 0) ? int(nor.texels[Y[i] * nor.width + X[i]]) : 0;
+            }
+            const __m128i t = _mm_load_si128(reinterpret_cast<const __m128i*>(texels));
+            nx = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(t, 24), 24)), snorm);
+            ny = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(t, 16), 24)), snorm);
+            nz = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(nx, nx)), _mm_mul_ps(ny, ny)), zero));
+        }
+        __m128 lambda = one;
+        if constexpr ((F & SHADE_GBUFFER) != 0) {
+            for (int a = 0; a < 3; a++) {
+                __m128 normal = interpolate(w0, w1, w2, s.n[a]);
+                if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+                    normal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, interpolate(w0, w1, w2, s.t[a])),
+                                                   _mm_mul_ps(ny, interpolate(w0, w1, w2, s.b[a]))),
+                                        _mm_mul_ps(nz, normal));
+                }
+                alignas(16) float out[2][4];
+                _mm_store_ps(out[0], normal);
+                _mm_store_ps(out[1], interpolate(w0, w1, w2, s.p[a]));
+                for (int i = 0; i < n; i++) {
+                    gbuf.normal[a][frags.pixel[k + i]] = out[0][i];
+                    gbuf.position[a][frags.pixel[k + i]] = out[1][i];
+                }
+            }
+        } else {
+            __m128 ndl = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, n0), _mm_mul_ps(w1, n1)), _mm_mul_ps(w2, n2));
+            if constexpr ((F & SHADE_NORMAL_MAP) != 0) {
+                const __m128 tdl = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, t0), _mm_mul_ps(w1, t1)), _mm_mul_ps(w2, t2));
+                const __m128 bdl = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, b0), _mm_mul_ps(w1, b1)), _mm_mul_ps(w2, b2));
+                ndl = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, tdl), _mm_mul_ps(ny, bdl)), _mm_mul_ps(nz, ndl));
+            }
+            lambda = _mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(ndl, zero), one), _mm_set1_ps(0.7f)),
+                                _mm_set1_ps(0.3f));
+        }
+
+        __m128 r = max255, g = max255, b = max255;
+        if constexpr ((F & SHADE_TEXTURE) != 0) {
+            alignas(16) int X[4], Y[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(X),
+                            _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(texW, u), texMaxX)));
+            _mm_store_si128(reinterpret_cast<__m128i*>(Y),
+                            _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(texH, _mm_sub_ps(one, v)), texMaxY)));
+            alignas(16) int texels[4];
+            for (int i = 0; i < 4; i++) {
+                texels[i] = (i < n && X[i] >= 0 && Y[i] >= 0) ? int(tex.bits[Y[i] * tex.stride + X[i]]) : 0;
+            }
+            const __m128i t = _mm_load_si128(reinterpret_cast<const __m128i*>(texels));
+            const __m128i byte = _mm_set1_epi32(0xFF);
+            r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(t, 16), byte));
+            g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(t, 8), byte));
+            b = _mm_cvtepi32_ps(_mm_and_si128(t, byte));
+        }
+        if constexpr ((F & SHADE_VERTEX_COLOR) != 0) {
+            r = _mm_mul_ps(r, interpolate(w0, w1, w2, s.rgb[0]));
+            g = _mm_mul_ps(g, interpolate(w0, w1, w2, s.rgb[1]));
+            b = _mm_mul_ps(b, interpolate(w0, w1, w2, s.rgb[2]));
+        }
+        const __m128i ri = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(_mm_mul_ps(r, lambda), zero), max255), half));
+        const __m128i gi = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(_mm_mul_ps(g, lambda), zero), max255), half));
+        const __m128i bi = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(_mm_mul_ps(b, lambda), zero), max255), half));
+        const __m128i packed = _mm_or_si128(_mm_or_si128(_mm_set1_epi32(int(0xFF000000)), _mm_slli_epi32(ri, 16)),
+                                            _mm_or_si128(_mm_slli_epi32(gi, 8), bi));
+        alignas(16) QRgb rgb[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(rgb), packed);
+        for (int i = 0; i < n; i++) {
+            color[frags.pixel[k + i]] = rgb[i];
+        }
+    }
+}
+
+// the first n of four floats, the rest zero, without touching memory past them
+KERNEL static inline __m128 loadPartial(const float* p, int n)
+{
+    if (n == 4) {
+        return _mm_loadu_ps(p);
+    }
+    alignas(16) float tmp[4] = {};
+    for (int i = 0; i < n; i++) {
+        tmp[i] = p[i];
+    }
+    return _mm_load_ps(tmp);
+}
+
+KERNEL static void lightSSE42(const LightSetup* lights, const int* indices, int count, float ambient, const GBufferView& g,
+                              const float* depth, int width, int x0, int y0, int x1, int y1, QRgb* color)
+{
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), half = _mm_set1_ps(0.5f);
+    const __m128 max255 = _mm_set1_ps(255.f);
+    const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 minDist = _mm_set1_ps(1e-6f);
+    const __m128i byte = _mm_set1_epi32(0xFF);
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x += 4) {
+            const int n = std::min(4, x1 - x);
+            const int i = y * width + x;
+            // lanes past x1 read a depth of 0, so they count as empty
+            const __m128 z = loadPartial(depth + i, n);
+            const int valid = _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(z, zero), _mm_cmplt_ps(z, inf)));
+            if (!valid) {
+                continue;
+            }
+            __m128 nx = loadPartial(g.normal[0] + i, n);
+            __m128 ny = loadPartial(g.normal[1] + i, n);
+            __m128 nz = loadPartial(g.normal[2] + i, n);
+            const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+            const __m128 inv = _mm_and_ps(_mm_cmpgt_ps(len, zero), _mm_div_ps(one, len));
+            nx = _mm_mul_ps(nx, inv);
+            ny = _mm_mul_ps(ny, inv);
+            nz = _mm_mul_ps(nz, inv);
+            const __m128 px = loadPartial(g.position[0] + i, n);
+            const __m128 py = loadPartial(g.position[1] + i, n);
+            const __m128 pz = loadPartial(g.position[2] + i, n);
+
+            __m128 r = _mm_set1_ps(ambient), gr = r, b = r;
+            for (int j = 0; j < count; j++) {
+                const LightSetup& l = lights[indices[j]];
+                __m128 lx = _mm_sub_ps(_mm_set1_ps(l.pos[0]), px);
+                __m128 ly = _mm_sub_ps(_mm_set1_ps(l.pos[1]), py);
+                __m128 lz = _mm_sub_ps(_mm_set1_ps(l.pos[2]), pz);
+                const __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz)));
+                const __m128 invd = _mm_div_ps(one, _mm_max_ps(d, minDist));
+                lx = _mm_mul_ps(lx, invd);
+                ly = _mm_mul_ps(ly, invd);
+                lz = _mm_mul_ps(lz, invd);
+                const __m128 ndl = _mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, lx), _mm_mul_ps(ny, ly)), _mm_mul_ps(nz, lz)), zero);
+                const __m128 fade = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(d, _mm_set1_ps(l.invRange))), zero);
+                const __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, _mm_set1_ps(l.axis[0])), _mm_mul_ps(ly, _mm_set1_ps(l.axis[1]))),
+                                                _mm_mul_ps(lz, _mm_set1_ps(l.axis[2])));
+                const __m128 cone = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(along, _mm_set1_ps(l.coneCos)), _mm_set1_ps(l.coneScale)),
+                                                          zero), one);
+                __m128 k = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(ndl, fade), fade), cone);
+                if (l.shadow) {
+                    k = _mm_mul_ps(k, loadPartial(l.shadow + i, n));
+                }
+                r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(l.color[0]), k));
+                gr = _mm_add_ps(gr, _mm_mul_ps(_mm_set1_ps(l.color[1]), k));
+                b = _mm_add_ps(b, _mm_mul_ps(_mm_set1_ps(l.color[2]), k));
+            }
+
+            alignas(16) QRgb rgb[4] = {};
+            for (int lane = 0; lane < n; lane++) {
+                rgb[lane] = color[i + lane];
+            }
+            const __m128i albedo = _mm_load_si128(reinterpret_cast<const __m128i*>(rgb));
+            r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(albedo, 16), byte)), r);
+            gr = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(albedo, 8), byte)), gr);
+            b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(albedo, byte)), b);
+            const __m128i ri = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(r, zero), max255), half));
+            const __m128i gi = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(gr, zero), max255), half));
+            const __m128i bi = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(b, zero), max255), half));
+            _mm_store_si128(reinterpret_cast<__m128i*>(rgb),
+                            _mm_or_si128(_mm_or_si128(_mm_set1_epi32(int(0xFF000000)), _mm_slli_epi32(ri, 16)),
+                                         _mm_or_si128(_mm_slli_epi32(gi, 8), bi)));
+            for (int lane = 0; lane < n; lane++) {
+                if (valid & (1 << lane)) {
+                    color[i + lane] = rgb[lane];
+                }
+            }
+        }
+    }
+}
+
+KERNEL static void shadowSSE42(const ShadowSetup& s, const GBufferView& g, const float* depth, int width,
+                               int x0, int y0, int x1, int y1, float* visibility)
+{
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), half = _mm_set1_ps(0.5f);
+    const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 minDist = _mm_set1_ps(1e-6f);
+    const __m128 sign = _mm_set1_ps(-0.f);
+    const __m128 mapHalf = _mm_set1_ps(0.5f * float(s.size));
+    const __m128 offset = _mm_set1_ps(s.offset);
+    const __m128 taps = _mm_set1_ps(1.f / float((2 * s.radius + 1) * (2 * s.radius + 1)));
+    const __m128i last = _mm_set1_epi32(s.size - 1), izero = _mm_setzero_si128();
+    __m128 m[16];
+    for (int e = 0; e < 16; e++) {
+        m[e] = _mm_set1_ps(s.viewProj[e]);
+    }
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x += 4) {
+            const int n = std::min(4, x1 - x);
+            const int i = y * width + x;
+            const __m128 z = loadPartial(depth + i, n);
+            const __m128 valid = _mm_and_ps(_mm_cmpgt_ps(z, zero), _mm_cmplt_ps(z, inf));
+            if (!_mm_movemask_ps(valid)) {
+                continue;
+            }
+            __m128 nx = loadPartial(g.normal[0] + i, n);
+            __m128 ny = loadPartial(g.normal[1] + i, n);
+            __m128 nz = loadPartial(g.normal[2] + i, n);
+            const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+            const __m128 inv = _mm_and_ps(_mm_cmpgt_ps(len, zero), _mm_div_ps(one, len));
+            nx = _mm_mul_ps(nx, inv);
+            ny = _mm_mul_ps(ny, inv);
+            nz = _mm_mul_ps(nz, inv);
+            __m128 px = loadPartial(g.position[0] + i, n);
+            __m128 py = loadPartial(g.position[1] + i, n);
+            __m128 pz = loadPartial(g.position[2] + i, n);
+            const __m128 lx = _mm_sub_ps(_mm_set1_ps(s.lightPos[0]), px);
+            const __m128 ly = _mm_sub_ps(_mm_set1_ps(s.lightPos[1]), py);
+            const __m128 lz = _mm_sub_ps(_mm_set1_ps(s.lightPos[2]), pz);
+            const __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz)));
+            const __m128 invd = _mm_div_ps(one, _mm_max_ps(d, minDist));
+            const __m128 off = _mm_mul_ps(d, offset);
+            px = _mm_add_ps(px, _mm_mul_ps(_mm_add_ps(nx, _mm_mul_ps(lx, invd)), off));
+            py = _mm_add_ps(py, _mm_mul_ps(_mm_add_ps(ny, _mm_mul_ps(ly, invd)), off));
+            pz = _mm_add_ps(pz, _mm_mul_ps(_mm_add_ps(nz, _mm_mul_ps(lz, invd)), off));
+
+            const __m128 cx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], px), _mm_mul_ps(m[4], py)), _mm_mul_ps(m[8], pz)), m[12]);
+            const __m128 cy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1], px), _mm_mul_ps(m[5], py)), _mm_mul_ps(m[9], pz)), m[13]);
+            const __m128 cw = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[3], px), _mm_mul_ps(m[7], py)), _mm_mul_ps(m[11], pz)), m[15]);
+            const int inside = _mm_movemask_ps(_mm_and_ps(_mm_and_ps(valid, _mm_cmpgt_ps(cw, zero)),
+                                                          _mm_and_ps(_mm_cmple_ps(_mm_andnot_ps(sign, cx), cw),
+                                                                     _mm_cmple_ps(_mm_andnot_ps(sign, cy), cw))));
+            if (!inside) {
+                continue;
+            }
+            const __m128 invw = _mm_div_ps(one, cw);
+            const __m128i tu = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(cx, invw), one), mapHalf), half)));
+            const __m128i tv = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(cy, invw)), mapHalf), half)));
+            // no gathers here: the clamped tap indices go through memory, one load per lane
+            __m128 lit = zero;
+            alignas(16) int idx[4];
+            for (int dy = -s.radius; dy <= s.radius; dy++) {
+                const __m128i row = _mm_mullo_epi32(_mm_min_epi32(_mm_max_epi32(_mm_add_epi32(tv, _mm_set1_epi32(dy)), izero), last),
+                                                    _mm_set1_epi32(s.size));
+                for (int dx = -s.radius; dx <= s.radius; dx++) {
+                    const __m128i col = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(tu, _mm_set1_epi32(dx)), izero), last);
+                    _mm_store_si128(reinterpret_cast<__m128i*>(idx), _mm_add_epi32(row, col));
+                    const __m128 tap = _mm_setr_ps(s.depth[idx[0]], s.depth[idx[1]], s.depth[idx[2]], s.depth[idx[3]]);
+                    lit = _mm_add_ps(lit, _mm_and_ps(_mm_cmple_ps(cw, tap), one));
+                }
+            }
+            alignas(16) float vis[4];
+            _mm_store_ps(vis, _mm_mul_ps(lit, taps));
+            for (int lane = 0; lane < n; lane++) {
+                if (inside & (1 << lane)) {
+                    visibility[i + lane] = vis[lane];
+                }
+            }
+        }
+    }
+}
+
+extern const RasterKernels g_kernelsSSE42 = {"sse4.2", transformSSE42, rasterSpanSSE42, depthSpanSSE42, SHADE_KERNELS(shadeSSE42), lightSSE42, shadowSSE42};
+
+#endif
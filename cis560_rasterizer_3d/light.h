@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// A point or spot light of the scene, in world space. Scenes without any are lit by a
+// headlight that follows the camera instead
+struct Light
+{
+    enum class Type { Point, Spot };
+
+    Type type = Type::Point;
+    glm::vec3 position = glm::vec3(0.f);
+    glm::vec3 color = glm::vec3(1.f);  // already scaled by the intensity, so it can go above 1
+    float range = 10.f;  // the light fades out with distance and reaches nothing past this
+    bool castsShadows = false;  // see Rasterizer::m_shadowFilter
+
+    // spot lights only
+    glm::vec3 direction = glm::vec3(0.f, 0.f, -1.f);  // normalized
+    float innerAngle = 20.f;  // degrees off the axis still fully lit
+    float outerAngle = 30.f;  // degrees off the axis where the light ends
+};
@@ -1,6 +1,5 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
-#include <QPixmap>
 #include <QFileDialog>
 #include <QTextStream>
 #include <QJsonObject>
@@ -10,13 +9,12 @@
 #include <QApplication>
 #include <QKeyEvent>
 #include <QImageWriter>
+#include <QActionGroup>
 #include <QDebug>
-#include <tiny_obj_loader.h>
 
 #include "camera.h"
 #include "constants.h"
 #include "debug.h"
-#include <chrono>
 
 
 void MainWindow::keyPressEvent(QKeyEvent *e)
@@ -28,39 +26,87 @@ void MainWindow::keyPressEvent(QKeyEvent *e)
     case Qt::Key_Escape : on_actionQuit_Esc_triggered();  break;
 
     // translate
-    case Qt::Key_W:  rasterizer.m_camera.translateZ(+TRANSLATE_STEP); break;
-    case Qt::Key_S:  rasterizer.m_camera.translateZ(-TRANSLATE_STEP); break;
-    case Qt::Key_A:  rasterizer.m_camera.translateX(-TRANSLATE_STEP); break;
-    case Qt::Key_D:  rasterizer.m_camera.translateX(+TRANSLATE_STEP); break;
-    case Qt::Key_Q:  rasterizer.m_camera.translateY(-TRANSLATE_STEP); break;
-    case Qt::Key_E:  rasterizer.m_camera.translateY(+TRANSLATE_STEP); break;
+    case Qt::Key_W:  camera.translateZ(+TRANSLATE_STEP); break;
+    case Qt::Key_S:  camera.translateZ(-TRANSLATE_STEP); break;
+    case Qt::Key_A:  camera.translateX(-TRANSLATE_STEP); break;
+    case Qt::Key_D:  camera.translateX(+TRANSLATE_STEP); break;
+    case Qt::Key_Q:  camera.translateY(-TRANSLATE_STEP); break;
+    case Qt::Key_E:  camera.translateY(+TRANSLATE_STEP); break;
 
     // rotate
-    case Qt::Key_Up:    rasterizer.m_camera.rotateX(-ROTATE_STEP); break;
-    case Qt::Key_Down:  rasterizer.m_camera.rotateX(+ROTATE_STEP); break;
-    case Qt::Key_Left:  rasterizer.m_camera.rotateY(+ROTATE_STEP); break;
-    case Qt::Key_Right: rasterizer.m_camera.rotateY(-ROTATE_STEP); break;
-    case Qt::Key_Z:     rasterizer.m_camera.rotateZ(+ROTATE_STEP); break;
-    case Qt::Key_X:     rasterizer.m_camera.rotateZ(-ROTATE_STEP); break;
+    case Qt::Key_Up:    camera.rotateX(-ROTATE_STEP); break;
+    case Qt::Key_Down:  camera.rotateX(+ROTATE_STEP); break;
+    case Qt::Key_Left:  camera.rotateY(+ROTATE_STEP); break;
+    case Qt::Key_Right: camera.rotateY(-ROTATE_STEP); break;
+    case Qt::Key_Z:     camera.rotateZ(+ROTATE_STEP); break;
+    case Qt::Key_X:     camera.rotateZ(-ROTATE_STEP); break;
+
+    // print the render statistics of every frame
+    case Qt::Key_P:  print_stats = !print_stats; break;
     }
 
-    auto start = std::chrono::high_resolution_clock::now();
-    rendered_image = rasterizer.RenderScene();
-    DisplayQImage(rendered_image);
-    auto end = std::chrono::high_resolution_clock::now();
+    // returns right away. with auto-repeat, a burst of keys ends up as one frame of the last camera
+    render_thread.SetCamera(camera);
+}
 
-    std::chrono::duration<double, std::milli> duration = end - start;
-    LOG(duration.count());
+void MainWindow::onFrameReady()
+{
+    if(!render_thread.AcquireFrame())
+    {
+        return;  // an earlier signal already picked this frame up
+    }
+    const RenderedFrame& frame = render_thread.Frame();
+    frame_item->SetImage(&frame.image, frame.displaySize);
+    graphics_scene.setSceneRect(frame_item->boundingRect());
+
+    LOG(frame.stats.TotalMs());
+    if(print_stats)
+    {
+        frame.stats.Print(std::cout);
+    }
 }
 
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow),
-    rasterizer(std::vector<Polygon>())
+    ui(new Ui::MainWindow)
 {
     ui->setupUi(this);
     setFocusPolicy(Qt::StrongFocus);
+
+    load_progress = new QProgressBar(this);
+    load_progress->setMaximumWidth(200);
+    load_progress->setVisible(false);
+    ui->statusBar->addPermanentWidget(load_progress);
+
+    connect(&scene_loader, &SceneLoader::lightsLoaded, &render_thread, &RenderThread::SetLights);
+    connect(&scene_loader, &SceneLoader::sceneGraphLoaded, &render_thread, &RenderThread::SetSceneGraph);
+    connect(&scene_loader, &SceneLoader::objectLoaded, this, &MainWindow::onSceneObjectLoaded);
+    connect(&scene_loader, &SceneLoader::progress, this, &MainWindow::onSceneLoadProgress);
+    connect(&scene_loader, &SceneLoader::finished, this, &MainWindow::onSceneLoadFinished);
+    connect(&render_thread, &RenderThread::frameReady, this, &MainWindow::onFrameReady);
+
+    // the scene owns the item
+    frame_item = new FrameItem();
+    graphics_scene.addItem(frame_item);
+    ui->scene_display->setScene(&graphics_scene);
+
+    // the render modes are mutually exclusive
+    QActionGroup* render_modes = new QActionGroup(this);
+    const std::pair<QAction*, RenderMode> modes[] = {
+        {ui->actionShaded, RenderMode::Shaded},
+        {ui->actionOverdraw, RenderMode::Overdraw},
+        {ui->actionShaded_Count, RenderMode::ShadedCount},
+        {ui->actionTile_Time, RenderMode::TileTime},
+    };
+    for(const auto& m : modes)
+    {
+        m.first->setData(int(m.second));
+        render_modes->addAction(m.first);
+    }
+    connect(render_modes, &QActionGroup::triggered, this, &MainWindow::onRenderModeTriggered);
+
+    render_thread.SetResolution(QSize(int(SCREEN_WIDTH), int(SCREEN_HEIGHT)));
 }
 
 MainWindow::~MainWindow()
@@ -68,157 +114,80 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
-void MainWindow::DisplayQImage(QImage &i)
-{
-    QPixmap pixmap(QPixmap::fromImage(i));
-    graphics_scene.addPixmap(pixmap);
-    graphics_scene.setSceneRect(pixmap.rect());
-    ui->scene_display->setScene(&graphics_scene);
-}
-
 void MainWindow::on_actionLoad_Scene_triggered()
 {
-    std::vector<Polygon> polygons;
-
     QString filename = QFileDialog::getOpenFileName(0, QString("Load Scene File"), QDir::currentPath().append(QString("../..")), QString("*.json"));
-    int i = filename.length() - 1;
-    while(QString::compare(filename.at(i), QChar('/')) != 0)
+    if(filename.isEmpty())
     {
-        i--;
-    }
-    QString local_path = filename.left(i+1);
-
-    QFile file(filename);
-    if(!file.open(QIODevice::ReadOnly)){
-        qWarning("Could not open the JSON file.");
         return;
     }
-    QByteArray file_data = file.readAll();
-
-    QJsonDocument jdoc(QJsonDocument::fromJson(file_data));
-    //Read the mesh data in the file
-    QJsonArray objects = jdoc.object()["objects"].toArray();
-    for(int i = 0; i < objects.size(); i++)
-    {
-        std::vector<glm::vec4> vert_pos;
-        std::vector<glm::vec3> vert_col;
-        QJsonObject obj = objects[i].toObject();
-        QString type = obj["type"].toString();
-        // Custom Polygon case
-        if(QString::compare(type, QString("custom")) == 0)
-        {
-            QString name = obj["name"].toString();
-            QJsonArray pos = obj["vertexPos"].toArray();
-            for(int j = 0; j < pos.size(); j++)
-            {
-                QJsonArray arr = pos[j].toArray();
-                glm::vec4 p(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble(), 1);
-                vert_pos.push_back(p);
-            }
-            QJsonArray col = obj["vertexCol"].toArray();
-            for(int j = 0; j < col.size(); j++)
-            {
-                QJsonArray arr = col[j].toArray();
-                glm::vec3 c(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble());
-                vert_col.push_back(c);
-            }
-            Polygon p(name, vert_pos, vert_col);
-            polygons.push_back(p);
-        }
-        // Regular Polygon case
-        else if(QString::compare(type, QString("regular")) == 0)
-        {
-            QString name = obj["name"].toString();
-            int sides = obj["sides"].toInt();
-            QJsonArray colorA = obj["color"].toArray();
-            glm::vec3 color(colorA[0].toDouble(), colorA[1].toDouble(), colorA[2].toDouble());
-            QJsonArray posA = obj["pos"].toArray();
-            glm::vec4 pos(posA[0].toDouble(), posA[1].toDouble(), posA[2].toDouble(),1);
-            float rot = obj["rot"].toDouble();
-            QJsonArray scaleA = obj["scale"].toArray();
-            glm::vec4 scale(scaleA[0].toDouble(), scaleA[1].toDouble(), scaleA[2].toDouble(),1);
-            Polygon p(name, sides, color, pos, rot, scale);
-            polygons.push_back(p);
-        }
-        // OBJ file case
-        else if(QString::compare(type, QString("obj")) == 0)
-        {
-            QString name = obj["name"].toString();
-            QString filename = local_path;
-            filename.append(obj["filename"].toString());
-            Polygon p = LoadOBJ(filename, name);
-            QString texPath = local_path;
-            texPath.append(obj["texture"].toString());
-            p.SetTexture(new QImage(texPath));
-            if(obj.contains(QString("normalMap")))
-            {
-                p.SetNormalMap(new QImage(local_path.append(obj["normalMap"].toString())));
-            }
-            polygons.push_back(p);
-        }
-    }
 
-    rasterizer = Rasterizer(polygons);
+    // start from an empty scene and a fresh camera. objects show up as they finish loading
+    camera = Camera();
+    render_thread.SetScene(std::make_shared<std::vector<Polygon>>());
+    render_thread.SetLights({});
+    render_thread.SetSceneGraph(SceneGraph());
+    render_thread.SetCamera(camera);
+
+    load_progress->setValue(0);
+    load_progress->setVisible(true);
+    ui->statusBar->showMessage(QString("Loading %1").arg(filename));
+    scene_loader.Load(filename);
+}
 
-    rendered_image = rasterizer.RenderScene();
-    DisplayQImage(rendered_image);
+void MainWindow::onSceneObjectLoaded(std::shared_ptr<Polygon> polygon)
+{
+    render_thread.AddPolygon(std::move(polygon));
 }
 
+void MainWindow::onSceneLoadProgress(int done, int total)
+{
+    load_progress->setMaximum(total);
+    load_progress->setValue(done);
+}
 
-Polygon MainWindow::LoadOBJ(const QString &file, const QString &polyName)
+void MainWindow::onSceneLoadFinished(QString errors)
 {
-    Polygon p(polyName);
-    QString filepath = file;
-    std::vector<tinyobj::shape_t> shapes; std::vector<tinyobj::material_t> materials;
-    std::string errors = tinyobj::LoadObj(shapes, materials, filepath.toStdString().c_str());
-    std::cout << errors << std::endl;
-    if(errors.size() == 0)
+    load_progress->setVisible(false);
+    if(errors.isEmpty())
     {
-        int min_idx = 0;
-        //Read the information from the vector of shape_ts
-        for(unsigned int i = 0; i < shapes.size(); i++)
-        {
-            std::vector<glm::vec4> pos, nor;
-            std::vector<glm::vec2> uv;
-            std::vector<float> &positions = shapes[i].mesh.positions;
-            std::vector<float> &normals = shapes[i].mesh.normals;
-            std::vector<float> &uvs = shapes[i].mesh.texcoords;
-            for(unsigned int j = 0; j < positions.size()/3; j++)
-            {
-                pos.push_back(glm::vec4(positions[j*3], positions[j*3+1], positions[j*3+2],1));
-            }
-            for(unsigned int j = 0; j < normals.size()/3; j++)
-            {
-                nor.push_back(glm::vec4(normals[j*3], normals[j*3+1], normals[j*3+2],0));
-            }
-            for(unsigned int j = 0; j < uvs.size()/2; j++)
-            {
-                uv.push_back(glm::vec2(uvs[j*2], uvs[j*2+1]));
-            }
-            for(unsigned int j = 0; j < pos.size(); j++)
-            {
-                p.AddVertex(Vertex(pos[j], glm::vec3(255,255,255), nor[j], uv[j]));
-            }
-
-            std::vector<unsigned int> indices = shapes[i].mesh.indices;
-            for(unsigned int j = 0; j < indices.size(); j += 3)
-            {
-                Triangle t;
-                t.m_indices[0] = indices[j] + min_idx;
-                t.m_indices[1] = indices[j+1] + min_idx;
-                t.m_indices[2] = indices[j+2] + min_idx;
-                p.AddTriangle(t);
-            }
-
-            min_idx += pos.size();
-        }
+        ui->statusBar->clearMessage();
     }
     else
     {
-        //An error loading the OBJ occurred!
-        std::cout << errors << std::endl;
+        std::cout << errors.toStdString() << std::endl;
+        ui->statusBar->showMessage(QString("Scene loaded with errors"));
     }
-    return p;
+}
+
+
+void MainWindow::onRenderModeTriggered(QAction* action)
+{
+    render_thread.SetRenderMode(RenderMode(action->data().toInt()));
+}
+
+
+void MainWindow::on_actionDynamic_Resolution_toggled(bool checked)
+{
+    render_thread.SetDynamicResolution(checked);
+}
+
+
+void MainWindow::on_actionTemporal_Reprojection_toggled(bool checked)
+{
+    render_thread.SetTemporalReprojection(checked);
+}
+
+
+void MainWindow::on_actionProgressive_Refinement_toggled(bool checked)
+{
+    render_thread.SetProgressiveRefinement(checked);
+}
+
+
+void MainWindow::on_actionIdle_Accumulation_toggled(bool checked)
+{
+    render_thread.SetIdleAccumulation(checked);
 }
 
 
@@ -232,7 +201,7 @@ void MainWindow::on_actionSave_Image_triggered()
     }
     QImageWriter writer(filename);
     writer.setFormat("bmp");
-    if(!writer.write(rendered_image))
+    if(!writer.write(render_thread.Frame().image))
     {
         qDebug() << writer.errorString();
     }
@@ -261,12 +230,14 @@ void MainWindow::on_actionEquilateral_Triangle_triggered()
     }
 
     p.AddTriangle(t);
-    std::vector<Polygon> vec; vec.push_back(p);
-
-    rasterizer = Rasterizer(vec);
-
-    rendered_image = rasterizer.RenderScene();
-    DisplayQImage(rendered_image);
+    auto vec = std::make_shared<std::vector<Polygon>>(); vec->push_back(p);
+
+    scene_loader.Cancel();
+    camera = Camera();
+    render_thread.SetScene(vec);
+    render_thread.SetLights({});
+    render_thread.SetSceneGraph(SceneGraph());
+    render_thread.SetCamera(camera);
 }
 
 void MainWindow::on_actionQuit_Esc_triggered()
@@ -4,8 +4,13 @@
 #include <QMainWindow>
 #include <QImage>
 #include <QGraphicsScene>
+#include <QProgressBar>
+#include <memory>
 #include <polygon.h>
 #include <rasterizer.h>
+#include "frameitem.h"
+#include "renderthread.h"
+#include "sceneloader.h"
 
 namespace Ui {
 class MainWindow;
@@ -19,8 +24,6 @@ public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
-    void DisplayQImage(QImage &i);
-
     void keyPressEvent(QKeyEvent *e);
 
 private slots:
@@ -32,18 +35,38 @@ private slots:
 
     void on_actionQuit_Esc_triggered();
 
+    void onSceneObjectLoaded(std::shared_ptr<Polygon> polygon);
+    void onSceneLoadProgress(int done, int total);
+    void onSceneLoadFinished(QString errors);
+
+    void onRenderModeTriggered(QAction* action);
+    void on_actionDynamic_Resolution_toggled(bool checked);
+    void on_actionTemporal_Reprojection_toggled(bool checked);
+    void on_actionProgressive_Refinement_toggled(bool checked);
+    void on_actionIdle_Accumulation_toggled(bool checked);
+
+    void onFrameReady();
+
 private:
     Ui::MainWindow *ui;
-    Polygon LoadOBJ(const QString &file, const QString &polyName);
 
-    //This is used to display the QImage produced by RenderScene in the GUI
+    //This is used to display the images produced by RenderScene in the GUI.
+    //It holds a single item that paints the render thread's latest frame in place
     QGraphicsScene graphics_scene;
+    FrameItem* frame_item;
+
+    //The camera the key bindings move. Every change is sent to the render thread
+    Camera camera;
+
+    //Builds scene objects on worker threads and hands them over as they finish
+    SceneLoader scene_loader;
+    QProgressBar* load_progress;
 
-    //This is the image rendered by your program when it loads a scene
-    QImage rendered_image;
+    //Toggled with P: print the rasterizer's statistics after every frame
+    bool print_stats = false;
 
-    //The instance of the Rasterizer used to render our scene
-    Rasterizer rasterizer;
+    //Renders our scene off the GUI thread. Declared last so it stops before anything it reports to is gone
+    RenderThread render_thread;
 
 };
 
@@ -0,0 +1,110 @@
+#include "memorystats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+
+MemoryBytes& MemoryBytes::operator+=(const MemoryBytes& other)
+{
+    for(int i = 0; i < MEMORY_CATEGORIES; i++)
+    {
+        bytes[i] += other.bytes[i];
+    }
+    return *this;
+}
+
+size_t MemoryBytes::Total() const
+{
+    return std::accumulate(bytes.begin(), bytes.end(), size_t(0));
+}
+
+static const char* const CATEGORY_NAMES[MEMORY_CATEGORIES] = {"vertices", "indices", "textures", "framebuffers", "scratch"};
+
+static double kilobytes(size_t bytes)
+{
+    return bytes / 1024.0;
+}
+
+static void printBytes(std::ostream& out, const MemoryBytes& b)
+{
+    out << kilobytes(b.Total()) << " KB (";
+    for(int i = 0; i < MEMORY_CATEGORIES; i++)
+    {
+        out << (i ? ", " : "") << CATEGORY_NAMES[i] << " " << kilobytes(b.bytes[i]);
+    }
+    out << ")";
+}
+
+void MemoryStats::Print(std::ostream& out, size_t maxObjects) const
+{
+    const std::ios_base::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1);
+    out << "memory: scene ";
+    printBytes(out, scene);
+    out << "\nmemory: context ";
+    printBytes(out, context);
+    out << "\n";
+
+    std::vector<const Object*> largest;
+    for(const Object& o : objects)
+    {
+        largest.push_back(&o);
+    }
+    std::stable_sort(largest.begin(), largest.end(), [](const Object* a, const Object* b)
+    {
+        return a->bytes.Total() > b->bytes.Total();
+    });
+    for(size_t i = 0; i < std::min(maxObjects, largest.size()); i++)
+    {
+        out << "  " << largest[i]->name << " ";
+        printBytes(out, largest[i]->bytes);
+        out << "\n";
+    }
+    if(largest.size() > maxObjects)
+    {
+        out << "  and " << largest.size() - maxObjects << " more objects\n";
+    }
+    out.flush();
+    out.flags(flags);
+    out.precision(precision);
+}
+
+// the calling thread's operator new calls and bytes. plain integers, so they need no
+// initialization and can be counted from any allocation, even the ones while threads start
+static thread_local unsigned long long t_allocations = 0;
+static thread_local unsigned long long t_allocatedBytes = 0;
+// set by the first allocation counted, on any thread. only read before it's written, so the
+// allocations after that don't all write to the one cache line
+static std::atomic<bool> s_counting(false);
+
+void CountAllocation(size_t bytes)
+{
+    t_allocations++;
+    t_allocatedBytes += bytes;
+    if(!s_counting.load(std::memory_order_relaxed))
+    {
+        s_counting.store(true, std::memory_order_relaxed);
+    }
+}
+
+AllocationScope::AllocationScope()
+    : m_count(t_allocations), m_bytes(t_allocatedBytes)
+{}
+
+unsigned long long AllocationScope::Count() const
+{
+    return t_allocations - m_count;
+}
+
+unsigned long long AllocationScope::Bytes() const
+{
+    return t_allocatedBytes - m_bytes;
+}
+
+bool AllocationScope::Counting()
+{
+    return s_counting.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// what the bytes a scene or a Rasterizer holds are for
+enum class MemoryCategory {
+    Vertices,      // the polygons' vertex streams
+    Indices,       // their triangles
+    Textures,      // textures and normal maps
+    Framebuffers,  // depth buffers, the temporal history and the shadow maps
+    Scratch,       // the frame arena and the other per-frame working space
+};
+static constexpr int MEMORY_CATEGORIES = 5;
+
+// bytes per MemoryCategory. capacities rather than sizes, since that's what is held
+struct MemoryBytes
+{
+    std::array<size_t, MEMORY_CATEGORIES> bytes = {};
+
+    size_t& operator[](MemoryCategory c) { return bytes[size_t(c)]; }
+    size_t operator[](MemoryCategory c) const { return bytes[size_t(c)]; }
+    MemoryBytes& operator+=(const MemoryBytes& other);
+    size_t Total() const;
+};
+
+// the bytes a vector holds on to, whether in use or not
+template <typename T>
+size_t CapacityBytes(const std::vector<T>& v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+// Where a Rasterizer's memory goes, see Rasterizer::Memory. The scene is shared by every
+// rasterizer drawing it, so it's kept apart from what each one holds on its own: a process
+// running n render contexts over one scene needs scene + n * context bytes
+struct MemoryStats
+{
+    struct Object
+    {
+        std::string name;
+        MemoryBytes bytes;
+    };
+    std::vector<Object> objects;  // per polygon of the scene, in its order
+    MemoryBytes scene;            // the sum of the objects
+    MemoryBytes context;          // the rasterizer's own buffers, its shadow map renderer's included
+
+    // the totals per category, then the objects from the largest down, at most maxObjects of them
+    void Print(std::ostream& out, size_t maxObjects = 20) const;
+};
+
+// Counts the heap allocations, through operator new, that the calling thread makes while it
+// lives. Every thread counts on its own, so render contexts side by side don't see each other's.
+// Only programs linking allocationcounter.cpp count anything, elsewhere this always reads 0
+class AllocationScope
+{
+public:
+    AllocationScope();
+    unsigned long long Count() const;  // so far
+    unsigned long long Bytes() const;
+
+    // whether this program counts allocations at all: true from the first one counted on
+    static bool Counting();
+
+private:
+    unsigned long long m_count;
+    unsigned long long m_bytes;
+};
+
+// adds an allocation of the calling thread to what its AllocationScopes see
+void CountAllocation(size_t bytes);
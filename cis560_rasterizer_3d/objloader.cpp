@@ -0,0 +1,365 @@
+#include "objloader.h"
+
+#include <QFile>
+#include <QByteArray>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// below this much text per thread, spawning another thread costs more than it saves
+constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+// one triangle corner as 0-based indices into the file-wide v/vt/vn arrays. -1 if absent
+struct Corner {
+    int32_t v, t, n;
+};
+
+// a line-aligned slice of the file. each chunk is counted, then parsed, by one thread
+struct Chunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    // filled by the counting pass
+    size_t numPos = 0, numUV = 0, numNor = 0, numCorners = 0;
+    // prefix sums of the counts over all earlier chunks, so each chunk writes its own slots
+    size_t posOffset = 0, uvOffset = 0, norOffset = 0, cornerOffset = 0;
+
+    std::string error;  // empty if the chunk parsed cleanly
+};
+
+template <typename F>
+void parallelFor(size_t n, const F& fn) {
+    std::vector<std::thread> workers;
+    workers.reserve(n > 0 ? n - 1 : 0);
+    for (size_t i = 1; i < n; i++) {
+        workers.emplace_back(fn, i);
+    }
+    if (n > 0) fn(0);
+    for (std::thread& w : workers) {
+        w.join();
+    }
+}
+
+inline const char* skipSpaces(const char* s, const char* end) {
+    while (s < end && (*s == ' ' || *s == '\t')) s++;
+    return s;
+}
+
+inline const char* skipToken(const char* s, const char* end) {
+    while (s < end && *s != ' ' && *s != '\t' && *s != '\r') s++;
+    return s;
+}
+
+inline const char* findLineEnd(const char* s, const char* end) {
+    const void* nl = std::memchr(s, '\n', end - s);
+    return nl ? static_cast<const char*>(nl) : end;
+}
+
+enum class LineKind { Other, Position, UV, Normal, Face };
+
+// classifies the line starting at s, and advances s past the keyword
+inline LineKind classifyLine(const char*& s, const char* end) {
+    s = skipSpaces(s, end);
+    if (end - s < 2) return LineKind::Other;
+    const char c0 = s[0], c1 = s[1];
+    if (c0 == 'v') {
+        if (c1 == ' ' || c1 == '\t') { s += 1; return LineKind::Position; }
+        if (end - s >= 3 && (s[2] == ' ' || s[2] == '\t')) {
+            if (c1 == 't') { s += 2; return LineKind::UV; }
+            if (c1 == 'n') { s += 2; return LineKind::Normal; }
+        }
+    } else if (c0 == 'f' && (c1 == ' ' || c1 == '\t')) {
+        s += 1;
+        return LineKind::Face;
+    }
+    return LineKind::Other;
+}
+
+// number of whitespace separated corners on a face line (s is just past the 'f')
+inline size_t countFaceCorners(const char* s, const char* end) {
+    size_t n = 0;
+    for (s = skipSpaces(s, end); s < end && *s != '\r'; s = skipSpaces(s, end)) {
+        s = skipToken(s, end);
+        n++;
+    }
+    return n;
+}
+
+inline const char* parseFloat(const char* s, const char* end, float* out) {
+    s = skipSpaces(s, end);
+    if (s < end && *s == '+') s++;  // from_chars doesn't accept an explicit plus sign
+    const std::from_chars_result r = std::from_chars(s, end, *out);
+    return r.ec == std::errc() ? r.ptr : nullptr;
+}
+
+// OBJ indices are 1-based, or negative to count back from the last element declared so far
+inline const char* parseIndex(const char* s, const char* end, size_t declared, int32_t* out) {
+    long idx = 0;
+    const std::from_chars_result r = std::from_chars(s, end, idx);
+    if (r.ec != std::errc() || idx == 0) return nullptr;
+    *out = static_cast<int32_t>(idx > 0 ? idx - 1 : static_cast<long>(declared) + idx);
+    return r.ptr;
+}
+
+// parses one "v", "v/vt", "v//vn" or "v/vt/vn" token
+inline const char* parseCorner(const char* s, const char* end, const Chunk& c,
+                               size_t pos, size_t uv, size_t nor, Corner* out) {
+    out->t = -1;
+    out->n = -1;
+    s = parseIndex(s, end, c.posOffset + pos, &out->v);
+    if (!s) return nullptr;
+    if (s < end && *s == '/') {
+        s++;
+        if (s < end && *s != '/') {
+            s = parseIndex(s, end, c.uvOffset + uv, &out->t);
+            if (!s) return nullptr;
+        }
+        if (s < end && *s == '/') {
+            s = parseIndex(s + 1, end, c.norOffset + nor, &out->n);
+            if (!s) return nullptr;
+        }
+    }
+    return s;
+}
+
+void countChunk(Chunk& c) {
+    for (const char* line = c.begin; line < c.end;) {
+        const char* lineEnd = findLineEnd(line, c.end);
+        const char* s = line;
+        switch (classifyLine(s, lineEnd)) {
+        case LineKind::Position: c.numPos++; break;
+        case LineKind::UV:       c.numUV++;  break;
+        case LineKind::Normal:   c.numNor++; break;
+        case LineKind::Face: {
+            const size_t corners = countFaceCorners(s, lineEnd);
+            if (corners >= 3) c.numCorners += 3 * (corners - 2);  // fan triangulation
+            break;
+        }
+        case LineKind::Other: break;
+        }
+        line = lineEnd + 1;
+    }
+}
+
+void parseChunk(Chunk& c, float* positions, float* uvs, float* normals, Corner* corners) {
+    size_t pos = 0, uv = 0, nor = 0, corner = 0;
+    for (const char* line = c.begin; line < c.end && c.error.empty();) {
+        const char* lineEnd = findLineEnd(line, c.end);
+        const char* s = line;
+        switch (classifyLine(s, lineEnd)) {
+        case LineKind::Position: {
+            float* out = positions + 3 * (c.posOffset + pos++);
+            if (!(s = parseFloat(s, lineEnd, &out[0])) ||
+                !(s = parseFloat(s, lineEnd, &out[1])) ||
+                !(s = parseFloat(s, lineEnd, &out[2]))) {
+                c.error = "malformed vertex position: " + std::string(line, lineEnd);
+            }
+            break;
+        }
+        case LineKind::UV: {
+            float* out = uvs + 2 * (c.uvOffset + uv++);
+            if (!(s = parseFloat(s, lineEnd, &out[0]))) {
+                c.error = "malformed texture coordinate: " + std::string(line, lineEnd);
+            } else if (!parseFloat(s, lineEnd, &out[1])) {
+                out[1] = 0.f;  // 1D texture coordinate
+            }
+            break;
+        }
+        case LineKind::Normal: {
+            float* out = normals + 3 * (c.norOffset + nor++);
+            if (!(s = parseFloat(s, lineEnd, &out[0])) ||
+                !(s = parseFloat(s, lineEnd, &out[1])) ||
+                !(s = parseFloat(s, lineEnd, &out[2]))) {
+                c.error = "malformed vertex normal: " + std::string(line, lineEnd);
+            }
+            break;
+        }
+        case LineKind::Face: {
+            Corner first, prev, cur;
+            size_t n = 0;
+            for (s = skipSpaces(s, lineEnd); s < lineEnd && *s != '\r'; s = skipSpaces(s, lineEnd)) {
+                s = parseCorner(s, lineEnd, c, pos, uv, nor, &cur);
+                if (!s || (s < lineEnd && *s != ' ' && *s != '\t' && *s != '\r')) {
+                    c.error = "malformed face: " + std::string(line, lineEnd);
+                    break;
+                }
+                if (n == 0) {
+                    first = cur;
+                } else if (n >= 2) {
+                    Corner* out = corners + c.cornerOffset + corner;
+                    out[0] = first;
+                    out[1] = prev;
+                    out[2] = cur;
+                    corner += 3;
+                }
+                prev = cur;
+                n++;
+            }
+            break;
+        }
+        case LineKind::Other: break;
+        }
+        line = lineEnd + 1;
+    }
+}
+
+inline uint32_t hashCorner(const Corner& c) {
+    uint64_t h = static_cast<uint64_t>(static_cast<uint32_t>(c.v)) * 0x9E3779B97F4A7C15ull;
+    h ^= static_cast<uint64_t>(static_cast<uint32_t>(c.t)) * 0xC2B2AE3D27D4EB4Full;
+    h ^= static_cast<uint64_t>(static_cast<uint32_t>(c.n)) * 0x165667B19E3779F9ull;
+    return static_cast<uint32_t>(h ^ (h >> 29));
+}
+
+// open addressing with linear probing. a slot is empty while key.v == -1
+class CornerTable {
+public:
+    explicit CornerTable(size_t maxKeys) {
+        size_t cap = 16;
+        while (cap < 2 * maxKeys) cap <<= 1;
+        m_mask = cap - 1;
+        m_slots.assign(cap, Slot{{-1, -1, -1}, 0});
+    }
+
+    // returns the index already mapped to key, or maps it to candidate and returns that
+    uint32_t findOrInsert(const Corner& key, uint32_t candidate) {
+        for (size_t i = hashCorner(key) & m_mask;; i = (i + 1) & m_mask) {
+            Slot& s = m_slots[i];
+            if (s.key.v == -1) {
+                s.key = key;
+                s.index = candidate;
+                return candidate;
+            }
+            if (s.key.v == key.v && s.key.t == key.t && s.key.n == key.n) {
+                return s.index;
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        Corner key;
+        uint32_t index;
+    };
+    std::vector<Slot> m_slots;
+    size_t m_mask;
+};
+
+}  // namespace
+
+bool LoadOBJFile(const QString& file, Polygon& p, QString* error) {
+    auto fail = [error](const QString& msg) {
+        if (error) *error = msg;
+        return false;
+    };
+
+    QFile f(file);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return fail(QString("Could not open OBJ file %1").arg(file));
+    }
+    const qint64 size = f.size();
+    if (size == 0) return true;
+
+    // map the file rather than reading it. fall back to a plain read if mapping isn't supported
+    QByteArray fallback;
+    const char* data = reinterpret_cast<const char*>(f.map(0, size));
+    if (!data) {
+        fallback = f.readAll();
+        data = fallback.constData();
+    }
+    const char* dataEnd = data + size;
+
+    // split into line-aligned chunks
+    const size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    const size_t numChunks = std::max<size_t>(1, std::min(hw, static_cast<size_t>(size) / MIN_CHUNK_BYTES));
+    std::vector<Chunk> chunks(numChunks);
+    const char* cursor = data;
+    for (size_t i = 0; i < numChunks; i++) {
+        const char* cut = (i + 1 == numChunks) ? dataEnd : data + size * (i + 1) / numChunks;
+        cut = std::max(cut, cursor);
+        if (cut < dataEnd) cut = std::min(dataEnd, findLineEnd(cut, dataEnd) + 1);
+        chunks[i].begin = cursor;
+        chunks[i].end = cut;
+        cursor = cut;
+    }
+
+    parallelFor(numChunks, [&chunks](size_t i) { countChunk(chunks[i]); });
+
+    size_t totalPos = 0, totalUV = 0, totalNor = 0, totalCorners = 0;
+    for (Chunk& c : chunks) {
+        c.posOffset = totalPos;       totalPos += c.numPos;
+        c.uvOffset = totalUV;         totalUV += c.numUV;
+        c.norOffset = totalNor;       totalNor += c.numNor;
+        c.cornerOffset = totalCorners; totalCorners += c.numCorners;
+    }
+
+    std::vector<float> positions(3 * totalPos), uvs(2 * totalUV), normals(3 * totalNor);
+    std::vector<Corner> corners(totalCorners);
+    parallelFor(numChunks, [&](size_t i) {
+        parseChunk(chunks[i], positions.data(), uvs.data(), normals.data(), corners.data());
+    });
+
+    if (fallback.isEmpty()) f.unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+
+    for (const Chunk& c : chunks) {
+        if (!c.error.empty()) return fail(QString::fromStdString(c.error));
+    }
+
+    // dedupe corners. the hashing is serial, but it only produces a list of unique corners,
+    // so the vertex packing below is parallel again
+    const uint32_t base = static_cast<uint32_t>(p.VertexCount());
+    std::vector<uint32_t> remap(totalCorners);
+    std::vector<uint32_t> uniqueCorners;
+    uniqueCorners.reserve(std::max(totalPos, totalUV));
+    CornerTable table(totalCorners);
+    for (size_t i = 0; i < totalCorners; i++) {
+        const Corner& c = corners[i];
+        if (c.v < 0 || static_cast<size_t>(c.v) >= totalPos ||
+            c.t >= static_cast<int32_t>(totalUV) || c.n >= static_cast<int32_t>(totalNor) ||
+            c.t < -1 || c.n < -1) {
+            return fail(QString("OBJ face references a missing vertex in %1").arg(file));
+        }
+        const uint32_t next = static_cast<uint32_t>(uniqueCorners.size());
+        const uint32_t idx = table.findOrInsert(c, next);
+        if (idx == next) uniqueCorners.push_back(static_cast<uint32_t>(i));
+        remap[i] = base + idx;
+    }
+
+    // write straight into the polygon's final storage
+    p.ResizeVertices(base + uniqueCorners.size());
+    p.m_tris.resize(p.m_tris.size() + totalCorners / 3);
+    Triangle* tris = p.m_tris.data() + p.m_tris.size() - totalCorners / 3;
+    glm::vec3* vertPos = p.m_positions.data() + base;
+    PackedAttributes* vertAttr = p.m_attributes.data() + base;
+
+    const size_t numWorkers = std::max<size_t>(1, std::min(hw, uniqueCorners.size() / (1 << 14)));
+    parallelFor(numWorkers, [&](size_t w) {
+        const size_t vBegin = uniqueCorners.size() * w / numWorkers;
+        const size_t vEnd = uniqueCorners.size() * (w + 1) / numWorkers;
+        for (size_t i = vBegin; i < vEnd; i++) {
+            const Corner& c = corners[uniqueCorners[i]];
+            const float* pos = &positions[3 * c.v];
+            const glm::vec3 nor = c.n >= 0 ? glm::vec3(normals[3 * c.n], normals[3 * c.n + 1], normals[3 * c.n + 2])
+                                           : glm::vec3(0, 0, 0);
+            const glm::vec2 uv = c.t >= 0 ? glm::vec2(uvs[2 * c.t], uvs[2 * c.t + 1]) : glm::vec2(0, 0);
+            vertPos[i] = glm::vec3(pos[0], pos[1], pos[2]);
+            vertAttr[i] = {PackNormal(nor), PackUV(uv)};
+        }
+
+        const size_t numTris = totalCorners / 3;
+        const size_t tBegin = numTris * w / numWorkers;
+        const size_t tEnd = numTris * (w + 1) / numWorkers;
+        for (size_t t = tBegin; t < tEnd; t++) {
+            tris[t].m_indices[0] = remap[3 * t];
+            tris[t].m_indices[1] = remap[3 * t + 1];
+            tris[t].m_indices[2] = remap[3 * t + 2];
+        }
+    });
+
+    return true;
+}
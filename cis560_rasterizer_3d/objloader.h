@@ -0,0 +1,10 @@
+#pragma once
+
+#include <QString>
+#include "polygon.h"
+
+// Parses a Wavefront OBJ file straight into p's vertex streams and m_tris.
+// The file is memory mapped and split into line-aligned chunks that are parsed in parallel,
+// then every unique v/vt/vn corner becomes one vertex (deduplicated through a hash table).
+// Returns false and fills *error if the file can't be read or references missing data.
+bool LoadOBJFile(const QString& file, Polygon& p, QString* error = nullptr);
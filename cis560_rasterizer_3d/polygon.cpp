@@ -4,6 +4,7 @@
 #include "debug.h"
 #include "constants.h"
 #include <algorithm>
+#include <cmath>
 #include <limits>
 #include "camera.h"
 
@@ -50,57 +51,9 @@ BarycentricWeights::BarycentricWeights(float s1, float s2, float s3, float z)
 {}
 
 
-void Polygon::computeBoundingBoxes(Triangle& t) const {
-    t.offScreen = false;
-
-    const glm::vec4& p1 = this->m_verts[t.m_indices[0]].m_pos;
-    const glm::vec4& p2 = this->m_verts[t.m_indices[1]].m_pos;
-    const glm::vec4& p3 = this->m_verts[t.m_indices[2]].m_pos;
-
-    // these store the floats of the bb sides
-    const float minXf = std::min({p1[0], p2[0], p3[0]});
-    const float maxXf = std::max({p1[0], p2[0], p3[0]});
-    const float minYf = std::min({p1[1], p2[1], p3[1]});
-    const float maxYf = std::max({p1[1], p2[1], p3[1]});
-
-    // if any side is outside [0,W) x [0,H), dont render the triangle
-    if (maxXf <= 0.f || minXf >= float(SCREEN_WIDTH) || maxYf <= 0.f || minYf >= float(SCREEN_HEIGHT)) {
-        t.offScreen = true;
-    }
-
-    t.m_boundingBox.minX = minXf;
-    t.m_boundingBox.maxX = maxXf;
-    t.m_boundingBox.minY = minYf;
-    t.m_boundingBox.maxY = maxYf;
-}
-
-void Polygon::computeBoundingBoxes(Triangle& t, const std::array<Vertex,3>& pv) const {
-    t.offScreen = false;
-
-    const glm::vec4& p1 = pv[0].m_pos;
-    const glm::vec4& p2 = pv[1].m_pos;
-    const glm::vec4& p3 = pv[2].m_pos;
-
-    // these store the floats of the bb sides
-    const float minXf = std::min({p1[0], p2[0], p3[0]});
-    const float maxXf = std::max({p1[0], p2[0], p3[0]});
-    const float minYf = std::min({p1[1], p2[1], p3[1]});
-    const float maxYf = std::max({p1[1], p2[1], p3[1]});
-
-    // if any side is outside [0,W) x [0,H), dont render the triangle
-    if (maxXf <= 0.f || minXf >= float(SCREEN_WIDTH) || maxYf <= 0.f || minYf >= float(SCREEN_HEIGHT)) {
-        t.offScreen = true;
-    }
-
-    t.m_boundingBox.minX = minXf;
-    t.m_boundingBox.maxX = maxXf;
-    t.m_boundingBox.minY = minYf;
-    t.m_boundingBox.maxY = maxYf;
-}
-
 void Polygon::Triangulate()
 {
-    int num_tris = this->m_verts.size() - 2;  // for an n-polygon, need n-2 triangles
+    int num_tris = this->VertexCount() - 2;  // for an n-polygon, need n-2 triangles
     // vertices are guaranteed to be correct by constructor, custom or regular
     // remember, Triangle stores indices of vertices
     this->m_tris.clear();
@@ -127,26 +80,26 @@ glm::vec3 GetImageColor(const glm::vec2 &uv_coord, const QImage* const image)
     return glm::vec3(255.f, 255.f, 255.f);
 }
 
+// the custom and regular polygons are flat shapes in the xy plane, facing the viewer of a 2D scene
+static const glm::vec4 FLAT_NORMAL(0.f, 0.f, 1.f, 0.f);
 
 // Creates a polygon from the input list of vertex positions and colors
 Polygon::Polygon(const QString& name, const std::vector<glm::vec4>& pos, const std::vector<glm::vec3>& col)
-    : m_tris(), m_verts(), m_name(name), mp_texture(nullptr), mp_normalMap(nullptr)
+    : m_tris(), m_positions(), m_name(name), mp_texture(nullptr)
 {
     for(unsigned int i = 0; i < pos.size(); i++)
     {
-        m_verts.push_back(Vertex(pos[i], col[i], glm::vec4(), glm::vec2()));
+        AddVertex(Vertex(pos[i], col[i], FLAT_NORMAL, glm::vec2()));
     }
+    m_colors.assign(col.begin(), col.begin() + pos.size());
     Triangulate();
-    for (Triangle& t : m_tris) {
-        computeBoundingBoxes(t);
-    }
 }
 
 // Creates a regular polygon with a number of sides indicated by the "sides" input integer.
 // All of its vertices are of color "color", and the polygon is centered at "pos".
 // It is rotated about its center by "rot" degrees, and is scaled from its center by "scale" units
 Polygon::Polygon(const QString& name, int sides, glm::vec3 color, glm::vec4 pos, float rot, glm::vec4 scale)
-    : m_tris(), m_verts(), m_name(name), mp_texture(nullptr), mp_normalMap(nullptr)
+    : m_tris(), m_positions(), m_name(name), mp_texture(nullptr)
 {
     glm::vec4 v(0.f, 1.f, 0.f, 1.f);
     float angle = 360.f / sides;
@@ -157,34 +110,68 @@ Polygon::Polygon(const QString& name, int sides, glm::vec3 color, glm::vec4 pos,
             * glm::scale(glm::vec3(scale.x, scale.y, scale.z))
             * glm::rotate(i * angle, glm::vec3(0.f, 0.f, 1.f))
             * v;
-        m_verts.push_back(Vertex(vert_pos, color, glm::vec4(), glm::vec2()));
+        AddVertex(Vertex(vert_pos, color, FLAT_NORMAL, glm::vec2()));
     }
+    m_colors.assign(sides, color);
 
     Triangulate();
-    for (Triangle& t : m_tris) {
-        computeBoundingBoxes(t);
-    }
 }
 
 Polygon::Polygon(const QString &name)
-    : m_tris(), m_verts(), m_name(name), mp_texture(nullptr), mp_normalMap(nullptr)
+    : m_tris(), m_positions(), m_name(name), mp_texture(nullptr)
 {}
 
 Polygon::Polygon()
-    : m_tris(), m_verts(), m_name("Polygon"), mp_texture(nullptr), mp_normalMap(nullptr)
+    : m_tris(), m_positions(), m_name("Polygon"), mp_texture(nullptr)
 {}
 
 Polygon::Polygon(const Polygon& p)
-    : m_tris(p.m_tris), m_verts(p.m_verts), m_name(p.m_name), mp_texture(nullptr), mp_normalMap(nullptr)
+    : m_tris(p.m_tris), m_positions(p.m_positions), m_attributes(p.m_attributes), m_colors(p.m_colors),
+      m_tangents(p.m_tangents), m_name(p.m_name), mp_texture(nullptr),
+      m_normalMap(p.m_normalMap), m_textureAverage(p.m_textureAverage), m_node(p.m_node)
 {
     if(p.mp_texture != nullptr)
     {
         mp_texture = new QImage(*p.mp_texture);
     }
-    if(p.mp_normalMap != nullptr)
+}
+
+Polygon::Polygon(Polygon&& p) noexcept
+    : m_tris(std::move(p.m_tris)), m_positions(std::move(p.m_positions)), m_attributes(std::move(p.m_attributes)),
+      m_colors(std::move(p.m_colors)), m_tangents(std::move(p.m_tangents)), m_name(std::move(p.m_name)),
+      mp_texture(p.mp_texture), m_normalMap(std::move(p.m_normalMap)), m_textureAverage(p.m_textureAverage),
+      m_node(p.m_node)
+{
+    p.mp_texture = nullptr;
+}
+
+Polygon& Polygon::operator=(const Polygon& p)
+{
+    if(this != &p)
     {
-        mp_normalMap = new QImage(*p.mp_normalMap);
+        *this = Polygon(p);
     }
+    return *this;
+}
+
+Polygon& Polygon::operator=(Polygon&& p) noexcept
+{
+    if(this != &p)
+    {
+        m_tris = std::move(p.m_tris);
+        m_positions = std::move(p.m_positions);
+        m_attributes = std::move(p.m_attributes);
+        m_colors = std::move(p.m_colors);
+        m_tangents = std::move(p.m_tangents);
+        m_name = std::move(p.m_name);
+        delete mp_texture;
+        mp_texture = p.mp_texture;
+        m_normalMap = std::move(p.m_normalMap);
+        m_textureAverage = p.m_textureAverage;
+        m_node = p.m_node;
+        p.mp_texture = nullptr;
+    }
+    return *this;
 }
 
 Polygon::~Polygon()
@@ -192,14 +179,201 @@ Polygon::~Polygon()
     delete mp_texture;
 }
 
+// mean of at most 64x64 evenly spread texels, which is plenty for a preview color
+static QRgb averageColor(const QImage& image)
+{
+    const int stepX = std::max(1, image.width() / 64);
+    const int stepY = std::max(1, image.height() / 64);
+    unsigned long long r = 0, g = 0, b = 0, n = 0;
+    for(int y = 0; y < image.height(); y += stepY)
+    {
+        const QRgb* row = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for(int x = 0; x < image.width(); x += stepX)
+        {
+            r += qRed(row[x]);
+            g += qGreen(row[x]);
+            b += qBlue(row[x]);
+            n++;
+        }
+    }
+    return qRgb(int(r / n), int(g / n), int(b / n));
+}
+
 void Polygon::SetTexture(QImage* i)
 {
+    if(mp_texture != i)
+    {
+        delete mp_texture;
+    }
+    // the shading kernels read texels straight from the image's bits
+    if(i && !i->isNull() && i->format() != QImage::Format_RGB32 && i->format() != QImage::Format_ARGB32)
+    {
+        *i = i->convertToFormat(QImage::Format_RGB32);
+    }
     mp_texture = i;
+    m_textureAverage = (i && !i->isNull()) ? averageColor(*i) : qRgb(0, 0, 0);
 }
 
 void Polygon::SetNormalMap(QImage* i)
 {
-    mp_normalMap = i;
+    m_normalMap = PackedNormalMap();
+    if(i && !i->isNull())
+    {
+        const int w = i->width(), h = i->height();
+        m_normalMap.width = w;
+        m_normalMap.height = h;
+        // one spare texel: the gathering kernels read four bytes per two byte texel
+        m_normalMap.texels.resize(size_t(w) * h + 1, 0);
+        const QImage rgb = i->convertToFormat(QImage::Format_RGB32);
+        for(int y = 0; y < h; y++)
+        {
+            const QRgb* row = reinterpret_cast<const QRgb*>(rgb.constScanLine(y));
+            for(int x = 0; x < w; x++)
+            {
+                const glm::vec3 n = glm::normalize(glm::vec3(qRed(row[x]), qGreen(row[x]), qBlue(row[x])) / 127.5f - 1.f);
+                m_normalMap.texels[size_t(y) * w + x] = PackedNormalMap::Pack(n);
+            }
+        }
+        ComputeTangents();
+    }
+    delete i;
+}
+
+// [-1, 1] to a signed byte, as its unsigned bit pattern
+static uint32_t snorm8(float f)
+{
+    return uint8_t(int8_t(std::lround(glm::clamp(f, -1.f, 1.f) * 127.f)));
+}
+
+uint16_t PackedNormalMap::Pack(const glm::vec3& n)
+{
+    return uint16_t(snorm8(n.x) | snorm8(n.y) << 8);
+}
+
+uint32_t PackTangent(const glm::vec3& t, float handedness)
+{
+    return snorm8(t.x) | snorm8(t.y) << 8 | snorm8(t.z) << 16 | snorm8(handedness < 0 ? -1.f : 1.f) << 24;
+}
+
+glm::vec4 UnpackTangent(uint32_t packed)
+{
+    auto decode = [](uint32_t b) { return float(int8_t(uint8_t(b))) / 127.f; };
+    return glm::vec4(decode(packed), decode(packed >> 8), decode(packed >> 16), decode(packed >> 24));
+}
+
+// [-1, 1] to a signed 16 bit value, as its unsigned bit pattern
+static uint32_t snorm16(float f)
+{
+    return uint16_t(int16_t(std::lround(glm::clamp(f, -1.f, 1.f) * 32767.f)));
+}
+
+// -32768 twice. snorm16 never rounds to that, so no direction has it
+static const uint32_t ZERO_NORMAL = 0x80008000u;
+
+uint32_t PackNormal(const glm::vec3& n)
+{
+    const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if(l1 == 0.f)
+    {
+        return ZERO_NORMAL;
+    }
+    // onto the octahedron |x| + |y| + |z| = 1, and its lower half folded over the upper one
+    glm::vec2 o = glm::vec2(n) / l1;
+    if(n.z < 0.f)
+    {
+        o = glm::vec2((1.f - std::abs(o.y)) * (o.x < 0.f ? -1.f : 1.f),
+                      (1.f - std::abs(o.x)) * (o.y < 0.f ? -1.f : 1.f));
+    }
+    return snorm16(o.x) | snorm16(o.y) << 16;
+}
+
+glm::vec3 UnpackNormal(uint32_t packed)
+{
+    if(packed == ZERO_NORMAL)
+    {
+        return glm::vec3(0.f);
+    }
+    auto decode = [](uint32_t b) { return float(int16_t(uint16_t(b))) / 32767.f; };
+    const float x = decode(packed), y = decode(packed >> 16);
+    glm::vec3 n(x, y, 1.f - std::abs(x) - std::abs(y));
+    if(n.z < 0.f)
+    {
+        n.x = (1.f - std::abs(y)) * (x < 0.f ? -1.f : 1.f);
+        n.y = (1.f - std::abs(x)) * (y < 0.f ? -1.f : 1.f);
+    }
+    return glm::normalize(n);
+}
+
+uint32_t PackUV(const glm::vec2& uv)
+{
+    return glm::packHalf2x16(uv);
+}
+
+glm::vec2 UnpackUV(uint32_t packed)
+{
+    return glm::unpackHalf2x16(packed);
+}
+
+void Polygon::ComputeTangents()
+{
+    // the direction of increasing u and v on each triangle, from the edges and their uv deltas.
+    // shared vertices sum their triangles' directions, larger triangles weighing more
+    std::vector<glm::vec3> tangents(VertexCount(), glm::vec3(0.f));
+    std::vector<glm::vec3> bitangents(VertexCount(), glm::vec3(0.f));
+    for(const Triangle& t : m_tris)
+    {
+        const Vertex a = VertAt(t.m_indices[0]);
+        const Vertex b = VertAt(t.m_indices[1]);
+        const Vertex c = VertAt(t.m_indices[2]);
+        const glm::vec3 e1 = glm::vec3(b.m_pos - a.m_pos), e2 = glm::vec3(c.m_pos - a.m_pos);
+        const glm::vec2 d1 = b.m_uv - a.m_uv, d2 = c.m_uv - a.m_uv;
+        const float det = d1.x * d2.y - d2.x * d1.y;
+        if(std::abs(det) < 1e-12f)
+        {
+            continue;  // no uv area, no direction
+        }
+        const glm::vec3 tan = (e1 * d2.y - e2 * d1.y) / det;
+        const glm::vec3 bit = (e2 * d1.x - e1 * d2.x) / det;
+        for(unsigned idx : t.m_indices)
+        {
+            tangents[idx] += tan;
+            bitangents[idx] += bit;
+        }
+    }
+
+    m_tangents.assign(VertexCount(), 0);
+    for(size_t i = 0; i < VertexCount(); i++)
+    {
+        const glm::vec3 n = UnpackNormal(m_attributes[i].normal);
+        // made perpendicular to the normal. without uvs any perpendicular will do
+        glm::vec3 t = tangents[i] - n * glm::dot(n, tangents[i]);
+        if(glm::dot(t, t) < 1e-12f)
+        {
+            t = glm::cross(n, std::abs(n.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0));
+        }
+        if(glm::dot(t, t) < 1e-12f)
+        {
+            continue;  // no normal either
+        }
+        t = glm::normalize(t);
+        // mirrored uvs flip the bitangent, which is rebuilt from the normal and tangent when shading
+        const float handedness = glm::dot(glm::cross(n, t), bitangents[i]) < 0.f ? -1.f : 1.f;
+        m_tangents[i] = PackTangent(t, handedness);
+    }
+}
+
+MemoryBytes Polygon::Memory() const
+{
+    MemoryBytes b;
+    b[MemoryCategory::Vertices] = CapacityBytes(m_positions) + CapacityBytes(m_attributes)
+                                + CapacityBytes(m_colors) + CapacityBytes(m_tangents);
+    b[MemoryCategory::Indices] = CapacityBytes(m_tris);
+    b[MemoryCategory::Textures] = CapacityBytes(m_normalMap.texels);
+    if(mp_texture)
+    {
+        b[MemoryCategory::Textures] += size_t(mp_texture->bytesPerLine()) * mp_texture->height();
+    }
+    return b;
 }
 
 void Polygon::AddTriangle(const Triangle& t)
@@ -209,7 +383,30 @@ void Polygon::AddTriangle(const Triangle& t)
 
 void Polygon::AddVertex(const Vertex& v)
 {
-    m_verts.push_back(v);
+    if(HasVertexColors())
+    {
+        m_colors.push_back(v.m_color);
+    }
+    if(!m_tangents.empty() && m_tangents.size() == m_positions.size())
+    {
+        m_tangents.push_back(v.m_tangent);
+    }
+    m_positions.push_back(glm::vec3(v.m_pos));
+    m_attributes.push_back({PackNormal(glm::vec3(v.m_normal)), PackUV(v.m_uv)});
+}
+
+void Polygon::ResizeVertices(size_t count)
+{
+    if(HasVertexColors())
+    {
+        m_colors.resize(count, glm::vec3(255.f));
+    }
+    if(!m_tangents.empty() && m_tangents.size() == m_positions.size())
+    {
+        m_tangents.resize(count, 0);
+    }
+    m_positions.resize(count);
+    m_attributes.resize(count);
 }
 
 void Polygon::ClearTriangles()
@@ -227,12 +424,11 @@ Triangle Polygon::TriAt(unsigned int i) const
     return m_tris[i];
 }
 
-Vertex &Polygon::VertAt(unsigned int i)
-{
-    return m_verts[i];
-}
-
 Vertex Polygon::VertAt(unsigned int i) const
 {
-    return m_verts[i];
+    return Vertex(glm::vec4(m_positions[i], 1.f),
+                  HasVertexColors() ? m_colors[i] : glm::vec3(255.f),
+                  glm::vec4(UnpackNormal(m_attributes[i].normal), 0.f),
+                  UnpackUV(m_attributes[i].uv),
+                  m_tangents.size() == m_positions.size() ? m_tangents[i] : 0);
 }
@@ -1,9 +1,11 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <vector>
 #include <QString>
 #include <QImage>
 #include <QColor>
+#include "memorystats.h"
 
 // #include "segment.h"
 
@@ -15,20 +17,54 @@ struct BarycentricWeights {
 // A Vertex is a point in space that defines one corner of a polygon.
 // Each Vertex has several attributes that determine how they contribute to the
 // appearance of their Polygon, such as coloration.
+// This is the unpacked form the rasterizer works with. Polygons store theirs compactly, see VertAt
 struct Vertex
 {
     glm::vec4 m_pos;    // The position of the vertex. In hw02, this is in pixel space.
     glm::vec3 m_color;  // The color of the vertex. X corresponds to Red, Y corresponds to Green, and Z corresponds to Blue.
     glm::vec4 m_normal; // The surface normal of the vertex (not yet used)
     glm::vec2 m_uv;     // The texture coordinates of the vertex (not yet used)
+    uint32_t m_tangent = 0;  // the direction of increasing u, see PackTangent. 0 without a normal map
 
     Vertex() = default;
-    Vertex(glm::vec4 p, glm::vec3 c, glm::vec4 n, glm::vec2 u)
-        : m_pos(p), m_color(c), m_normal(n), m_uv(u)
+    Vertex(glm::vec4 p, glm::vec3 c, glm::vec4 n, glm::vec2 u, uint32_t t = 0)
+        : m_pos(p), m_color(c), m_normal(n), m_uv(u), m_tangent(t)
     {}
 
 };
 
+// a unit tangent in three signed bytes, and in the fourth the sign the bitangent
+// cross(normal, tangent) takes, which is -1 where the uvs are mirrored
+uint32_t PackTangent(const glm::vec3& tangent, float handedness);
+glm::vec4 UnpackTangent(uint32_t packed);  // w is the handedness
+
+// a unit normal in two signed 16 bit values, its octahedral projection. the zero vector, which
+// the meshes without normals have, gets a code of its own
+uint32_t PackNormal(const glm::vec3& normal);
+glm::vec3 UnpackNormal(uint32_t packed);
+
+// a uv as two half floats, u in the low half. in [0, 1] they're off by at most 1/4096, a quarter
+// texel of a 1024 texture. repeating uvs lose a bit per power of two past 1, a whole texel in [2, 4)
+uint32_t PackUV(const glm::vec2& uv);
+glm::vec2 UnpackUV(uint32_t packed);
+
+// what a Polygon stores of a vertex besides its position and the optional streams
+struct PackedAttributes
+{
+    uint32_t normal;  // see PackNormal
+    uint32_t uv;      // see PackUV
+};
+
+// A tangent space normal map as two signed bytes per texel, x and y scaled by 127.
+// The unit normal's z is rebuilt from them, so the third channel isn't stored at all
+struct PackedNormalMap
+{
+    int width = 0, height = 0;
+    std::vector<uint16_t> texels;  // x in the low byte, y in the high one. empty without a map
+
+    static uint16_t Pack(const glm::vec3& unit_normal);
+};
+
 class Segment
 {
 public:
@@ -47,44 +83,44 @@ private:
 struct Triangle
 {
     // The indices of the Vertices that make up this triangle.
-    // The indices correspond to the std::vector of Vertices stored in the Polygon
+    // The indices correspond to the vertex streams of the Polygon
     // which stores this Triangle
     unsigned int m_indices[3];
-
-    struct BoundingBox {
-        float minX, maxX, minY, maxY;
-    };
-
-    BoundingBox m_boundingBox;
-    bool offScreen = false;  // depends on the bounding box
-
-    // std::array<Vertex,3> m_verts;
-    // the segments/sides of the triangle
-    // std::array<Segment,3> m_segments;  // created automatically at initialization
-
 };
 
-
+// a triangle's extent in pixel space. the rasterizer works it out anew every frame
+struct BoundingBox {
+    float minX, maxX, minY, maxY;
+};
 
 class Polygon
 {
 public:
     // Populate this list of triangles in Triangulate()
     std::vector<Triangle> m_tris;
-    // The list of Vertices that define this polygon. This is already filled by the Polygon constructor.
-    std::vector<Vertex> m_verts;
-    // The above list of triangles, after they've been projected to pixel space. changes every re-render
-    std::vector<Triangle> m_proj_tris;
-    // Same thing but for verts.
-    std::vector<Vertex> m_proj_verts;
+    // The Vertices that define this polygon, one element per vertex in each stream. This is already
+    // filled by the Polygon constructor. The positions are a stream of their own, so the passes
+    // that only need them, like the transform and the depth-only ones, don't drag the rest along
+    std::vector<glm::vec3> m_positions;
+    std::vector<PackedAttributes> m_attributes;
+    // the vertex colors, 0 to 255. only the custom and regular polygons have them, the meshes
+    // leave this empty and get shaded without. they only count while there's one per position,
+    // see HasVertexColors
+    std::vector<glm::vec3> m_colors;
+    // the packed tangents, see PackTangent. empty without a normal map, and like the colors
+    // ignored unless there's one per position
+    std::vector<uint32_t> m_tangents;
     // The name of this polygon, primarily to help you debug
     QString m_name;
     // The image that can be read to determine pixel color when used in conjunction with UV coordinates
     // Not used until homework 3.
     QImage* mp_texture;
-    // The image that can be read to determine surface normal offset when used in conjunction with UV coordinates
-    // Not used until homework 3
-    QImage* mp_normalMap;
+    // The normal map, read at the same UV coordinates as the texture to perturb the surface normal
+    PackedNormalMap m_normalMap;
+    // the mean color of mp_texture, what a texture looks like from far enough away. kept by SetTexture
+    QRgb m_textureAverage = qRgb(0, 0, 0);
+    // the SceneGraph node whose space the vertices are in, -1 for world space
+    int m_node = -1;
 
     // Polygon class constructors
     Polygon(const QString& name, const std::vector<glm::vec4>& pos, const std::vector<glm::vec3> &col);  // custom
@@ -92,32 +128,46 @@ public:
     Polygon(const QString& name);  // the first part of the 3d render steps
     Polygon();
     Polygon(const Polygon& p);  // copy
+    Polygon(Polygon&& p) noexcept;  // move, takes the texture and normal map
+    Polygon& operator=(const Polygon& p);
+    Polygon& operator=(Polygon&& p) noexcept;
     ~Polygon();
 
     // TODO: Complete the body of Triangulate() in polygon.cpp
     // Creates a set of triangles that, when combined, fill the area of this convex polygon.
     void Triangulate();
 
-    // computes the min x, max x, min y, max y for each Triangle in m_tris
-    void computeBoundingBoxes(Triangle&) const;
-    void computeBoundingBoxes(Triangle&, const std::array<Vertex,3>&) const;
-
-    // Copies the input QImage into this Polygon's texture
+    // Takes ownership of the input QImage as this Polygon's texture, freeing any previous one
     void SetTexture(QImage*);
 
-    // Copies the input QImage into this Polygon's normal map
+    // Takes ownership of the input QImage and converts it into this Polygon's normal map.
+    // Also derives the vertex tangents it needs, so set it once the geometry is in place
     void SetNormalMap(QImage*);
+    // per vertex tangents from the positions and uvs, for normal mapping
+    void ComputeTangents();
 
     // Various getter, setter, and adder functions
+    // packs the vertex into the streams. its color is kept if the polygon has vertex colors, and
+    // its tangent if the others have tangents. a polygon starts out without either, the custom and
+    // regular constructors add the colors once all vertices are in
     void AddVertex(const Vertex&);
+    // grows or shrinks every stream to count vertices, for the loaders that write them in place.
+    // vertex colors and tangents in use stay in step, the new vertices white and without tangent
+    void ResizeVertices(size_t count);
     void AddTriangle(const Triangle&);
     void ClearTriangles();
 
     Triangle& TriAt(unsigned int);
     Triangle TriAt(unsigned int) const;
 
-    Vertex& VertAt(unsigned int);
+    size_t VertexCount() const { return m_positions.size(); }
+    // unpacks a vertex. without vertex colors it's white, without a normal map its tangent is 0
     Vertex VertAt(unsigned int) const;
+    // whether every vertex has a color
+    bool HasVertexColors() const { return !m_colors.empty() && m_colors.size() == m_positions.size(); }
+
+    // the bytes its vertices, triangles and textures take up
+    MemoryBytes Memory() const;
 };
 
 // Returns the color of the pixel in the image at the specified texture coordinates.
@@ -7,10 +7,17 @@
 #include "debug.h"
 #include "camera.h"
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
 #include "polygon.h"
 
 Rasterizer::Rasterizer(const std::vector<Polygon>& polygons)
-    : m_polygons(polygons)
+    : mp_polygons(std::make_shared<std::vector<Polygon>>(polygons))
+{}
+
+Rasterizer::Rasterizer(std::shared_ptr<std::vector<Polygon>> polygons)
+    : mp_polygons(std::move(polygons))
 {}
 
 float Rasterizer::computeSubTriangleArea(const glm::vec2& v1,
@@ -28,9 +35,9 @@ BarycentricWeights Rasterizer::ComputeBarycentricWeights(const Polygon& p,
                                                          const Triangle& t,
                                                          const glm::vec2 &fragPos) const {
 
-    glm::vec2 v1(p.VertAt(t.m_indices[0]).m_pos.x, p.VertAt(t.m_indices[0]).m_pos.y);
-    glm::vec2 v2(p.VertAt(t.m_indices[1]).m_pos.x, p.VertAt(t.m_indices[1]).m_pos.y);
-    glm::vec2 v3(p.VertAt(t.m_indices[2]).m_pos.x, p.VertAt(t.m_indices[2]).m_pos.y);
+    glm::vec2 v1(p.m_positions[t.m_indices[0]].x, p.m_positions[t.m_indices[0]].y);
+    glm::vec2 v2(p.m_positions[t.m_indices[1]].x, p.m_positions[t.m_indices[1]].y);
+    glm::vec2 v3(p.m_positions[t.m_indices[2]].x, p.m_positions[t.m_indices[2]].y);
 
     float s = computeSubTriangleArea(v1, v2, v3);
     float s1 = computeSubTriangleArea(fragPos, v2, v3) / s;
@@ -41,120 +48,299 @@ BarycentricWeights Rasterizer::ComputeBarycentricWeights(const Polygon& p,
     return BarycentricWeights(s1, s2, s3, z);
 }
 
-bool Rasterizer::ConsultAndWriteToZBuffer(const int x, const int y, const float candidate_z) {
-    float cur_z = m_zbuffer[y*SCREEN_WIDTH+x];
-    if (candidate_z < cur_z) {
-        m_zbuffer[y*SCREEN_WIDTH+x] = candidate_z;
-        return true;
-    }
-    return false;
+void Rasterizer::SetResolution(int width, int height) {
+    m_width = std::max(1, width);
+    m_height = std::max(1, height);
 }
 
 void Rasterizer::resetZBuffer() {
     m_zbuffer.assign(m_zbuffer.size(), std::numeric_limits<float>::infinity());
 }
 
-// pass triangle by copy and fill in proj_verts
-Triangle Rasterizer::projectTriangleFromWorldtoPixelSpace(const glm::mat4 proj_mat,
-                                                          const glm::mat4 view_mat,
-                                                          const Polygon& p,
-                                                          const Triangle t,
-                                                          std::array<Vertex,3>& pv) const {
+// clip space to pixel space. z stays the ndc depth the z-buffer and interpolation work with
+static inline glm::vec4 clipToPixel(const glm::vec4& clip, float width, float height) {
+    const glm::vec4 unhomo = clip / clip.w;
+    return {(unhomo.x+1)*(width/2),
+            (1-unhomo.y)*(height/2),
+            unhomo.z,
+            1.f};
+}
 
-    Triangle proj_tri;  // same indices in p.m_verts
-    std::copy(std::begin(t.m_indices), std::end(t.m_indices), std::begin(proj_tri.m_indices));
+static inline Vertex lerpVertex(const Vertex& a, const Vertex& b, float t) {
+    uint32_t tangent = 0;
+    if (a.m_tangent && b.m_tangent) {
+        const glm::vec4 ta = UnpackTangent(a.m_tangent), tb = UnpackTangent(b.m_tangent);
+        tangent = PackTangent(glm::normalize(glm::mix(glm::vec3(ta), glm::vec3(tb), t)), ta.w);
+    }
+    return Vertex(glm::mix(a.m_pos, b.m_pos, t),
+                  glm::mix(a.m_color, b.m_color, t),
+                  glm::mix(a.m_normal, b.m_normal, t),
+                  glm::mix(a.m_uv, b.m_uv, t),
+                  tangent);
+}
 
-    for (int i=0; i<3; i++) {
-        Vertex vert = p.VertAt(proj_tri.m_indices[i]);  // get a copy
+// a vertex with nothing but a position, for the depth-only pipeline
+static inline Vertex positionOnly(const glm::vec4& pos) {
+    return Vertex(pos, glm::vec3(0.f), glm::vec4(0.f), glm::vec2(0.f));
+}
 
-        glm::vec4 unhomo = proj_mat * view_mat * vert.m_pos;
-        unhomo /= unhomo.w;
+// the triangle's extent in pixel space, pv's positions. false if that's entirely off the
+// width x height screen
+static bool screenBounds(const std::array<Vertex,3>& pv, float width, float height, BoundingBox* bb) {
+    const glm::vec4& p1 = pv[0].m_pos;
+    const glm::vec4& p2 = pv[1].m_pos;
+    const glm::vec4& p3 = pv[2].m_pos;
+    bb->minX = std::min({p1[0], p2[0], p3[0]});
+    bb->maxX = std::max({p1[0], p2[0], p3[0]});
+    bb->minY = std::min({p1[1], p2[1], p3[1]});
+    bb->maxY = std::max({p1[1], p2[1], p3[1]});
+    return !(bb->maxX <= 0.f || bb->minX >= width || bb->maxY <= 0.f || bb->minY >= height);
+}
 
-        vert.m_pos = {(unhomo.x+1)*(SCREEN_WIDTH/2),
-                      (1-unhomo.y)*(SCREEN_HEIGHT/2),
-                      unhomo.z,
-                      unhomo.w};
+// triangles crossing the near plane are clipped against this ndc depth rather than 0,
+// since the interpolation divides by z
+static constexpr float NEAR_CLIP_Z = 1e-5f;
+// how far apart in view depth, relative to it, two reprojected pixels may be to close a crack between them
+static constexpr float CRACK_MAX_DEPTH_RATIO = 0.05f;
 
-        pv[i] = vert;
+void Rasterizer::transformVertices(const Polygon& p, const glm::mat4& view_proj) {
+    const size_t count = p.VertexCount();
+    m_clipPos = m_arena.Allocate<glm::vec4>(count);
+    m_screenPos = m_arena.Allocate<glm::vec4>(count);
+    m_worldVerts = nullptr;
+    m_model = nullptr;
+    m_mirrored = false;
+    if (m_sceneGraph.IsIdentity(p.m_node)) {
+        Kernels().transform(p.m_positions.data(), count, view_proj, m_width, m_height, m_clipPos, m_screenPos);
+    } else {
+        // the node's matrix goes into the projection, and shading gets world space copies of the
+        // vertices. the scene's own vertices stay in the node's space
+        m_model = &m_sceneGraph.World(p.m_node);
+        Kernels().transform(p.m_positions.data(), count, view_proj * *m_model, m_width, m_height, m_clipPos, m_screenPos);
+        const glm::mat3 linear(*m_model);
+        m_mirrored = glm::determinant(linear) < 0.f;
+        m_normalMatrix = glm::transpose(glm::inverse(linear));
     }
+    if (m_depthOnly) {
+        return;
+    }
+    // the triangles sharing a vertex all read it, so it's unpacked the first time one does
+    m_worldVerts = m_arena.Allocate<Vertex>(count);
+    m_unpacked = m_arena.Allocate<bool>(count);
+    std::fill_n(m_unpacked, count, false);
+}
 
-    return proj_tri;
-};
-
-// calculate this for every pixel. triangle is in pixel space
-BarycentricWeights Rasterizer::perspectiveCorrectBarycentricWeights(const Triangle& t,
-                                                                    std::array<Vertex,3>& pv,
-                                                                    const glm::vec2& fragPos) const {
-    glm::vec2 v1(pv[0].m_pos.x, pv[0].m_pos.y);
-    glm::vec2 v2(pv[1].m_pos.x, pv[1].m_pos.y);
-    glm::vec2 v3(pv[2].m_pos.x, pv[2].m_pos.y);
+const Vertex& Rasterizer::worldVertex(const Polygon& p, unsigned i) {
+    Vertex& w = m_worldVerts[i];
+    if (m_unpacked[i]) {
+        return w;
+    }
+    m_unpacked[i] = true;
+    new (&w) Vertex(p.VertAt(i));
+    if (!m_model) {
+        return w;
+    }
+    w.m_pos = *m_model * w.m_pos;
+    const glm::vec3 n = m_normalMatrix * glm::vec3(w.m_normal);
+    w.m_normal = glm::vec4(glm::length(n) > 0.f ? glm::normalize(n) : n, 0.f);
+    if (w.m_tangent) {
+        // a mirroring transform flips the bitangent along with the handedness
+        const glm::vec4 t = UnpackTangent(w.m_tangent);
+        w.m_tangent = PackTangent(glm::normalize(glm::mat3(*m_model) * glm::vec3(t)), m_mirrored ? -t.w : t.w);
+    }
+    return w;
+}
 
-    float s = computeSubTriangleArea(v1, v2, v3);
-    float s1 = computeSubTriangleArea(fragPos, v2, v3) / s;
-    float s2 = computeSubTriangleArea(fragPos, v1, v3) / s;
-    float s3 = computeSubTriangleArea(fragPos, v2, v1) / s;
+void Rasterizer::setupTriangles(const Polygon& p) {
+    // a triangle clipped down to a quad is set up as two
+    m_setupTris = m_arena.Allocate<SetupTriangle>(2 * p.m_tris.size());
+    m_setupCount = 0;
+    if (!m_depthOnly) {
+        m_fragRuns = m_arena.Allocate<FragmentRun>(2 * p.m_tris.size());
+        m_fragCount = 0;
+        growFragments(m_fragCapacity);
+    }
+    // depth-only passes only need the clip space positions, so they never unpack the vertices
+    for (const Triangle& t : p.m_tris) {
+        m_stats.trianglesSubmitted++;
 
-    float z1 = pv[0].m_pos.z;
-    float z2 = pv[1].m_pos.z;
-    float z3 = pv[2].m_pos.z;
+        int behind = 0;
+        for (unsigned idx : t.m_indices) {
+            const glm::vec4& c = m_clipPos[idx];
+            behind += c.z < NEAR_CLIP_Z * c.w;
+        }
+        if (behind == 3) {
+            m_stats.culledOffscreen++;
+            continue;
+        }
+        if (behind == 0) {
+            std::array<Vertex,3> verts;
+            std::array<glm::vec3,3> world;
+            for (int i = 0; i < 3; i++) {
+                if (m_depthOnly) {
+                    verts[i] = positionOnly(m_screenPos[t.m_indices[i]]);
+                    if (m_viewDepth) {
+                        verts[i].m_pos.z = m_clipPos[t.m_indices[i]].w;
+                    }
+                    continue;
+                }
+                const Vertex& v = worldVertex(p, t.m_indices[i]);
+                verts[i] = Vertex(m_screenPos[t.m_indices[i]], v.m_color, v.m_normal, v.m_uv, v.m_tangent);
+                world[i] = glm::vec3(v.m_pos);
+            }
+            setupScreenTriangle(verts, world);
+            continue;
+        }
 
-    return BarycentricWeights(s1, s2, s3, 1.f/(s1/z1 + s2/z2 + s3/z3));
+        // cut the triangle at the near plane in clip space, where attributes are still linear.
+        // what's left is a triangle or a quad
+        m_stats.nearClipped++;
+        std::array<Vertex,4> kept;
+        std::array<glm::vec3,4> keptWorld;
+        int n = 0;
+        for (int i = 0; i < 3; i++) {
+            const unsigned ia = t.m_indices[i];
+            const unsigned ib = t.m_indices[(i+1) % 3];
+            const Vertex va = m_depthOnly ? positionOnly(m_clipPos[ia]) : worldVertex(p, ia);
+            const Vertex vb = m_depthOnly ? positionOnly(m_clipPos[ib]) : worldVertex(p, ib);
+            const Vertex a = m_depthOnly ? positionOnly(m_clipPos[ia])
+                                         : Vertex(m_clipPos[ia], va.m_color, va.m_normal, va.m_uv, va.m_tangent);
+            const Vertex b = m_depthOnly ? positionOnly(m_clipPos[ib])
+                                         : Vertex(m_clipPos[ib], vb.m_color, vb.m_normal, vb.m_uv, vb.m_tangent);
+            const float da = a.m_pos.z - NEAR_CLIP_Z * a.m_pos.w;
+            const float db = b.m_pos.z - NEAR_CLIP_Z * b.m_pos.w;
+            if (da >= 0) {
+                keptWorld[n] = glm::vec3(va.m_pos);
+                kept[n++] = a;
+            }
+            if ((da >= 0) != (db >= 0)) {
+                const float t = da / (da - db);
+                keptWorld[n] = glm::mix(glm::vec3(va.m_pos), glm::vec3(vb.m_pos), t);
+                kept[n++] = m_depthOnly ? positionOnly(glm::mix(a.m_pos, b.m_pos, t)) : lerpVertex(a, b, t);
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            const float w = kept[i].m_pos.w;
+            kept[i].m_pos = clipToPixel(kept[i].m_pos, m_width, m_height);
+            if (m_viewDepth) {
+                kept[i].m_pos.z = w;
+            }
+        }
+        setupScreenTriangle({kept[0], kept[1], kept[2]}, {keptWorld[0], keptWorld[1], keptWorld[2]});
+        if (n == 4) {
+            setupScreenTriangle({kept[0], kept[2], kept[3]}, {keptWorld[0], keptWorld[2], keptWorld[3]});
+        }
+    }
 }
 
-// returns the same type that was put in
-template <typename T>
-T Rasterizer::perspectiveCorrectInterpolateAttrib(const T &v1attrib,
-                                                  const T &v2attrib,
-                                                  const T &v3attrib,
-                                                  const BarycentricWeights& bw,
-                                                  std::array<Vertex,3>& pv) const {
-    glm::vec2 v1(pv[0].m_pos.x, pv[0].m_pos.y);
-    glm::vec2 v2(pv[1].m_pos.x, pv[1].m_pos.y);
-    glm::vec2 v3(pv[2].m_pos.x, pv[2].m_pos.y);
+void Rasterizer::setupScreenTriangle(const std::array<Vertex,3>& verts, const std::array<glm::vec3,3>& world) {
+    SetupTriangle st;
+    st.verts = verts;
+    st.world = world;
+    if (!screenBounds(verts, m_width, m_height, &st.box)) {
+        m_stats.culledOffscreen++;
+        return;
+    }
 
-    float z1 = pv[0].m_pos.z;
-    float z2 = pv[1].m_pos.z;
-    float z3 = pv[2].m_pos.z;
+    const glm::vec2 a = glm::vec2(verts[1].m_pos) - glm::vec2(verts[0].m_pos);
+    const glm::vec2 b = glm::vec2(verts[2].m_pos) - glm::vec2(verts[0].m_pos);
+    const float twiceArea = a.x * b.y - a.y * b.x;
+    if (std::abs(twiceArea) < EPS * EPS) {
+        m_stats.culledDegenerate++;
+        return;
+    }
+    // counter-clockwise faces are the front, and pixel space flips y. a mirroring node turns them around
+    if (m_cullBackfaces && (twiceArea > 0) != m_mirrored) {
+        m_stats.culledBackface++;
+        return;
+    }
 
-    float s1 = bw.s1;
-    float s2 = bw.s2;
-    float s3 = bw.s3;
-    float pc_z = bw.pc_z;
+    // the barycentric coordinates as planes over the screen, with the first corner as origin
+    const glm::vec2 v0(verts[0].m_pos), v1(verts[1].m_pos), v2(verts[2].m_pos);
+    SpanSetup& s = st.span;
+    s.ox = v0.x;
+    s.oy = v0.y;
+    s.c[0] = 1.f;
+    s.c[1] = 0.f;
+    s.c[2] = 0.f;
+    s.dx[0] = (v1.y - v2.y) / twiceArea;
+    s.dy[0] = (v2.x - v1.x) / twiceArea;
+    s.dx[1] = (v2.y - v0.y) / twiceArea;
+    s.dy[1] = (v0.x - v2.x) / twiceArea;
+    s.dx[2] = (v0.y - v1.y) / twiceArea;
+    s.dy[2] = (v1.x - v0.x) / twiceArea;
+    for (int i = 0; i < 3; i++) {
+        s.invz[i] = 1.f / verts[i].m_pos.z;
+    }
 
-    return pc_z*((v1attrib*s1/z1) + (v2attrib*s2/z2) + (v3attrib*s3/z3));
+    m_stats.trianglesRasterized++;
+    new (&m_setupTris[m_setupCount++]) SetupTriangle(st);
 }
 
-void Rasterizer::RenderTriangle(const Polygon& p,
-                                const Triangle& t,
-                                std::array<Vertex,3>& proj_verts,
-                                QImage& result) {
-    // we have already computed all bounding boxes
-    if (t.offScreen) {/*LOG("OFFSCREEN");*/ return;}
+// moves the queued fragments to arrays with room for capacity of them. the old ones are left
+// to the arena, which gets them back with the rest of the polygon's scratch
+void Rasterizer::growFragments(size_t capacity) {
+    int* pixels = m_arena.Allocate<int>(capacity);
+    float* w0 = m_arena.Allocate<float>(capacity);
+    float* w1 = m_arena.Allocate<float>(capacity);
+    float* w2 = m_arena.Allocate<float>(capacity);
+    std::copy_n(m_fragPixels, m_fragCount, pixels);
+    std::copy_n(m_fragW0, m_fragCount, w0);
+    std::copy_n(m_fragW1, m_fragCount, w1);
+    std::copy_n(m_fragW2, m_fragCount, w2);
+    m_fragPixels = pixels;
+    m_fragW0 = w0;
+    m_fragW1 = w1;
+    m_fragW2 = w2;
+    m_fragCapacity = capacity;
+}
 
-    Vertex vert0 = proj_verts[0];
-    Vertex vert1 = proj_verts[1];
-    Vertex vert2 = proj_verts[2];
+void Rasterizer::rasterizeTriangles(int x0, int y0, int x1, int y1) {
+    m_fragCount = 0;
+    m_runCount = 0;
+    for (unsigned i = 0; i < m_setupCount; i++) {
+        if (cancelled()) {
+            return;
+        }
+        const BoundingBox& bb = m_setupTris[i].box;
+        if (bb.maxX <= x0 || bb.minX >= x1 || bb.maxY <= y0 || bb.minY >= y1) {
+            continue;
+        }
+        if (m_reprojecting && coveredByHistory(bb)) {
+            continue;  // every pixel it could touch was reprojected, with whatever of it shows there
+        }
+        rasterizeTriangle(i, x0, y0, x1, y1);
+    }
+}
+
+// walks the triangle's scanlines and depth tests every covered pixel. the ones that pass
+// are queued in the fragment arrays, in order, for shadeFragments
+void Rasterizer::rasterizeTriangle(unsigned index, int x0, int y0, int x1, int y1) {
+    const BoundingBox& bb = m_setupTris[index].box;
+    std::array<Vertex,3>& proj_verts = m_setupTris[index].verts;
+    const RasterKernels& kernels = Kernels();
+    const int begin = m_fragCount;
 
-    std::array<Segment, 3> segments = {Segment(vert0, vert1),
-                                       Segment(vert0, vert2),
-                                       Segment(vert1, vert2)};
+    std::array<Segment, 3> segments = {Segment(proj_verts[0], proj_verts[1]),
+                                       Segment(proj_verts[0], proj_verts[2]),
+                                       Segment(proj_verts[1], proj_verts[2])};
 
-    int yStart = (int)std::ceil(t.m_boundingBox.minY);  // should round up to nearest int
-    int yEnd = (int)std::ceil(t.m_boundingBox.maxY);
+    int yStart = (int)std::ceil(bb.minY);  // should round up to nearest int
+    int yEnd = (int)std::ceil(bb.maxY);
 
-    // does the bounding box go partially outside the screen? (it wouldn't entirely, because we would have set t.offScreen)
-    yStart = std::max(0, yStart);
-    yEnd = std::min((int)SCREEN_HEIGHT, yEnd);
+    // does the bounding box go partially outside the screen (or the tile)?
+    yStart = std::max(y0, yStart);
+    yEnd = std::min(y1, yEnd);
 
     for (int scanline = yStart; scanline < yEnd; scanline++) {
         // for every scanline, check all three segments of the triangle for intersection. have two stack floats to store them
-        float xLeft = SCREEN_WIDTH;
+        float xLeft = m_width;
         float xRight = 0.f;
 
         for (const Segment& segment : segments) {
             float xInt;
             if (segment.checkIntersection(scanline, &xInt)) {
-                if (t.m_boundingBox.minX <= xInt && xInt <= t.m_boundingBox.maxX) {
+                if (bb.minX <= xInt && xInt <= bb.maxX) {
                     xLeft = std::min(xLeft, xInt);
                     xRight = std::max(xRight, xInt);
                 }
@@ -165,79 +351,800 @@ void Rasterizer::RenderTriangle(const Polygon& p,
         int xStart = (int)std::ceil(xLeft);  // should round up to nearest int
         int xEnd = (int)std::ceil(xRight);
         // the bounding box could have been partially outside the screen, so one of these could be outside as well
-        xStart = std::max(0, xStart);
-        xEnd = std::min((int)SCREEN_WIDTH, xEnd);
+        xStart = std::max(x0, xStart);
+        xEnd = std::min(x1, xEnd);
+
+        if (xStart >= xEnd) {
+            continue;
+        }
+
+        const int row = scanline*m_width;
+        if (m_depthOnly) {
+            const int passed = kernels.depthSpan(m_setupTris[index].span, scanline, xStart, xEnd, &m_zbuffer[row]);
+            m_stats.pixelsTested += xEnd - xStart;
+            m_stats.depthFailed += (xEnd - xStart) - passed;
+            continue;
+        }
+
+        // room for the whole span, plus what the kernel may write past its end
+        const size_t needed = m_fragCount + (xEnd - xStart) + KERNEL_FRAGMENT_SLACK;
+        if (m_fragCapacity < needed) {
+            // the next polygons start out with this much too
+            growFragments(std::max(needed, 2 * m_fragCapacity));
+        }
+        if (m_renderMode == RenderMode::Overdraw) {
+            for (int x_i = xStart; x_i < xEnd; x_i++) {
+                m_pixelCounts[scanline*m_width + x_i]++;
+            }
+        }
+
+        const int before = m_fragCount;
+        m_fragCount = kernels.rasterSpan(m_setupTris[index].span, scanline, xStart, xEnd, &m_zbuffer[row], row,
+                                         {m_fragPixels, m_fragW0, m_fragW1, m_fragW2},
+                                         m_fragCount);
+        m_stats.pixelsTested += xEnd - xStart;
+        m_stats.depthFailed += (xEnd - xStart) - (m_fragCount - before);
+        if (m_reprojecting) {
+            // a reprojected pixel something got in front of is shaded like any other now
+            for (int k = before; k < m_fragCount; k++) {
+                m_reprojected[m_fragPixels[k]] = false;
+            }
+        }
+    }
+
+    if (m_fragCount > begin) {
+        m_fragRuns[m_runCount++] = {index, begin, m_fragCount};
+    }
+}
+
+// shades the queued fragments in the order they passed the depth test, so a pixel covered
+// twice ends up with the later, closer triangle, exactly as if it had been shaded right away
+void Rasterizer::shadeFragments(const Polygon& p) {
+    // SetTexture keeps textures in a 32 bit format, so the kernel can read the texels directly.
+    // a texture that failed to load samples as black, like QImage::pixel does
+    static const QRgb black = qRgb(0, 0, 0);
+    TextureView tex = {nullptr, 0, 0, 0};
+    if (p.mp_texture && m_previewShading) {
+        tex = {&p.m_textureAverage, 1, 1, 1};
+    } else if (p.mp_texture && p.mp_texture->isNull()) {
+        tex = {&black, 1, 1, 1};
+    } else if (p.mp_texture) {
+        tex = {reinterpret_cast<const QRgb*>(p.mp_texture->constBits()),
+               p.mp_texture->width(), p.mp_texture->height(), p.mp_texture->bytesPerLine() / 4};
+    }
+    const PackedNormalMap& nm = p.m_normalMap;
+    const NormalMapView nor = (nm.texels.empty() || m_previewShading)
+            ? NormalMapView{nullptr, 0, 0}
+            : NormalMapView{nm.texels.data(), nm.width, nm.height};
+
+    // every material gets its own loop, rather than one loop that checks what it has per fragment
+    using ShadeRuns = void (Rasterizer::*)(const TextureView&, const NormalMapView&);
+    static constexpr ShadeRuns variants[SHADE_VARIANTS] = SHADE_KERNELS(&Rasterizer::shadeRuns);
+    const unsigned features = (tex.bits ? SHADE_TEXTURE : 0u) | (nor.texels ? SHADE_NORMAL_MAP : 0u)
+                            | (p.HasVertexColors() ? SHADE_VERTEX_COLOR : 0u) | (m_lightPass ? SHADE_GBUFFER : 0u);
+    (this->*variants[features])(tex, nor);
 
+    m_stats.pixelsShaded += m_fragCount;
+    if (m_renderMode == RenderMode::ShadedCount) {
+        for (int i = 0; i < m_fragCount; i++) {
+            m_pixelCounts[m_fragPixels[i]]++;
+        }
+    }
+    if (p.mp_texture && !m_previewShading) {
+        m_stats.textureFetches += m_fragCount;
+    }
+}
+
+template <unsigned F>
+void Rasterizer::shadeRuns(const TextureView& tex, const NormalMapView& nor) {
+    constexpr bool uv = (F & (SHADE_TEXTURE | SHADE_NORMAL_MAP)) != 0;
+    constexpr bool normalMap = (F & SHADE_NORMAL_MAP) != 0;
+    const glm::vec4 light_dir = glm::normalize(-m_camera.m_forward);
+    const glm::vec3 light = glm::vec3(light_dir);
+    const GBufferView g = (F & SHADE_GBUFFER) ? gbuffer() : GBufferView{};
+
+    const auto shade = Kernels().shade[F];
+    const FragmentArrays frags = {m_fragPixels, m_fragW0, m_fragW1, m_fragW2};
+    for (int r = 0; r < m_runCount; r++) {
+        const FragmentRun& run = m_fragRuns[r];
+        const SetupTriangle& st = m_setupTris[run.tri];
+        const std::array<Vertex,3>& verts = st.verts;
+        ShadeSetup s;
+        for (int i = 0; i < 3; i++) {
+            if constexpr (uv) {
+                s.u[i] = verts[i].m_uv[0];
+                s.v[i] = verts[i].m_uv[1];
+            }
+            if constexpr ((F & SHADE_VERTEX_COLOR) != 0) {
+                for (int c = 0; c < 3; c++) {
+                    s.rgb[c][i] = verts[i].m_color[c] / 255.f;
+                }
+            }
+            // with a normal map the light is taken into each vertex's tangent frame, so per pixel
+            // only the sampled normal is left to dot with it
+            glm::vec3 tangent(0.f), bitangent(0.f);
+            if constexpr (normalMap) {
+                const glm::vec4 t = UnpackTangent(verts[i].m_tangent);
+                tangent = glm::vec3(t);
+                bitangent = t.w * glm::cross(glm::vec3(verts[i].m_normal), tangent);
+            }
+            if constexpr ((F & SHADE_GBUFFER) != 0) {
+                for (int a = 0; a < 3; a++) {
+                    s.n[a][i] = verts[i].m_normal[a];
+                    s.p[a][i] = st.world[i][a];
+                    if constexpr (normalMap) {
+                        s.t[a][i] = tangent[a];
+                        s.b[a][i] = bitangent[a];
+                    }
+                }
+            } else {
+                s.ndl[i] = glm::dot(verts[i].m_normal, light_dir);
+                if constexpr (normalMap) {
+                    s.tdl[i] = glm::dot(tangent, light);
+                    s.bdl[i] = glm::dot(bitangent, light);
+                }
+            }
+        }
+        shade(s, tex, nor, g, frags, run.begin, run.end, mp_colorbuffer);
+    }
+}
 
-        for (int x_i = xStart; x_i < xEnd; x_i++) {
+GBufferView Rasterizer::gbuffer() {
+    return {{m_gNormal[0], m_gNormal[1], m_gNormal[2]},
+            {m_gPosition[0], m_gPosition[1], m_gPosition[2]}};
+}
 
-            // BarycentricWeights bw = ComputeBarycentricWeights(p, t, glm::vec2(x_i, scanline));
-            // FOR 3D: compute cand_z using bw
-            const BarycentricWeights pc_bw = perspectiveCorrectBarycentricWeights(t, proj_verts, glm::vec2(x_i, scanline));
+static LightSetup setupLight(const Light& l) {
+    LightSetup s;
+    for (int a = 0; a < 3; a++) {
+        s.pos[a] = l.position[a];
+        s.color[a] = l.color[a];
+        s.axis[a] = 0.f;
+    }
+    s.invRange = 1.f / l.range;
+    s.shadow = nullptr;
+    // a point light's cone test always comes out above 1
+    s.coneCos = -2.f;
+    s.coneScale = 1.f;
+    if (l.type == Light::Type::Spot) {
+        for (int a = 0; a < 3; a++) {
+            s.axis[a] = -l.direction[a];
+        }
+        s.coneCos = std::cos(glm::radians(l.outerAngle));
+        s.coneScale = 1.f / std::max(std::cos(glm::radians(l.innerAngle)) - s.coneCos, 1e-4f);
+    }
+    return s;
+}
 
-            if (!ConsultAndWriteToZBuffer(x_i, scanline, pc_bw.pc_z)) {
+// the views a shadow casting light renders its depth from
+static void shadowViews(const Light& l, std::vector<Camera>* views) {
+    views->clear();
+    const glm::vec4 eye(l.position, 1.f);
+    const float near = l.range * SHADOW_NEAR_RATIO;
+    if (l.type == Light::Type::Spot && l.outerAngle <= SHADOW_MAX_SPOT_DEG) {
+        // a degree to spare around the cone. the up vector only has to be off the axis
+        const glm::vec3 up = std::abs(l.direction.y) < 0.9f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f);
+        views->push_back(Camera::LookAt(eye, eye + glm::vec4(l.direction, 0.f), glm::vec4(up, 0.f),
+                                        2 * l.outerAngle + 2, near, l.range, 1.f));
+        return;
+    }
+    static const glm::vec3 axes[6] = {{1.f, 0.f, 0.f}, {-1.f, 0.f, 0.f}, {0.f, 1.f, 0.f},
+                                      {0.f, -1.f, 0.f}, {0.f, 0.f, 1.f}, {0.f, 0.f, -1.f}};
+    for (const glm::vec3& axis : axes) {
+        const glm::vec3 up = axis.y == 0.f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(0.f, 0.f, 1.f);
+        views->push_back(Camera::LookAt(eye, eye + glm::vec4(axis, 0.f), glm::vec4(up, 0.f), 90.f, near, l.range, 1.f));
+    }
+}
+
+// whether a shadow map rendered for a still fits b. the color doesn't matter
+static bool sameShadowCaster(const Light& a, const Light& b) {
+    return a.type == b.type && a.position == b.position && a.range == b.range
+            && (a.type == Light::Type::Point || (a.direction == b.direction && a.outerAngle == b.outerAngle));
+}
+
+bool Rasterizer::updateShadowMaps() {
+    // the setups point into the maps' depth, so adding a map must never move the others. they
+    // would be copied rather than moved, leaving the cached maps' setups dangling
+    m_shadowMaps.reserve(SHADOW_MAX_LIGHTS);
+    size_t count = 0;
+    for (const Light& l : m_lights) {
+        if (!l.castsShadows) {
+            continue;
+        }
+        if (count == SHADOW_MAX_LIGHTS) {
+            break;
+        }
+        if (count == m_shadowMaps.size()) {
+            m_shadowMaps.emplace_back();
+        }
+        ShadowMap& map = m_shadowMaps[count++];
+        if (map.valid && sameShadowCaster(map.light, l) && map.sceneGeneration == m_sceneGraph.Generation()) {
+            continue;
+        }
+
+        map.valid = false;
+        map.light = l;
+        map.sceneGeneration = m_sceneGraph.Generation();
+        shadowViews(l, &map.views);
+        const int size = map.views.size() == 1 ? SHADOW_MAP_SIZE : SHADOW_CUBE_SIZE;
+        if (!mp_shadowRasterizer) {
+            mp_shadowRasterizer = std::make_unique<Rasterizer>(mp_polygons);
+        }
+        Rasterizer& r = *mp_shadowRasterizer;
+        r.m_cancel = m_cancel;
+        r.m_sceneGraph = m_sceneGraph;
+        r.SetResolution(size, size);
+        map.depth.resize(map.views.size());
+        map.setups.resize(map.views.size());
+        for (size_t v = 0; v < map.views.size(); v++) {
+            r.m_camera = map.views[v];
+            if (!r.RenderDepth()) {
+                m_cancelled = true;
+                return false;
+            }
+            // the rasterizer's depth becomes the map, and the map's old depth its next target
+            map.depth[v].swap(r.m_zbuffer);
+            m_stats.shadowViewsRendered++;
+            m_stats.shadowTriangles += r.m_stats.trianglesRasterized;
+
+            ShadowSetup& st = map.setups[v];
+            const glm::mat4 view_proj = r.m_camera.perspProjMatrix() * r.m_camera.viewMatrix();
+            std::copy(&view_proj[0][0], &view_proj[0][0] + 16, st.viewProj);
+            for (int a = 0; a < 3; a++) {
+                st.lightPos[a] = l.position[a];
+            }
+            // a texel spans this much per unit of distance from the light
+            st.offset = SHADOW_OFFSET_TEXELS * 2 * std::tan(glm::radians(r.m_camera.m_fov / 2)) / size;
+            st.depth = map.depth[v].data();
+            st.size = size;
+        }
+        map.valid = true;
+    }
+    m_shadowMaps.resize(count);
+    return true;
+}
+
+void Rasterizer::lightPass(const glm::mat4& view_proj) {
+    const int tilesX = (m_width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    const int tilesY = (m_height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+
+    // bound each light's sphere of influence by the corners of its box. once they're all in
+    // front of the camera their projection bounds it on screen and in depth, and a light
+    // crossing the near plane can reach anywhere
+    m_lightSetups = m_arena.Allocate<LightSetup>(m_lights.size());
+    m_lightBounds = m_arena.Allocate<LightBounds>(m_lights.size());
+    m_tileLights = m_arena.Allocate<int>(m_lights.size());
+    m_lightCount = 0;
+    const int filter = std::min(std::max(m_shadowFilter, 0), SHADOW_MAX_FILTER);
+    for (size_t i = 0; i < m_shadowMaps.size(); i++) {
+        m_shadowVisibility[i] = m_arena.Allocate<float>(size_t(m_width) * m_height);
+    }
+    int casters = 0;
+    for (const Light& l : m_lights) {
+        // the first shadow casters got a map, whether they show up or not
+        const int shadow = l.castsShadows && casters < int(m_shadowMaps.size()) ? casters++ : -1;
+        glm::vec2 lo(std::numeric_limits<float>::infinity()), hi(-std::numeric_limits<float>::infinity());
+        float zmin = std::numeric_limits<float>::infinity(), zmax = -std::numeric_limits<float>::infinity();
+        int behind = 0;
+        for (int c = 0; c < 8; c++) {
+            const glm::vec3 corner = l.position + l.range * glm::vec3(c & 1 ? 1.f : -1.f, c & 2 ? 1.f : -1.f, c & 4 ? 1.f : -1.f);
+            const glm::vec4 clip = view_proj * glm::vec4(corner, 1.f);
+            if (clip.w <= 0.f || clip.z < NEAR_CLIP_Z * clip.w) {
+                behind++;
                 continue;
             }
-            float u = perspectiveCorrectInterpolateAttrib(vert0.m_uv[0],
-                                                          vert1.m_uv[0],
-                                                          vert2.m_uv[0],
-                                                          pc_bw,
-                                                          proj_verts);
-            float v = perspectiveCorrectInterpolateAttrib(vert0.m_uv[1],
-                                                          vert1.m_uv[1],
-                                                          vert2.m_uv[1],
-                                                          pc_bw,
-                                                          proj_verts);
-            glm::vec4 normal = perspectiveCorrectInterpolateAttrib(vert0.m_normal,
-                                                                   vert1.m_normal,
-                                                                   vert2.m_normal,
-                                                                   pc_bw,
-                                                                   proj_verts);
-            float lambda = glm::clamp(glm::dot(normal, glm::normalize(-m_camera.m_forward)), 0.f, 1.f)*0.7 + 0.3;
+            const glm::vec4 px = clipToPixel(clip, m_width, m_height);
+            lo = glm::min(lo, glm::vec2(px));
+            hi = glm::max(hi, glm::vec2(px));
+            zmin = std::min(zmin, px.z);
+            zmax = std::max(zmax, px.z);
+        }
+        if (behind == 8) {
+            continue;
+        }
+        LightBounds b = {0, 0, tilesX - 1, tilesY - 1, 0.f, std::numeric_limits<float>::infinity(), shadow};
+        if (behind == 0) {
+            if (hi.x < 0 || hi.y < 0 || lo.x >= m_width || lo.y >= m_height) {
+                continue;
+            }
+            b.tx0 = std::max(0, int(lo.x) / LIGHT_TILE_SIZE);
+            b.ty0 = std::max(0, int(lo.y) / LIGHT_TILE_SIZE);
+            b.tx1 = std::min(tilesX - 1, int(hi.x) / LIGHT_TILE_SIZE);
+            b.ty1 = std::min(tilesY - 1, int(hi.y) / LIGHT_TILE_SIZE);
+            b.zmin = zmin;
+            b.zmax = zmax;
+        }
+        m_lightSetups[m_lightCount] = setupLight(l);
+        m_lightBounds[m_lightCount] = b;
+        if (shadow >= 0) {
+            m_lightSetups[m_lightCount].shadow = m_shadowVisibility[shadow];
+            for (ShadowSetup& st : m_shadowMaps[shadow].setups) {
+                st.radius = filter;
+            }
+        }
+        m_lightCount++;
+    }
 
-            glm::vec3 color = GetImageColor({u,v}, p.mp_texture)*lambda;
-            int r = static_cast<int>(std::clamp(std::lround(color[0]), 0l, 255l));
-            int g = static_cast<int>(std::clamp(std::lround(color[1]), 0l, 255l));
-            int b = static_cast<int>(std::clamp(std::lround(color[2]), 0l, 255l));
+    m_stats.lightsVisible = m_lightCount;
 
-            result.setPixelColor(x_i, scanline, QColor(r,g,b));
+    // the kernels leave pixels with a depth of 0 alone, which is what the reprojected ones that
+    // nothing was drawn over get: their color is lit already, and they have nothing in the g-buffer
+    const float* depth = m_zbuffer.data();
+    if (m_reprojecting) {
+        float* const masked = m_arena.Allocate<float>(m_zbuffer.size());
+        for (size_t i = 0; i < m_zbuffer.size(); i++) {
+            masked[i] = m_reprojected[i] ? 0.f : m_zbuffer[i];
+        }
+        depth = masked;
+    }
+
+    const RasterKernels& kernels = Kernels();
+    const GBufferView g = gbuffer();
+    for (int ty = 0; ty < tilesY; ty++) {
+        if (cancelled()) {
+            return;
+        }
+        for (int tx = 0; tx < tilesX; tx++) {
+            const int x0 = tx * LIGHT_TILE_SIZE, y0 = ty * LIGHT_TILE_SIZE;
+            const int x1 = std::min(x0 + LIGHT_TILE_SIZE, m_width), y1 = std::min(y0 + LIGHT_TILE_SIZE, m_height);
+            // the depth range of the tile's drawn pixels. reprojected ones keep their lit color
+            float zmin = std::numeric_limits<float>::infinity(), zmax = 0.f;
+            int lit = 0;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    const float z = depth[y*m_width + x];
+                    if (z > 0.f && z < std::numeric_limits<float>::infinity()) {
+                        zmin = std::min(zmin, z);
+                        zmax = std::max(zmax, z);
+                        lit++;
+                    }
+                }
+            }
+            if (lit == 0) {
+                continue;
+            }
+            int tileLights = 0;
+            for (int i = 0; i < m_lightCount; i++) {
+                const LightBounds& b = m_lightBounds[i];
+                if (tx >= b.tx0 && tx <= b.tx1 && ty >= b.ty0 && ty <= b.ty1 && b.zmin <= zmax && b.zmax >= zmin) {
+                    m_tileLights[tileLights++] = i;
+                }
+            }
+            m_stats.lightEvaluations += lit * tileLights;
+            // the shadowed lights' visibility, for the light kernel to pick up. each pixel gets it
+            // from the view that sees it, and a spot light doesn't reach the pixels outside its view
+            for (int l = 0; l < tileLights; l++) {
+                const int shadow = m_lightBounds[m_tileLights[l]].shadow;
+                if (shadow < 0) {
+                    continue;
+                }
+                float* visibility = m_shadowVisibility[shadow];
+                for (int y = y0; y < y1; y++) {
+                    std::fill(visibility + y*m_width + x0, visibility + y*m_width + x1, 1.f);
+                }
+                for (const ShadowSetup& st : m_shadowMaps[shadow].setups) {
+                    kernels.shadow(st, g, depth, m_width, x0, y0, x1, y1, visibility);
+                }
+                m_stats.shadowLookups += lit;
+            }
+            kernels.light(m_lightSetups, m_tileLights, tileLights, LIGHT_AMBIENT, g,
+                          depth, m_width, x0, y0, x1, y1, mp_colorbuffer);
         }
     }
 }
 
+void Rasterizer::InvalidateHistory() {
+    m_history.valid = false;
+}
+
+bool Rasterizer::reprojectHistory(const glm::mat4& view_proj) {
+    const History& h = m_history;
+    if (!h.valid || h.width != m_width || h.height != m_height || h.framesSince >= TEMPORAL_REFRESH_FRAMES
+            || h.sceneGeneration != m_sceneGraph.Generation()) {
+        return false;
+    }
+    const float turn = glm::dot(glm::normalize(glm::vec3(h.forward)), glm::normalize(glm::vec3(m_camera.m_forward)));
+    if (turn < std::cos(glm::radians(TEMPORAL_MAX_LIGHT_DEG))) {
+        return false;
+    }
+
+    // old pixel (x, y) with depth d sits at ndc (2x/W - 1, 1 - 2y/H, d). carry it into the new view
+    // and keep the closest of whatever lands on each new pixel.
+    // in double, since the inverse of a projection with a distant far plane loses too much in float
+    const glm::mat4 reproject = glm::mat4(glm::dmat4(view_proj) * glm::inverse(glm::dmat4(h.viewProj)));
+    const glm::vec4 stepX = reproject[0] * (2.f / m_width);
+    const float W = float(m_width), H = float(m_height);
+    const float inf = std::numeric_limits<float>::infinity();
+    for (int y = 0; y < m_height; y++) {
+        const glm::vec4 row = reproject * glm::vec4(-1.f, 1 - 2*y/H, 0.f, 1.f);
+        for (int x = 0; x < m_width; x++) {
+            const float d = h.depth[y*m_width + x];
+            if (d == inf) {
+                continue;
+            }
+            const glm::vec4 p = row + stepX * float(x) + reproject[2] * d;
+            if (p.w <= 0) {
+                continue;
+            }
+            const float invw = 1.f / p.w;
+            const float z = p.z * invw;
+            // rounded to the nearest pixel. the bounds are checked before the int conversion,
+            // which would round towards zero
+            const float fx = (p.x*invw + 1) * (W/2) + 0.5f;
+            const float fy = (1 - p.y*invw) * (H/2) + 0.5f;
+            if (z < NEAR_CLIP_Z || !(fx >= 0 && fx < W && fy >= 0 && fy < H)) {
+                continue;
+            }
+            const int i = int(fy)*m_width + int(fx);
+            if (z < m_zbuffer[i]) {
+                m_zbuffer[i] = z;
+                mp_colorbuffer[i] = h.color[y*m_width + x];
+            }
+        }
+    }
+
+    // surfaces that got closer spread out and leave one pixel cracks between the splats.
+    // close those that lie within one surface, so only real holes are left to rasterize.
+    // ndc depth goes like 1 - near/w, so a relative step in w is the same step scaled by 1 - z
+    auto sameSurface = [inf](float a, float b) {
+        return a != inf && b != inf && std::abs(a - b) < CRACK_MAX_DEPTH_RATIO * (1 - std::min(a, b));
+    };
+    for (int y = 1; y < m_height - 1; y++) {
+        for (int x = 1; x < m_width - 1; x++) {
+            const int i = y*m_width + x;
+            if (m_zbuffer[i] != inf) {
+                continue;
+            }
+            int from = -1;
+            if (sameSurface(m_zbuffer[i - 1], m_zbuffer[i + 1])) {
+                from = i - 1;
+            } else if (sameSurface(m_zbuffer[i - m_width], m_zbuffer[i + m_width])) {
+                from = i - m_width;
+            }
+            if (from >= 0) {
+                m_zbuffer[i] = m_zbuffer[from];
+                mp_colorbuffer[i] = mp_colorbuffer[from];
+            }
+        }
+    }
+
+    // reprojected geometry keeps its depth, so only what is in front of it draws over it.
+    // the holes nothing landed on (disocclusions, and the edges the camera moved towards) are
+    // open to rasterization, as well as the background, where something might show now. the
+    // background costs nothing unless a triangle covers it, so only what is open beyond the
+    // old background counts as invalid
+    const size_t pixels = m_zbuffer.size();
+    const int tilesX = (m_width + TEMPORAL_TILE_SIZE - 1) / TEMPORAL_TILE_SIZE;
+    const int tilesY = (m_height + TEMPORAL_TILE_SIZE - 1) / TEMPORAL_TILE_SIZE;
+    m_tileOpen = m_arena.Allocate<unsigned>(tilesX * tilesY);
+    std::fill_n(m_tileOpen, tilesX * tilesY, 0u);
+    m_reprojected = m_arena.Allocate<bool>(pixels);
+    size_t open = 0;
+    for (int y = 0; y < m_height; y++) {
+        for (int x = 0; x < m_width; x++) {
+            const int i = y*m_width + x;
+            m_reprojected[i] = m_zbuffer[i] != inf;
+            if (!m_reprojected[i]) {
+                open++;
+                m_tileOpen[(y/TEMPORAL_TILE_SIZE)*tilesX + x/TEMPORAL_TILE_SIZE]++;
+            }
+        }
+    }
+    if (open > h.background + TEMPORAL_MAX_INVALID * pixels) {
+        resetZBuffer();
+        std::fill_n(mp_colorbuffer, pixels, qRgb(0, 0, 0));
+        return false;
+    }
+    m_stats.pixelsReused = pixels - open;
+    return true;
+}
+
+bool Rasterizer::coveredByHistory(const BoundingBox& bb) const {
+    const int tilesX = (m_width + TEMPORAL_TILE_SIZE - 1) / TEMPORAL_TILE_SIZE;
+    const int tx0 = std::max(0, (int)bb.minX) / TEMPORAL_TILE_SIZE;
+    const int ty0 = std::max(0, (int)bb.minY) / TEMPORAL_TILE_SIZE;
+    const int tx1 = std::min(m_width - 1, (int)bb.maxX) / TEMPORAL_TILE_SIZE;
+    const int ty1 = std::min(m_height - 1, (int)bb.maxY) / TEMPORAL_TILE_SIZE;
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            if (m_tileOpen[ty*tilesX + tx] != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Rasterizer::finishHistory(const glm::mat4& view_proj) {
+    History& h = m_history;
+    const size_t pixels = m_zbuffer.size();
+    if (m_reprojecting) {
+        h.framesSince++;
+        return;
+    }
+    h.valid = true;
+    h.width = m_width;
+    h.height = m_height;
+    h.viewProj = view_proj;
+    h.forward = m_camera.m_forward;
+    h.sceneGeneration = m_sceneGraph.Generation();
+    h.framesSince = 0;
+    h.color.assign(mp_colorbuffer, mp_colorbuffer + pixels);
+    h.depth.assign(m_zbuffer.begin(), m_zbuffer.end());
+    h.background = std::count(h.depth.begin(), h.depth.end(), std::numeric_limits<float>::infinity());
+}
+
+bool Rasterizer::cancelled() {
+    m_cancelled = m_cancelled || (m_cancel && m_cancel());
+    return m_cancelled;
+}
+
+// replaces the shaded colors with the heatmap of the current mode
+void Rasterizer::drawHeatmap() {
+    if (m_renderMode == RenderMode::TileTime) {
+        const int tilesX = (m_width + HEATMAP_TILE_SIZE - 1) / HEATMAP_TILE_SIZE;
+        const int tilesY = (m_height + HEATMAP_TILE_SIZE - 1) / HEATMAP_TILE_SIZE;
+        const double slowest = *std::max_element(m_tileTimes, m_tileTimes + tilesX * tilesY);
+        for (int y = 0; y < m_height; y++) {
+            for (int x = 0; x < m_width; x++) {
+                const double t = m_tileTimes[(y/HEATMAP_TILE_SIZE)*tilesX + x/HEATMAP_TILE_SIZE];
+                // a thin grid, so neighbouring tiles of similar cost stay apart
+                const bool edge = x % HEATMAP_TILE_SIZE == 0 || y % HEATMAP_TILE_SIZE == 0;
+                mp_colorbuffer[y*m_width + x] = edge ? qRgb(0, 0, 0)
+                                                              : heatmapColor(slowest > 0 ? float(t / slowest) : 0.f);
+            }
+        }
+        return;
+    }
+    for (size_t i = 0; i < m_zbuffer.size(); i++) {
+        // untouched pixels stay black, so the silhouette is still readable
+        mp_colorbuffer[i] = m_pixelCounts[i] == 0 ? qRgb(0, 0, 0)
+                                                 : heatmapColor((m_pixelCounts[i] - 1) / (HEATMAP_MAX_COUNT - 1));
+    }
+}
+
+bool Rasterizer::depthPass(const glm::mat4& view_proj) {
+    m_depthOnly = true;
+    for (const Polygon &p : *mp_polygons) {
+        if (cancelled()) {
+            break;
+        }
+        const FrameArena::Scope scratch(m_arena);
+        transformVertices(p, view_proj);
+        setupTriangles(p);
+        rasterizeTriangles(0, 0, m_width, m_height);
+    }
+    m_depthOnly = false;
+    return !cancelled();
+}
+
+bool Rasterizer::RenderDepth()
+{
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    const AllocationScope allocations;
+    m_stats = RenderStats();
+    m_cancelled = false;
+    m_reprojecting = false;
+    m_zbuffer.resize(size_t(m_width) * m_height);
+    resetZBuffer();
+    m_arena.Reset();
+    m_sceneGraph.Update();
+    // the corners carry their view depth instead of the ndc one, see setupTriangles. its
+    // reciprocal is linear on screen, so the depth the raster kernel interpolates is exact
+    m_viewDepth = true;
+    const bool done = depthPass(m_camera.perspProjMatrix() * m_camera.viewMatrix());
+    m_viewDepth = false;
+    m_stats.depthMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    m_stats.allocations = allocations.Count();
+    m_stats.allocatedBytes = allocations.Bytes();
+    return done;
+}
 
 QImage Rasterizer::RenderScene()
 {
+    QImage image;
+    return RenderScene(&image) ? image : QImage();
+}
+
+bool Rasterizer::RenderScene(QImage* target)
+{
+    const AllocationScope allocations;
+    const bool done = renderScene(target);
+    m_stats.allocations = allocations.Count();
+    m_stats.allocatedBytes = allocations.Bytes();
+    return done;
+}
+
+bool Rasterizer::renderScene(QImage* target)
+{
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+
+    m_stats = RenderStats();
+    m_cancelled = false;
+
+    const Clock::time_point clearStart = Clock::now();
+    const size_t pixels = size_t(m_width) * m_height;
+    if (target->width() != m_width || target->height() != m_height
+            || target->format() != QImage::Format_RGB32) {
+        *target = QImage(m_width, m_height, QImage::Format_RGB32);
+    }
+    // RGB32 rows need no padding, so the image is one contiguous buffer
+    mp_colorbuffer = reinterpret_cast<QRgb*>(target->bits());
+    if (m_zbuffer.size() != pixels) {
+        m_zbuffer.resize(pixels);
+    }
     resetZBuffer();
-    QImage result(512, 512, QImage::Format_RGB32);
     // Fill the image with black pixels.
+    std::fill_n(mp_colorbuffer, pixels, qRgb(0, 0, 0));
+    // drops the last frame's scratch all at once
+    m_arena.Reset();
+    m_stats.clearMs = ms(clearStart, Clock::now());
 
-    result.fill(qRgb(0.f, 0.f, 0.f));
+    // only the nodes that moved since the last frame are recomputed
+    const Clock::time_point graphStart = Clock::now();
+    m_sceneGraph.Update();
+    m_stats.transformMs = ms(graphStart, Clock::now());
 
-    std::cout << "rerendered" << std::endl;
     // printCamera(m_camera);
-    glm::mat4 view_mat = m_camera.viewMatrix();
-    glm::mat4 proj_mat = m_camera.perspProjMatrix();
+    // a pixel is 2/size in ndc, whose y points up the screen
+    const glm::mat4 jitter = glm::translate(glm::mat4(1.f), glm::vec3(2*m_jitter.x / m_width, -2*m_jitter.y / m_height, 0.f));
+    const glm::mat4 view_proj = jitter * m_camera.perspProjMatrix() * m_camera.viewMatrix();
+
+    const bool temporal = m_temporal && m_renderMode == RenderMode::Shaded && !m_previewShading
+            && m_jitter == glm::vec2(0.f);
+    m_reprojecting = false;
+    if (temporal) {
+        const Clock::time_point reprojectStart = Clock::now();
+        m_reprojecting = reprojectHistory(view_proj);
+        m_stats.reprojectMs = ms(reprojectStart, Clock::now());
+    }
+
+    m_lightPass = !m_lights.empty() && m_renderMode == RenderMode::Shaded;
+    if (m_lightPass) {
+        for (int a = 0; a < 3; a++) {
+            m_gNormal[a] = m_arena.Allocate<float>(pixels);
+            m_gPosition[a] = m_arena.Allocate<float>(pixels);
+        }
+    }
 
+    if (m_depthPrepass) {
+        const Clock::time_point depthStart = Clock::now();
+        if (!depthPass(view_proj)) {
+            return false;
+        }
+        // every pixel's final depth, nudged one step further away: whatever is behind it still
+        // fails against it, and the first triangle that ends up in front passes once and puts it back
+        const float inf = std::numeric_limits<float>::infinity();
+        for (float& z : m_zbuffer) {
+            if (z > 0.f && z < inf) {
+                z = std::nextafter(z, inf);
+            }
+        }
+        m_stats.depthMs = ms(depthStart, Clock::now());
+    }
+
+    const int tilesX = (m_width + HEATMAP_TILE_SIZE - 1) / HEATMAP_TILE_SIZE;
+    const int tilesY = (m_height + HEATMAP_TILE_SIZE - 1) / HEATMAP_TILE_SIZE;
+    if (m_renderMode == RenderMode::Overdraw || m_renderMode == RenderMode::ShadedCount) {
+        m_pixelCounts = m_arena.Allocate<unsigned>(pixels);
+        std::fill_n(m_pixelCounts, pixels, 0u);
+    }
+    if (m_renderMode == RenderMode::TileTime) {
+        m_tileTimes = m_arena.Allocate<double>(tilesX * tilesY);
+        std::fill_n(m_tileTimes, tilesX * tilesY, 0.0);
+    }
 
-    for (Polygon &p : this->m_polygons) {
-        for (const Triangle &t : p.m_tris) {
-            // after this, the single triangle will be projected to screen space, its vertices inside proj_verts.
-            std::array<Vertex, 3> proj_verts;
-            Triangle proj_tri = projectTriangleFromWorldtoPixelSpace(proj_mat, view_mat, p, t, proj_verts);
+    for (const Polygon &p : *mp_polygons) {
+        if (cancelled()) {
+            return false;
+        }
+        // what the polygon leaves in the arena is gone by the next one
+        const FrameArena::Scope scratch(m_arena);
+        const Clock::time_point t0 = Clock::now();
+        transformVertices(p, view_proj);
+        const Clock::time_point t1 = Clock::now();
+        setupTriangles(p);
+        const Clock::time_point t2 = Clock::now();
+        m_stats.transformMs += ms(t0, t1);
+        m_stats.setupMs += ms(t1, t2);
 
-            // now proj_tri's bounding boxes are initialized
-            p.computeBoundingBoxes(proj_tri, proj_verts);
+        if (m_renderMode != RenderMode::TileTime) {
+            rasterizeTriangles(0, 0, m_width, m_height);
+            const Clock::time_point t3 = Clock::now();
+            shadeFragments(p);
+            m_stats.rasterMs += ms(t2, t3);
+            m_stats.shadeMs += ms(t3, Clock::now());
+            continue;
+        }
 
-            RenderTriangle(p, proj_tri, proj_verts, result);
+        // one tile at a time, so each tile's share of the work can be timed on its own
+        for (int ty = 0; ty < tilesY; ty++) {
+            for (int tx = 0; tx < tilesX; tx++) {
+                const int x0 = tx * HEATMAP_TILE_SIZE;
+                const int y0 = ty * HEATMAP_TILE_SIZE;
+                const Clock::time_point r0 = Clock::now();
+                rasterizeTriangles(x0, y0,
+                                   std::min(x0 + HEATMAP_TILE_SIZE, m_width),
+                                   std::min(y0 + HEATMAP_TILE_SIZE, m_height));
+                const Clock::time_point r1 = Clock::now();
+                shadeFragments(p);
+                const Clock::time_point r2 = Clock::now();
+                m_stats.rasterMs += ms(r0, r1);
+                m_stats.shadeMs += ms(r1, r2);
+                m_tileTimes[ty*tilesX + tx] += ms(r0, r2);
+            }
         }
     }
 
+    // the last polygon may have been cut short
+    if (cancelled()) {
+        return false;
+    }
+    if (m_lightPass) {
+        const Clock::time_point shadowStart = Clock::now();
+        if (!updateShadowMaps()) {
+            return false;
+        }
+        const Clock::time_point lightStart = Clock::now();
+        m_stats.shadowMs = ms(shadowStart, lightStart);
+        lightPass(view_proj);
+        m_stats.lightMs = ms(lightStart, Clock::now());
+        if (cancelled()) {
+            return false;
+        }
+    }
+    if (m_renderMode != RenderMode::Shaded) {
+        drawHeatmap();
+    }
+    if (temporal) {
+        const Clock::time_point storeStart = Clock::now();
+        finishHistory(view_proj);
+        m_stats.reprojectMs += ms(storeStart, Clock::now());
+    }
+    return true;
+}
 
-    return result;
+MemoryStats Rasterizer::Memory() const {
+    MemoryStats m;
+    for (const Polygon& p : *mp_polygons) {
+        m.objects.push_back({p.m_name.toStdString(), p.Memory()});
+        m.scene += m.objects.back().bytes;
+    }
+
+    MemoryBytes& c = m.context;
+    c[MemoryCategory::Framebuffers] = CapacityBytes(m_zbuffer) + CapacityBytes(m_history.color)
+                                    + CapacityBytes(m_history.depth);
+    c[MemoryCategory::Scratch] = m_arena.Capacity() + CapacityBytes(m_shadowMaps);
+    for (const ShadowMap& map : m_shadowMaps) {
+        for (const std::vector<float>& depth : map.depth) {
+            c[MemoryCategory::Framebuffers] += CapacityBytes(depth);
+        }
+        c[MemoryCategory::Scratch] += CapacityBytes(map.views) + CapacityBytes(map.depth) + CapacityBytes(map.setups);
+    }
+    if (mp_shadowRasterizer) {
+        c += mp_shadowRasterizer->Memory().context;
+    }
+    return m;
 }
 
 void Rasterizer::ClearScene()
 {
-    m_polygons.clear();
+    mp_polygons->clear();
+    InvalidateHistory();
+    for (ShadowMap& map : m_shadowMaps) {
+        map.valid = false;
+    }
+}
+
+void Rasterizer::AddPolygon(Polygon&& p)
+{
+    mp_polygons->push_back(std::move(p));
+    InvalidateHistory();
+    for (ShadowMap& map : m_shadowMaps) {
+        map.valid = false;
+    }
 }
@@ -4,36 +4,116 @@
 
 #include "constants.h"
 #include <vector>
+#include <memory>
+#include <functional>
+#include <array>
 #include "camera.h"
+#include "light.h"
+#include "framearena.h"
+#include "memorystats.h"
+#include "renderstats.h"
+#include "scenegraph.h"
+#include "kernels.h"
+
+// what RenderScene puts in the image
+enum class RenderMode {
+    Shaded,       // the lit, textured scene
+    Overdraw,     // depth tests per pixel, up to HEATMAP_MAX_COUNT
+    ShadedCount,  // fragments shaded per pixel, up to HEATMAP_MAX_COUNT
+    TileTime,     // time spent rasterizing and shading each tile, relative to the slowest tile
+};
 
 class Rasterizer
 {
 private:
-    //This is the set of Polygons loaded from a JSON scene file
-    std::vector<Polygon> m_polygons;
+    //This is the set of Polygons loaded from a JSON scene file.
+    //Rendering only reads it, so several Rasterizers (e.g. batch workers) can share one scene
+    std::shared_ptr<std::vector<Polygon>> mp_polygons;
 public:
-    Rasterizer(const std::vector<Polygon>& polygons);
+    Rasterizer(const std::vector<Polygon>& polygons);  // copies the scene
+    Rasterizer(std::shared_ptr<std::vector<Polygon>> polygons);  // shares it
+
+    // the resolution RenderScene draws at. the buffers follow on the next frame
+    void SetResolution(int width, int height);
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
 
-    static const unsigned long long m_zbufsize = (unsigned long long)(SCREEN_HEIGHT*SCREEN_WIDTH);
     // initialize the z_buffer to be infinity everywhere
-    std::vector<float> m_zbuffer = std::vector<float>(m_zbufsize, std::numeric_limits<float>::infinity());
+    std::vector<float> m_zbuffer = std::vector<float>(size_t(SCREEN_WIDTH*SCREEN_HEIGHT), std::numeric_limits<float>::infinity());
 
-    bool ConsultAndWriteToZBuffer(const int, const int, const float);
     void resetZBuffer();
 
     Camera m_camera;
 
-    Triangle projectTriangleFromWorldtoPixelSpace(const glm::mat4,
-                                                  const glm::mat4,
-                                                  const Polygon&,
-                                                  const Triangle,
-                                                  std::array<Vertex,3>&) const;
+    // the scene's point and spot lights. each LIGHT_TILE_SIZE tile of the frame only evaluates
+    // the ones that can reach it. without any, a headlight follows the camera. only affects
+    // RenderMode::Shaded
+    std::vector<Light> m_lights;
+
+    // the transform hierarchy the polygons hang from, see Polygon::m_node. RenderScene brings its
+    // world matrices up to date and applies them in the vertex stage, so moving a node never
+    // touches the scene's vertices, and the shadow maps and the temporal history notice it moved
+    SceneGraph m_sceneGraph;
+
+    // lights with castsShadows, up to SHADOW_MAX_LIGHTS of them, render the scene's depth from
+    // their point of view into a map, and each lit pixel filters (2*m_shadowFilter + 1)^2 taps of
+    // it around where it lands, up to SHADOW_MAX_FILTER. 0 gives hard shadows. the maps only depend
+    // on the lights and the scene, so they are rendered once and kept while the camera moves
+    int m_shadowFilter = 1;
+
+    // skip triangles facing away from the camera. off by default, since not every scene is closed
+    bool m_cullBackfaces = false;
+
+    // lay down the depth of the whole scene with the depth-only pipeline first, so only the
+    // triangle that ends up in front of a pixel shades it. the image stays the same, it's just
+    // cheaper when a lot of the scene is drawn over
+    bool m_depthPrepass = false;
+
+    // the heatmap modes still render the whole scene, so m_stats stay meaningful
+    RenderMode m_renderMode = RenderMode::Shaded;
+
+    // counters and timings of the last RenderScene
+    RenderStats m_stats;
+    // what the scene and this rasterizer's buffers take up right now. the target RenderScene
+    // draws into is the caller's, and not included
+    MemoryStats Memory() const;
+
+    // reuse the last full frame while the camera only moves a little: its pixels are reprojected
+    // into the new view, and only triangles over what they don't cover get rasterized and shaded.
+    // every TEMPORAL_REFRESH_FRAMES frames, or once too much is uncovered, a full frame is drawn.
+    // only affects RenderMode::Shaded
+    bool m_temporal = false;
+    // makes the next frame a full one, e.g. to clean up once the camera stops
+    void InvalidateHistory();
 
+    // sub-pixel offset of the projection, in pixels, to supersample across frames. jittered
+    // frames are never kept for m_temporal
+    glm::vec2 m_jitter = glm::vec2(0.f);
+
+    // cheap shading for a quick first look: textures are replaced by their average color.
+    // such frames are never kept for m_temporal
+    bool m_previewShading = false;
+
+    // polled between triangles while rendering. once it returns true RenderScene gives up on
+    // the frame and returns a null image, e.g. because a newer camera is waiting
+    std::function<bool()> m_cancel;
+
+    // renders into *target, which is (re)allocated only if it isn't a Width() x Height()
+    // RGB32 image already, so reusing one target across frames allocates nothing. keep no other
+    // copies of it: writing to a shared QImage detaches it. returns false, leaving *target
+    // partially drawn, if the frame was cancelled
+    bool RenderScene(QImage* target);
+    // the same into a new image, or a null image if cancelled
     QImage RenderScene();
+    // renders only what m_camera sees of the scene's depth, into m_zbuffer, with the depth-only
+    // pipeline: no attributes are set up, nothing is shaded and there is no color target. ignores
+    // the render mode. unlike RenderScene's, the depth is the distance along m_camera's forward
+    // axis, infinity where nothing was drawn. returns false if cancelled
+    bool RenderDepth();
+    // these modify the scene, so they must not be used while it is shared with another Rasterizer
     void ClearScene();
-
-    void RenderTriangle(const Polygon&, const Triangle&, QImage&);
-    void RenderTriangle(const Polygon&, const Triangle&, std::array<Vertex,3>&, QImage&);
+    // adds one more polygon to the scene, e.g. as a background load finishes it
+    void AddPolygon(Polygon&&);
 
     float computeSubTriangleArea(const glm::vec2&, const glm::vec2&, const glm::vec2&) const; // make this const
 
@@ -41,22 +121,135 @@ public:
                                                  const Triangle&,
                                                  const glm::vec2&) const; // make this const
 
-    BarycentricWeights perspectiveCorrectBarycentricWeights(const Triangle&,
-                                                            std::array<Vertex,3>&,
-                                                            const glm::vec2&) const;
+private:
+    // one triangle that survived setup, in pixel space
+    struct SetupTriangle {
+        BoundingBox box;
+        std::array<Vertex,3> verts;
+        std::array<glm::vec3,3> world;  // the corners' world space positions, for the light pass
+        SpanSetup span;
+    };
+    // the pixels of one triangle that passed the depth test, waiting to be shaded,
+    // as the range [begin, end) of the fragment arrays
+    struct FragmentRun {
+        unsigned tri;  // index into m_setupTris
+        int begin, end;
+    };
+
+    bool renderScene(QImage* target);  // RenderScene, less the allocation counting
+
+    // the pipeline stages, run once per polygon
+    void transformVertices(const Polygon&, const glm::mat4& view_proj);
+    void setupTriangles(const Polygon&);
+    // the polygon's vertex i with its attributes unpacked and in world space, like its position.
+    // unpacked on first use and kept in m_worldVerts for the other triangles sharing it
+    const Vertex& worldVertex(const Polygon&, unsigned i);
+    void setupScreenTriangle(const std::array<Vertex,3>&, const std::array<glm::vec3,3>& world);
+    // only pixels in [x0,x1) x [y0,y1) are rasterized
+    void rasterizeTriangles(int x0, int y0, int x1, int y1);
+    void rasterizeTriangle(unsigned index, int x0, int y0, int x1, int y1);
+    void growFragments(size_t capacity);
+    // picks the shading variant for the polygon's material, once per polygon
+    void shadeFragments(const Polygon&);
+    // shades the queued runs with the kernel for ShadeFeatures F, setting up only what it interpolates
+    template <unsigned F>
+    void shadeRuns(const TextureView& tex, const NormalMapView& nor);
+    // runs the stages up to the depth test for every polygon, in depth-only mode. returns false if cancelled
+    bool depthPass(const glm::mat4& view_proj);
+    void drawHeatmap();
+    // lights the albedo left by shadeFragments, tile by tile, with the lights that reach each tile
+    void lightPass(const glm::mat4& view_proj);
+    GBufferView gbuffer();
+    // renders the depth maps of the shadow casting lights that changed. returns false if cancelled
+    bool updateShadowMaps();
+    // fills the cleared targets from the previous frame. returns false if a full frame is due
+    bool reprojectHistory(const glm::mat4& view_proj);
+    // after a full frame, keeps it as the new history
+    void finishHistory(const glm::mat4& view_proj);
+    // true if every pixel of every temporal tile under the bounding box was reprojected
+    bool coveredByHistory(const BoundingBox& bb) const;
+    bool cancelled();  // latches m_cancel for the rest of the frame
+
+    int m_width = int(SCREEN_WIDTH);
+    int m_height = int(SCREEN_HEIGHT);
+    QRgb* mp_colorbuffer = nullptr;  // the target's pixels during RenderScene
+    // the scratch memory of the frame: everything below that's only needed for one frame or one
+    // polygon points into it. the frame resets it, and each polygon gives back what it took
+    FrameArena m_arena;
+    // per-pixel depth tests or shaded fragments, and per-tile milliseconds, for the heatmap modes
+    unsigned* m_pixelCounts = nullptr;
+    double* m_tileTimes = nullptr;
+    bool m_cancelled = false;
+    // inside depthPass: triangles carry only their positions, and spans only update the depth
+    bool m_depthOnly = false;
+    bool m_viewDepth = false;  // inside RenderDepth. setupTriangles leaves the view depth in the corners' z
+
+    // the last full frame, for m_temporal. reprojected frames always start from it rather than
+    // from each other, so resampling errors don't pile up frame after frame
+    struct History {
+        bool valid = false;
+        int width = 0, height = 0;
+        glm::mat4 viewProj;
+        glm::vec4 forward;
+        unsigned long long sceneGeneration = 0;  // of m_sceneGraph, reprojection assumes nothing moved since
+        int framesSince = 0;
+        std::vector<QRgb> color;
+        std::vector<float> depth;
+        size_t background = 0;  // pixels nothing was drawn on
+    };
+    History m_history;
+    bool m_reprojecting = false;  // this frame started from the history
+    // the pixels still showing the history, which are lit already. reprojected pixels keep their
+    // depth in m_zbuffer, and a fragment in front of one takes it over
+    bool* m_reprojected = nullptr;
+    unsigned* m_tileOpen = nullptr;  // pixels per temporal tile left open to rasterization
 
-    template <typename T>
-    T perspectiveCorrectInterpolateAttrib(const T&,
-                                          const T&,
-                                          const T&,
-                                          const BarycentricWeights&,
-                                          std::array<Vertex,3>&) const;
+    // with m_lights, shading only leaves the albedo in the color buffer, and the normal and
+    // position of every pixel here for the light pass
+    bool m_lightPass = false;
+    std::array<float*,3> m_gNormal = {}, m_gPosition = {};
+    // the lights that can show up in the frame, and where: a rectangle of light tiles and a range of depths
+    struct LightBounds {
+        int tx0, ty0, tx1, ty1;  // inclusive
+        float zmin, zmax;
+        int shadow;  // index into m_shadowMaps, or -1
+    };
+    LightSetup* m_lightSetups = nullptr;
+    LightBounds* m_lightBounds = nullptr;
+    int m_lightCount = 0;
+    int* m_tileLights = nullptr;  // the list of the tile being lit, indices into m_lightSetups
 
-    glm::vec4 perspectiveCorrectInterpolateAttrib(const glm::vec4&,
-                                                  const glm::vec4&,
-                                                  const glm::vec4&,
-                                                  const Triangle&,
-                                                  std::array<Vertex,3>&,
-                                                  const glm::vec2&) const;
+    // the depth maps of the shadow casting lights, in the order of m_lights
+    struct ShadowMap {
+        bool valid = false;
+        Light light;  // what it was rendered for
+        unsigned long long sceneGeneration = 0;  // and the m_sceneGraph it was rendered with
+        std::vector<Camera> views;  // the cone of a spot light, or the six faces of a cube around a point light
+        std::vector<std::vector<float>> depth;  // per view
+        std::vector<ShadowSetup> setups;  // per view
+    };
+    std::vector<ShadowMap> m_shadowMaps;
+    std::unique_ptr<Rasterizer> mp_shadowRasterizer;  // renders the maps, sharing the scene
+    // per shadow map, the fraction of its light each pixel of the frame sees
+    std::array<float*, SHADOW_MAX_LIGHTS> m_shadowVisibility = {};
 
+    // per-polygon scratch space
+    glm::vec4* m_clipPos = nullptr;  // clip space positions of the polygon's vertices
+    glm::vec4* m_screenPos = nullptr;  // the same positions in pixel space
+    Vertex* m_worldVerts = nullptr;  // its vertices unpacked in world space, null in depth-only passes
+    bool* m_unpacked = nullptr;  // which of m_worldVerts are filled in yet
+    const glm::mat4* m_model = nullptr;  // its node's world matrix, null for the identity
+    glm::mat3 m_normalMatrix;  // the inverse transpose of m_model's upper 3x3
+    bool m_mirrored = false;  // its node turns front faces into back faces
+    SetupTriangle* m_setupTris = nullptr;
+    unsigned m_setupCount = 0;
+    // the queued fragments, as structure-of-arrays so the kernels can load them a register at a time
+    int* m_fragPixels = nullptr;
+    float* m_fragW0 = nullptr;
+    float* m_fragW1 = nullptr;
+    float* m_fragW2 = nullptr;
+    int m_fragCount = 0;
+    size_t m_fragCapacity = 0;  // the most any polygon queued so far, which every polygon starts out with room for
+    FragmentRun* m_fragRuns = nullptr;
+    int m_runCount = 0;
 };
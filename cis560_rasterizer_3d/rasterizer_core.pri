@@ -0,0 +1,58 @@
+# The renderer and scene loading, shared by the GUI app and the headless tools.
+# Everything here builds against QtCore/QtGui only, no widgets.
+
+QT       += core gui concurrent
+
+CONFIG += c++17
+
+INCLUDEPATH += $$PWD/include
+INCLUDEPATH += $$PWD
+
+*-clang*|*-g++* {
+    message("Enabling additional warnings")
+    QMAKE_CXXFLAGS += -fms-extensions
+    # no fused multiply-adds, so every kernel variant rounds exactly like the scalar one
+    QMAKE_CXXFLAGS += -ffp-contract=off
+}
+
+SOURCES += \
+    $$PWD/accumulator.cpp \
+    $$PWD/batchrender.cpp \
+    $$PWD/camera.cpp \
+    $$PWD/cameraset.cpp \
+    $$PWD/camerapath.cpp \
+    $$PWD/dynamicresolution.cpp \
+    $$PWD/framearena.cpp \
+    $$PWD/polygon.cpp \
+    $$PWD/objloader.cpp \
+    $$PWD/gltfloader.cpp \
+    $$PWD/kernels.cpp \
+    $$PWD/kernels_sse42.cpp \
+    $$PWD/kernels_avx2.cpp \
+    $$PWD/kernels_avx512.cpp \
+    $$PWD/memorystats.cpp \
+    $$PWD/rasterizer.cpp \
+    $$PWD/renderstats.cpp \
+    $$PWD/scenegraph.cpp \
+    $$PWD/sceneloader.cpp
+
+HEADERS += \
+    $$PWD/accumulator.h \
+    $$PWD/batchrender.h \
+    $$PWD/camera.h \
+    $$PWD/cameraset.h \
+    $$PWD/camerapath.h \
+    $$PWD/constants.h \
+    $$PWD/debug.h \
+    $$PWD/dynamicresolution.h \
+    $$PWD/framearena.h \
+    $$PWD/polygon.h \
+    $$PWD/objloader.h \
+    $$PWD/gltfloader.h \
+    $$PWD/kernels.h \
+    $$PWD/light.h \
+    $$PWD/memorystats.h \
+    $$PWD/rasterizer.h \
+    $$PWD/renderstats.h \
+    $$PWD/scenegraph.h \
+    $$PWD/sceneloader.h
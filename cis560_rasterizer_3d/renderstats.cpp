@@ -0,0 +1,50 @@
+#include "renderstats.h"
+#include "memorystats.h"
+
+#include <iomanip>
+#include <ostream>
+
+double RenderStats::TotalMs() const
+{
+    return clearMs + transformMs + setupMs + rasterMs + shadeMs + reprojectMs + depthMs + shadowMs + lightMs;
+}
+
+void RenderStats::Print(std::ostream& out) const
+{
+    const std::ios_base::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2)
+        << "frame " << TotalMs() << " ms"
+        << " (clear " << clearMs
+        << ", transform " << transformMs
+        << ", setup " << setupMs
+        << ", raster " << rasterMs
+        << ", shade " << shadeMs
+        << ", reproject " << reprojectMs
+        << ", depth " << depthMs
+        << ", shadow " << shadowMs
+        << ", light " << lightMs << ")\n"
+        << "triangles: " << trianglesSubmitted << " submitted, "
+        << trianglesRasterized << " rasterized, "
+        << nearClipped << " near clipped, culled "
+        << culledOffscreen << " offscreen / "
+        << culledBackface << " backface / "
+        << culledDegenerate << " degenerate\n"
+        << "pixels: " << pixelsTested << " tested, "
+        << depthFailed << " depth failed, "
+        << pixelsShaded << " shaded, "
+        << textureFetches << " texture fetches, "
+        << pixelsReused << " reused\n"
+        << "lights: " << lightsVisible << " visible, "
+        << lightEvaluations << " evaluations\n"
+        << "shadows: " << shadowViewsRendered << " views rendered, "
+        << shadowTriangles << " triangles, "
+        << shadowLookups << " lookups" << std::endl;
+    // without the counter linked in they'd read 0, whatever the frame allocated
+    if(AllocationScope::Counting())
+    {
+        out << "allocations: " << allocations << ", " << allocatedBytes / 1024.0 << " KB" << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <iosfwd>
+
+// What one RenderScene call did, stage by stage. Filled on every frame; the counters are plain
+// increments and the timings a handful of clock reads per object, so it is always on.
+// With a depth prepass, the triangle and depth test counters include both passes.
+struct RenderStats
+{
+    // triangles
+    unsigned long long trianglesSubmitted = 0;
+    unsigned long long culledOffscreen = 0;   // outside the screen, or entirely behind the near plane
+    unsigned long long culledBackface = 0;    // only counted when backface culling is enabled
+    unsigned long long culledDegenerate = 0;  // no area on screen
+    unsigned long long nearClipped = 0;       // crossed the near plane and were cut down to the visible part
+    unsigned long long trianglesRasterized = 0;  // including the pieces clipped triangles were split into
+
+    // pixels
+    unsigned long long pixelsTested = 0;  // depth tests performed
+    unsigned long long depthFailed = 0;
+    unsigned long long pixelsShaded = 0;
+    unsigned long long textureFetches = 0;
+    unsigned long long pixelsReused = 0;  // taken from the previous frame by temporal reprojection
+
+    // scene lights
+    unsigned long long lightsVisible = 0;     // lights whose range overlaps the view
+    unsigned long long lightEvaluations = 0;  // light and pixel pairs the light pass computed, after tile culling
+    unsigned long long shadowViewsRendered = 0;  // shadow map views redrawn, 0 while the lights and scene stay put
+    unsigned long long shadowTriangles = 0;      // triangles rasterized into them
+    unsigned long long shadowLookups = 0;        // light and pixel pairs that filtered a shadow map
+
+    // heap allocations made by the frame's thread while rendering it, and their bytes. 0 once
+    // the buffers have grown to fit, see Rasterizer::Memory for what they hold. only counted
+    // in programs that link allocationcounter.cpp, see AllocationScope, and only printed there
+    unsigned long long allocations = 0;
+    unsigned long long allocatedBytes = 0;
+
+    // milliseconds per stage
+    double clearMs = 0;      // resetting the depth and color targets
+    double transformMs = 0;  // vertices to clip and screen space
+    double setupMs = 0;      // clipping, culling and bounding boxes
+    double rasterMs = 0;     // scan conversion and depth test
+    double shadeMs = 0;      // attribute interpolation, lighting and texturing
+    double reprojectMs = 0;  // temporal reprojection from, and saving of, the previous frame
+    double depthMs = 0;      // the depth prepass, or all of RenderDepth
+    double shadowMs = 0;     // rendering the shadow maps that changed
+    double lightMs = 0;      // light culling and the light pass over the lit pixels, shadow lookups included
+
+    double TotalMs() const;
+
+    // a few human readable lines
+    void Print(std::ostream& out) const;
+};
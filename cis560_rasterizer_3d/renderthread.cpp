@@ -0,0 +1,269 @@
+#include "renderthread.h"
+
+#include <chrono>
+
+RenderThread::RenderThread(QObject* parent)
+    : QObject(parent)
+{
+    m_thread = std::thread([this]() { run(); });
+}
+
+RenderThread::~RenderThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+        request();  // also abandons the frame in flight
+    }
+    m_thread.join();
+}
+
+void RenderThread::request()
+{
+    m_generation++;
+    m_wake.notify_one();
+}
+
+void RenderThread::SetScene(std::shared_ptr<std::vector<Polygon>> polygons)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_newScene = std::move(polygons);
+    m_addedPolygons.clear();
+    request();
+}
+
+void RenderThread::AddPolygon(std::shared_ptr<Polygon> polygon)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_addedPolygons.push_back(std::move(polygon));
+    request();
+}
+
+void RenderThread::SetLights(std::vector<Light> lights)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lights = std::move(lights);
+    request();
+}
+
+void RenderThread::SetSceneGraph(SceneGraph graph)
+{
+    // brought up to date once here, or every frame's copy would Update on its own and come out
+    // as a new generation, throwing away the history and the shadow maps each time
+    graph.Update();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sceneGraph = std::move(graph);
+    request();
+}
+
+void RenderThread::SetCamera(const Camera& camera)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_camera = camera;
+    request();
+}
+
+void RenderThread::SetRenderMode(RenderMode mode)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_renderMode = mode;
+    request();
+}
+
+void RenderThread::SetResolution(const QSize& size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_resolution = size;
+    request();
+}
+
+void RenderThread::SetDynamicResolution(bool enabled, double target_ms)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dynamicResolution = enabled;
+    m_targetMs = target_ms;
+    request();
+}
+
+void RenderThread::SetTemporalReprojection(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_temporal = enabled;
+    request();
+}
+
+void RenderThread::SetProgressiveRefinement(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_progressive = enabled;
+    request();
+}
+
+void RenderThread::SetIdleAccumulation(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_accumulation = enabled;
+    request();
+}
+
+bool RenderThread::AcquireFrame()
+{
+    return m_frames.Acquire();
+}
+
+const RenderedFrame& RenderThread::Frame() const
+{
+    return m_frames.Front();
+}
+
+// what each frame of a request looks like in progressive mode. every stage is shown as it
+// finishes, and a new request drops whatever is left
+static const struct
+{
+    float scale;
+    bool preview;
+} PROGRESSIVE_STAGES[] = {
+    {PROGRESSIVE_PREVIEW_SCALE, true},  // a sixteenth of the pixels, textures as flat colors
+    {1.f, true},                        // full size
+    {1.f, false},                       // full quality
+};
+static const int PROGRESSIVE_STAGE_COUNT = int(sizeof(PROGRESSIVE_STAGES) / sizeof(PROGRESSIVE_STAGES[0]));
+
+void RenderThread::run()
+{
+    // only this thread touches the rasterizer, so the scene needs no locking while it renders
+    Rasterizer rasterizer(std::vector<Polygon>{});
+    DynamicResolution scaler;
+    Accumulator accumulator;
+    QImage sample;  // target of the jittered frames, before they go into the accumulator
+    unsigned rendered = 0;
+    int stage = 0;           // the progressive stage to render next for the last request, 0 once it's done
+    bool refine = false;     // the last frame was scaled down or reprojected, so redo it in full when idle
+    bool accumulate = false; // the accumulator holds the last request and takes more samples when idle
+    for(;;)
+    {
+        unsigned gen;
+        QSize full;
+        bool dynamic;
+        bool progressive;
+        bool accumulation;
+        std::vector<std::shared_ptr<Polygon>> added;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            const auto pending = [&]() { return m_quit || m_generation != rendered; };
+            // a progressive stage follows the last one right away, just picking up anything newer.
+            // otherwise give a burst of input a moment to go on before spending a full size frame
+            // or starting to accumulate, then keep adding samples for as long as nothing comes in
+            if(stage == 0 && refine)
+            {
+                m_wake.wait_for(lock, std::chrono::milliseconds(DYNRES_REFINE_DELAY_MS), pending);
+            }
+            else if(stage == 0 && accumulate)
+            {
+                const int delay = accumulator.Samples() == 1 ? ACCUMULATION_DELAY_MS : 0;
+                m_wake.wait_for(lock, std::chrono::milliseconds(delay), pending);
+            }
+            else if(stage == 0)
+            {
+                m_wake.wait(lock, pending);
+            }
+            if(m_quit)
+            {
+                return;
+            }
+            gen = m_generation;
+            if(m_newScene)
+            {
+                rasterizer = Rasterizer(std::move(m_newScene));
+                m_newScene = nullptr;
+            }
+            added.swap(m_addedPolygons);
+            rasterizer.m_camera = m_camera;
+            rasterizer.m_lights = m_lights;  // reuses its capacity, so it allocates nothing in steady state
+            // only copied when it changed, so the history and shadow maps survive until a node moves
+            if(rasterizer.m_sceneGraph.Generation() != m_sceneGraph.Generation())
+            {
+                rasterizer.m_sceneGraph = m_sceneGraph;
+            }
+            rasterizer.m_renderMode = m_renderMode;
+            rasterizer.m_temporal = m_temporal;
+            full = m_resolution;
+            dynamic = m_dynamicResolution;
+            progressive = m_progressive;
+            accumulation = m_accumulation;
+            scaler.SetTarget(m_targetMs);
+        }
+        for(std::shared_ptr<Polygon>& p : added)
+        {
+            rasterizer.AddPolygon(std::move(*p));
+        }
+
+        // the same request again is either its next progressive stage, a refinement pass at
+        // full size and from scratch, or one more jittered sample of it
+        const bool same = gen == rendered;
+        if(!same || !progressive)
+        {
+            stage = 0;
+        }
+        const bool refining = refine && same && stage == 0;
+        const bool sampling = accumulate && same && stage == 0 && !refining;
+        refine = false;
+        accumulate = false;
+        if(refining)
+        {
+            rasterizer.InvalidateHistory();
+        }
+        if(!dynamic || progressive)
+        {
+            scaler.Reset();
+        }
+        float scale = (refining || sampling) ? 1.f : scaler.Scale();
+        rasterizer.m_previewShading = false;
+        if(progressive && !refining && !sampling)
+        {
+            scale = PROGRESSIVE_STAGES[stage].scale;
+            rasterizer.m_previewShading = PROGRESSIVE_STAGES[stage].preview;
+        }
+        rasterizer.m_jitter = Accumulator::Jitter(sampling ? accumulator.Samples() : 0);
+        rasterizer.SetResolution(std::max(1, int(std::lround(full.width() * scale))),
+                                 std::max(1, int(std::lround(full.height() * scale))));
+
+        rasterizer.m_cancel = [this, gen]() { return m_generation.load(std::memory_order_relaxed) != gen; };
+        RenderedFrame& frame = m_frames.Back();
+        rendered = gen;
+        if(!rasterizer.RenderScene(sampling ? &sample : &frame.image))
+        {
+            continue;  // superseded, go straight to the newer request. the target gets reused
+        }
+        // only a complete full size frame can start an accumulation
+        const bool complete = rasterizer.Width() == full.width() && rasterizer.Height() == full.height()
+                && !rasterizer.m_previewShading && rasterizer.m_stats.pixelsReused == 0
+                && rasterizer.m_renderMode == RenderMode::Shaded;
+        if(sampling)
+        {
+            accumulator.Add(sample);
+            accumulator.Resolve(&frame.image);
+        }
+        else if(accumulation && complete)
+        {
+            accumulator.Reset(frame.image);
+        }
+        frame.stats = rasterizer.m_stats;
+        frame.displaySize = full;
+        m_frames.Publish();
+        emit frameReady();
+
+        if(progressive && !refining && !sampling)
+        {
+            stage = (stage + 1) % PROGRESSIVE_STAGE_COUNT;
+        }
+        else if(dynamic && !refining && !sampling)
+        {
+            scaler.FrameDone(rasterizer.m_stats.TotalMs());
+            refine = scale < 1.f;
+        }
+        refine = stage == 0 && (refine || rasterizer.m_stats.pixelsReused > 0);
+        accumulate = stage == 0 && accumulation && (sampling || complete)
+                && accumulator.Samples() < ACCUMULATION_MAX_SAMPLES;
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <QObject>
+#include <QImage>
+#include <QSize>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "accumulator.h"
+#include "camera.h"
+#include "dynamicresolution.h"
+#include "polygon.h"
+#include "rasterizer.h"
+#include "renderstats.h"
+#include "triplebuffer.h"
+
+// One of the render thread's color targets and the stats of the frame drawn into it
+struct RenderedFrame
+{
+    QImage image;
+    RenderStats stats;
+    QSize displaySize;  // what to show the image at. bigger than the image when dynamic resolution scaled it down
+};
+
+// Renders on a dedicated thread so the GUI never waits for a frame.
+// Every setter asks for a new frame. Requests that arrive while a frame is in flight are
+// coalesced: only the latest state gets rendered, and the frame in flight is abandoned at the
+// next triangle or tile. Frames are drawn straight into three persistent images that rotate
+// through a lock-free triple buffer, so steady state rendering allocates and copies nothing.
+class RenderThread : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RenderThread(QObject* parent = nullptr);
+    ~RenderThread();
+
+    // replaces the whole scene
+    void SetScene(std::shared_ptr<std::vector<Polygon>> polygons);
+    // adds one polygon to the current scene, e.g. as a background load finishes it
+    void AddPolygon(std::shared_ptr<Polygon> polygon);
+    // replaces the scene's lights. SetScene leaves them alone
+    void SetLights(std::vector<Light> lights);
+    // replaces the nodes the polygons are placed by, see Polygon::m_node. SetScene leaves it alone too
+    void SetSceneGraph(SceneGraph graph);
+    void SetCamera(const Camera& camera);
+    void SetRenderMode(RenderMode mode);
+    // the size frames are displayed at, and rendered at unless dynamic resolution is on
+    void SetResolution(const QSize& size);
+    // render below the display resolution while frames take longer than target_ms, for a
+    // responsive preview. once the requests stop, the last view is rendered again at full size
+    void SetDynamicResolution(bool enabled, double target_ms = DYNRES_TARGET_MS);
+    // reuse the previous frame for small camera moves, see Rasterizer::m_temporal. like a scaled
+    // down frame, a reprojected one is redrawn in full once the requests stop
+    void SetTemporalReprojection(bool enabled);
+    // show every request first as a coarse preview, then refine it in stages up to full quality,
+    // publishing each one. a new request abandons the rest. takes over from dynamic resolution
+    void SetProgressiveRefinement(bool enabled);
+    // once the requests stop, keep rendering the last view with sub-pixel jitter and publish the
+    // running average, converging to an antialiased still over ACCUMULATION_MAX_SAMPLES frames
+    void SetIdleAccumulation(bool enabled);
+
+    // makes the newest finished frame the one Frame() returns. returns false if nothing
+    // was finished since the last call
+    bool AcquireFrame();
+    // the frame last acquired. it stays untouched by the render thread until the next
+    // AcquireFrame, so it can be painted straight from its image. don't keep copies of the
+    // image around though, or the render thread has to detach from them when it reuses it
+    const RenderedFrame& Frame() const;
+
+signals:
+    // emitted on the render thread after a frame is published. several may be pending by the
+    // time the GUI gets to them, AcquireFrame only picks up the newest
+    void frameReady();
+
+private:
+    void run();
+    void request();  // must hold m_mutex
+
+    std::thread m_thread;
+
+    // what the next frame should show. guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::shared_ptr<std::vector<Polygon>> m_newScene;  // null unless SetScene was called
+    std::vector<std::shared_ptr<Polygon>> m_addedPolygons;
+    std::vector<Light> m_lights;
+    SceneGraph m_sceneGraph;
+    Camera m_camera;
+    RenderMode m_renderMode = RenderMode::Shaded;
+    QSize m_resolution = QSize(int(SCREEN_WIDTH), int(SCREEN_HEIGHT));
+    bool m_dynamicResolution = false;
+    double m_targetMs = DYNRES_TARGET_MS;
+    bool m_temporal = false;
+    bool m_progressive = false;
+    bool m_accumulation = false;
+    bool m_quit = false;
+
+    // bumped by every request, and read without the lock by the frame in flight to notice it's stale
+    std::atomic<unsigned> m_generation{0};
+
+    TripleBuffer<RenderedFrame> m_frames;
+};
@@ -0,0 +1,81 @@
+#include "scenegraph.h"
+
+#include <atomic>
+
+glm::mat4 NodeTransform::Matrix() const
+{
+    glm::mat4 m = glm::mat4_cast(rotation);
+    m[0] *= scale.x;
+    m[1] *= scale.y;
+    m[2] *= scale.z;
+    m[3] = glm::vec4(translation, 1.f);
+    return m;
+}
+
+// shared by every graph, so two of them never hand out the same generation
+static unsigned long long nextGeneration()
+{
+    static std::atomic<unsigned long long> s_generation{0};
+    return ++s_generation;
+}
+
+int SceneGraph::AddNode(const QString& name, int parent, const NodeTransform& local)
+{
+    Node n;
+    n.name = name;
+    n.parent = parent < Size() ? parent : -1;
+    n.local = local;
+    m_nodes.push_back(n);
+    m_dirty = true;
+    return Size() - 1;
+}
+
+int SceneGraph::Find(const QString& name) const
+{
+    for(int i = 0; i < Size(); i++)
+    {
+        if(m_nodes[i].name == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void SceneGraph::SetLocal(int node, const NodeTransform& local)
+{
+    m_nodes[node].local = local;
+    m_nodes[node].dirty = true;
+    m_dirty = true;
+}
+
+int SceneGraph::Update()
+{
+    if(!m_dirty)
+    {
+        return 0;
+    }
+    int updated = 0;
+    for(Node& n : m_nodes)
+    {
+        const Node* parent = n.parent >= 0 ? &m_nodes[n.parent] : nullptr;
+        n.moved = n.dirty || (parent && parent->moved);
+        if(!n.moved)
+        {
+            continue;
+        }
+        n.world = parent ? parent->world * n.local.Matrix() : n.local.Matrix();
+        n.identity = n.world == glm::mat4(1.f);
+        n.dirty = false;
+        updated++;
+    }
+    m_dirty = false;
+    m_generation = nextGeneration();
+    return updated;
+}
+
+const glm::mat4& SceneGraph::World(int node) const
+{
+    static const glm::mat4 identity(1.f);
+    return node < 0 ? identity : m_nodes[node].world;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QString>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+// A node's placement relative to its parent: scaled first, then rotated, then translated
+struct NodeTransform
+{
+    glm::vec3 translation = glm::vec3(0.f);
+    glm::quat rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+    glm::vec3 scale = glm::vec3(1.f);
+
+    glm::mat4 Matrix() const;
+};
+
+// The transform hierarchy a scene's polygons hang from, see Polygon::m_node. Every node has a
+// local transform and at most one parent, and a polygon's vertices are in the space of its node.
+// World matrices are cached: changing a node only marks it, and Update recomputes the marked
+// nodes and everything below them, leaving the rest alone. Nodes are stored parents first, so
+// that's a single pass.
+class SceneGraph
+{
+public:
+    // adds a node under parent, -1 for none, and returns its index. the parent must already exist
+    int AddNode(const QString& name, int parent = -1, const NodeTransform& local = NodeTransform());
+    // the index of the first node with that name, or -1
+    int Find(const QString& name) const;
+    int Size() const { return int(m_nodes.size()); }
+    int Parent(int node) const { return m_nodes[node].parent; }
+    const QString& Name(int node) const { return m_nodes[node].name; }
+
+    const NodeTransform& Local(int node) const { return m_nodes[node].local; }
+    // replaces a node's transform. it and its subtree move on the next Update
+    void SetLocal(int node, const NodeTransform& local);
+
+    // recomputes the world matrices of the nodes changed since the last call and of their
+    // descendants. returns how many were recomputed, 0 right away if nothing changed
+    int Update();
+
+    // the node's local to world matrix as of the last Update, identity for -1
+    const glm::mat4& World(int node) const;
+    // whether World(node) is the identity, so its polygons can skip the transform altogether
+    bool IsIdentity(int node) const { return node < 0 || m_nodes[node].identity; }
+
+    // changes whenever an Update moves anything, and is never the same for two different
+    // graphs, so whatever was rendered from world space positions can tell it's out of date
+    unsigned long long Generation() const { return m_generation; }
+
+private:
+    struct Node
+    {
+        QString name;
+        int parent;
+        NodeTransform local;
+        glm::mat4 world = glm::mat4(1.f);
+        bool identity = true;
+        bool dirty = true;   // its local transform changed since the last Update
+        bool moved = false;  // its world matrix was recomputed by the Update in progress
+    };
+    std::vector<Node> m_nodes;
+    bool m_dirty = false;  // some node is
+    unsigned long long m_generation = 0;
+};
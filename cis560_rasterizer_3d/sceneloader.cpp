@@ -0,0 +1,485 @@
+#include "sceneloader.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QImage>
+#include <QMetaObject>
+#include <QtConcurrent>
+#include <algorithm>
+#include <numeric>
+
+#include "objloader.h"
+#include "gltfloader.h"
+
+static glm::vec4 readVec3(const QJsonValue& v, const glm::vec4& fallback, float w)
+{
+    if(!v.isArray())
+    {
+        return fallback;
+    }
+    QJsonArray arr = v.toArray();
+    return glm::vec4(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble(), w);
+}
+
+// one entry of the scene's "lights" array
+static bool readLight(const QJsonObject& obj, Light* light, QString* error)
+{
+    const QString type = obj["type"].toString("point");
+    if(type == "spot")
+    {
+        light->type = Light::Type::Spot;
+    }
+    else if(type != "point")
+    {
+        if(error) *error = QString("Unknown light type \"%1\"").arg(type);
+        return false;
+    }
+    if(!obj["pos"].isArray())
+    {
+        if(error) *error = QString("A light needs a \"pos\"");
+        return false;
+    }
+    light->position = glm::vec3(readVec3(obj["pos"], glm::vec4(0.f), 1.f));
+    light->color = glm::vec3(readVec3(obj["color"], glm::vec4(1.f), 0.f)) * float(obj["intensity"].toDouble(1.0));
+    light->range = obj["range"].toDouble(light->range);
+    if(!(light->range > 0.f))
+    {
+        if(error) *error = QString("A light's \"range\" must be positive");
+        return false;
+    }
+    light->castsShadows = obj["shadows"].toBool(false);
+    if(light->type == Light::Type::Spot)
+    {
+        const glm::vec3 dir = glm::vec3(readVec3(obj["direction"], glm::vec4(light->direction, 0.f), 0.f));
+        if(glm::length(dir) == 0.f)
+        {
+            if(error) *error = QString("A spot light's \"direction\" can't be zero");
+            return false;
+        }
+        light->direction = glm::normalize(dir);
+        light->outerAngle = obj["angle"].toDouble(light->outerAngle);
+        light->innerAngle = std::min(float(obj["innerAngle"].toDouble(light->outerAngle * 0.75)), light->outerAngle);
+    }
+    return true;
+}
+
+// one entry of the scene's "nodes" array, without its parent
+static bool readNodeTransform(const QJsonObject& obj, NodeTransform* local, QString* error)
+{
+    local->translation = glm::vec3(readVec3(obj["translate"], glm::vec4(0.f), 0.f));
+    // x first, then y, then z, about the parent's axes
+    const glm::vec3 degrees = glm::vec3(readVec3(obj["rotate"], glm::vec4(0.f), 0.f));
+    local->rotation = glm::quat(glm::vec3(0.f, 0.f, glm::radians(degrees.z)))
+            * glm::quat(glm::vec3(0.f, glm::radians(degrees.y), 0.f))
+            * glm::quat(glm::vec3(glm::radians(degrees.x), 0.f, 0.f));
+    local->scale = obj["scale"].isDouble() ? glm::vec3(obj["scale"].toDouble())
+                                           : glm::vec3(readVec3(obj["scale"], glm::vec4(1.f), 0.f));
+    if(local->scale.x == 0.f || local->scale.y == 0.f || local->scale.z == 0.f)
+    {
+        if(error) *error = QString("A node's \"scale\" can't be zero");
+        return false;
+    }
+    return true;
+}
+
+// the graph has to store parents first, but the file may list the nodes in any order
+static bool readNodes(const QJsonArray& nodes, SceneGraph* graph, QString* error)
+{
+    std::vector<NodeTransform> locals(nodes.size());
+    QStringList names;
+    for(int i = 0; i < nodes.size(); i++)
+    {
+        const QJsonObject obj = nodes[i].toObject();
+        const QString name = obj["name"].toString();
+        if(name.isEmpty() || names.contains(name))
+        {
+            if(error) *error = QString("node %1: needs a \"name\" of its own").arg(i);
+            return false;
+        }
+        if(!readNodeTransform(obj, &locals[i], error))
+        {
+            if(error) *error = QString("node %1: %2").arg(name, *error);
+            return false;
+        }
+        names.append(name);
+    }
+    for(int i = 0; i < nodes.size(); i++)
+    {
+        const QString parent = nodes[i].toObject()["parent"].toString();
+        if(!parent.isEmpty() && !names.contains(parent))
+        {
+            if(error) *error = QString("node %1: unknown parent \"%2\"").arg(names[i], parent);
+            return false;
+        }
+    }
+
+    // each pass adds the nodes whose parents are in, so one that adds nothing has found a cycle
+    std::vector<bool> added(nodes.size(), false);
+    for(int remaining = nodes.size(); remaining > 0;)
+    {
+        const int before = remaining;
+        for(int i = 0; i < nodes.size(); i++)
+        {
+            if(added[i])
+            {
+                continue;
+            }
+            const QString parent = nodes[i].toObject()["parent"].toString();
+            const int parentIndex = parent.isEmpty() ? -1 : graph->Find(parent);
+            if(!parent.isEmpty() && parentIndex < 0)
+            {
+                continue;
+            }
+            graph->AddNode(names[i], parentIndex, locals[i]);
+            added[i] = true;
+            remaining--;
+        }
+        if(remaining == before)
+        {
+            if(error) *error = QString("The nodes' parents form a cycle");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ReadSceneFile(const QString& filename, SceneFile* scene, QString* error)
+{
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        if(error) *error = QString("Could not open the JSON file %1").arg(filename);
+        return false;
+    }
+    QJsonParseError parseError;
+    QJsonDocument jdoc(QJsonDocument::fromJson(file.readAll(), &parseError));
+    if(parseError.error != QJsonParseError::NoError)
+    {
+        if(error) *error = QString("Could not parse %1: %2").arg(filename, parseError.errorString());
+        return false;
+    }
+
+    scene->localPath = QFileInfo(filename).absolutePath() + "/";
+    scene->objects.clear();
+    QJsonArray objects = jdoc.object()["objects"].toArray();
+    for(int i = 0; i < objects.size(); i++)
+    {
+        scene->objects.push_back(objects[i].toObject());
+    }
+    scene->lights.clear();
+    QJsonArray lights = jdoc.object()["lights"].toArray();
+    for(int i = 0; i < lights.size(); i++)
+    {
+        Light light;
+        if(!readLight(lights[i].toObject(), &light, error))
+        {
+            if(error) *error = QString("%1: light %2: %3").arg(filename).arg(i).arg(*error);
+            return false;
+        }
+        scene->lights.push_back(light);
+    }
+
+    scene->graph = SceneGraph();
+    if(!readNodes(jdoc.object()["nodes"].toArray(), &scene->graph, error))
+    {
+        if(error) *error = QString("%1: %2").arg(filename, *error);
+        return false;
+    }
+    scene->objectNodes.clear();
+    for(size_t i = 0; i < scene->objects.size(); i++)
+    {
+        const QString node = scene->objects[i]["node"].toString();
+        scene->objectNodes.push_back(node.isEmpty() ? -1 : scene->graph.Find(node));
+        if(!node.isEmpty() && scene->objectNodes.back() < 0)
+        {
+            if(error) *error = QString("%1: object %2: unknown node \"%3\"").arg(filename).arg(i).arg(node);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LoadObjectGeometry(const QJsonObject& obj, const QString& localPath, Polygon& p, QString* error)
+{
+    QString type = obj["type"].toString();
+    p.m_name = obj["name"].toString();
+    // Custom Polygon case
+    if(QString::compare(type, QString("custom")) == 0)
+    {
+        std::vector<glm::vec4> vert_pos;
+        std::vector<glm::vec3> vert_col;
+        QJsonArray pos = obj["vertexPos"].toArray();
+        for(int j = 0; j < pos.size(); j++)
+        {
+            QJsonArray arr = pos[j].toArray();
+            vert_pos.push_back(glm::vec4(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble(), 1));
+        }
+        QJsonArray col = obj["vertexCol"].toArray();
+        for(int j = 0; j < col.size(); j++)
+        {
+            QJsonArray arr = col[j].toArray();
+            vert_col.push_back(glm::vec3(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble()));
+        }
+        p = Polygon(p.m_name, vert_pos, vert_col);
+        return true;
+    }
+    // Regular Polygon case
+    if(QString::compare(type, QString("regular")) == 0)
+    {
+        int sides = obj["sides"].toInt();
+        QJsonArray colorA = obj["color"].toArray();
+        glm::vec3 color(colorA[0].toDouble(), colorA[1].toDouble(), colorA[2].toDouble());
+        QJsonArray posA = obj["pos"].toArray();
+        glm::vec4 pos(posA[0].toDouble(), posA[1].toDouble(), posA[2].toDouble(), 1);
+        float rot = obj["rot"].toDouble();
+        QJsonArray scaleA = obj["scale"].toArray();
+        glm::vec4 scale(scaleA[0].toDouble(), scaleA[1].toDouble(), scaleA[2].toDouble(), 1);
+        p = Polygon(p.m_name, sides, color, pos, rot, scale);
+        return true;
+    }
+    // OBJ file case
+    if(QString::compare(type, QString("obj")) == 0)
+    {
+        return LoadOBJFile(localPath + obj["filename"].toString(), p, error);
+    }
+    // glTF / GLB file case. embedded textures are decoded along with the geometry
+    if(QString::compare(type, QString("gltf")) == 0)
+    {
+        return LoadGLTFFile(localPath + obj["filename"].toString(), p, error);
+    }
+    if(error) *error = QString("Unknown scene object type \"%1\"").arg(type);
+    return false;
+}
+
+QString ObjectTexturePath(const QJsonObject& obj, const QString& localPath)
+{
+    // for glTF an explicit texture overrides the one embedded in the file
+    return obj.contains(QString("texture")) ? localPath + obj["texture"].toString() : QString();
+}
+
+QString ObjectNormalMapPath(const QJsonObject& obj, const QString& localPath)
+{
+    return obj.contains(QString("normalMap")) ? localPath + obj["normalMap"].toString() : QString();
+}
+
+bool LoadScene(const QString& filename, std::vector<Polygon>* polygons, QString* errors, std::vector<Light>* lights,
+               SceneGraph* graph)
+{
+    SceneFile scene;
+    if(!ReadSceneFile(filename, &scene, errors))
+    {
+        return false;
+    }
+    if(lights)
+    {
+        *lights = scene.lights;
+    }
+    if(graph)
+    {
+        *graph = scene.graph;
+    }
+
+    std::vector<Polygon> loaded(scene.objects.size());
+    std::vector<QString> objErrors(scene.objects.size());
+    std::vector<int> indices(scene.objects.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    QtConcurrent::blockingMap(indices, [&](int i) {
+        const QJsonObject& obj = scene.objects[i];
+        if(!LoadObjectGeometry(obj, scene.localPath, loaded[i], &objErrors[i]))
+        {
+            return;
+        }
+        // without the graph there is nothing to place the object with
+        loaded[i].m_node = graph ? scene.objectNodes[i] : -1;
+        const QString texPath = ObjectTexturePath(obj, scene.localPath);
+        if(!texPath.isEmpty())
+        {
+            loaded[i].SetTexture(new QImage(texPath));
+        }
+        const QString norPath = ObjectNormalMapPath(obj, scene.localPath);
+        if(!norPath.isEmpty())
+        {
+            loaded[i].SetNormalMap(new QImage(norPath));
+        }
+    });
+
+    for(size_t i = 0; i < loaded.size(); i++)
+    {
+        if(!objErrors[i].isEmpty())
+        {
+            if(errors) errors->append(objErrors[i] + "\n");
+            continue;
+        }
+        polygons->push_back(std::move(loaded[i]));
+    }
+    return true;
+}
+
+Camera ReadCamera(const QJsonObject& obj, float aspectRatio)
+{
+    const Camera defaults;
+    const glm::vec4 eye = readVec3(obj["eye"], defaults.m_position, 1.f);
+    const glm::vec4 target = readVec3(obj["target"], eye + defaults.m_forward, 1.f);
+    const glm::vec4 up = readVec3(obj["up"], defaults.m_up, 0.f);
+    return Camera::LookAt(eye, target, up,
+                          obj["fov"].toDouble(defaults.m_fov),
+                          obj["near"].toDouble(defaults.m_near_clip),
+                          obj["far"].toDouble(defaults.m_far_clip),
+                          aspectRatio);
+}
+
+// One object being assembled from its geometry and texture tasks.
+// Each task writes only its own member, and whichever finishes last hands the result over.
+struct SceneLoader::PendingObject
+{
+    std::shared_ptr<Polygon> polygon = std::make_shared<Polygon>();
+    QImage texture;
+    QImage normalMap;
+    QString error;
+    std::atomic<int> remaining{0};
+};
+
+SceneLoader::SceneLoader(QObject* parent)
+    : QObject(parent), m_generation(0), m_tasksDone(0), m_tasksTotal(0)
+{}
+
+SceneLoader::~SceneLoader()
+{
+    Cancel();
+    m_pool.waitForDone();
+}
+
+template <typename F>
+void SceneLoader::post(unsigned gen, F fn)
+{
+    QMetaObject::invokeMethod(this, [this, gen, fn]() {
+        if(gen == m_generation)
+        {
+            fn();
+        }
+    }, Qt::QueuedConnection);
+}
+
+void SceneLoader::Load(const QString& filename)
+{
+    const unsigned gen = ++m_generation;
+    m_tasksDone = 0;
+    m_tasksTotal = 0;
+    m_errors.clear();
+
+    // even the JSON is read off the caller's thread
+    QtConcurrent::run(&m_pool, [this, gen, filename]() {
+        SceneFile scene;
+        QString error;
+        if(!ReadSceneFile(filename, &scene, &error))
+        {
+            post(gen, [this, error]() { emit finished(error); });
+            return;
+        }
+        post(gen, [this, lights = scene.lights]() { emit lightsLoaded(lights); });
+        post(gen, [this, graph = scene.graph]() { emit sceneGraphLoaded(graph); });
+        startObjects(gen, scene);
+    });
+}
+
+void SceneLoader::Cancel()
+{
+    ++m_generation;
+}
+
+void SceneLoader::startObjects(unsigned gen, const SceneFile& scene)
+{
+    std::vector<std::shared_ptr<PendingObject>> pending;
+    int total = 0;
+    for(const QJsonObject& obj : scene.objects)
+    {
+        pending.push_back(std::make_shared<PendingObject>());
+        pending.back()->remaining = 1
+                + !ObjectTexturePath(obj, scene.localPath).isEmpty()
+                + !ObjectNormalMapPath(obj, scene.localPath).isEmpty();
+        total += pending.back()->remaining;
+    }
+    post(gen, [this, total]() {
+        m_tasksTotal = total;
+        emit progress(0, total);
+        if(total == 0)
+        {
+            emit finished(QString());
+        }
+    });
+
+    for(size_t i = 0; i < scene.objects.size(); i++)
+    {
+        const QJsonObject obj = scene.objects[i];
+        const QString localPath = scene.localPath;
+        const int node = scene.objectNodes[i];
+        std::shared_ptr<PendingObject> p = pending[i];
+
+        QtConcurrent::run(&m_pool, [this, gen, obj, localPath, node, p]() {
+            if(gen == m_generation)
+            {
+                LoadObjectGeometry(obj, localPath, *p->polygon, &p->error);
+                p->polygon->m_node = node;
+            }
+            taskDone(gen, p);
+        });
+
+        const QString texPath = ObjectTexturePath(obj, localPath);
+        if(!texPath.isEmpty())
+        {
+            QtConcurrent::run(&m_pool, [this, gen, texPath, p]() {
+                if(gen == m_generation)
+                {
+                    p->texture = QImage(texPath);
+                }
+                taskDone(gen, p);
+            });
+        }
+        const QString norPath = ObjectNormalMapPath(obj, localPath);
+        if(!norPath.isEmpty())
+        {
+            QtConcurrent::run(&m_pool, [this, gen, norPath, p]() {
+                if(gen == m_generation)
+                {
+                    p->normalMap = QImage(norPath);
+                }
+                taskDone(gen, p);
+            });
+        }
+    }
+}
+
+void SceneLoader::taskDone(unsigned gen, const std::shared_ptr<PendingObject>& pending)
+{
+    const bool objectDone = (--pending->remaining == 0);
+    if(objectDone)
+    {
+        Polygon& p = *pending->polygon;
+        if(!pending->texture.isNull())
+        {
+            p.SetTexture(new QImage(pending->texture));
+        }
+        if(!pending->normalMap.isNull())
+        {
+            p.SetNormalMap(new QImage(pending->normalMap));
+        }
+    }
+
+    post(gen, [this, pending, objectDone]() {
+        if(objectDone)
+        {
+            if(!pending->error.isEmpty())
+            {
+                m_errors.append(pending->error + "\n");
+            }
+            emit objectLoaded(pending->polygon);
+        }
+        emit progress(++m_tasksDone, m_tasksTotal);
+        if(m_tasksDone == m_tasksTotal)
+        {
+            emit finished(m_errors);
+        }
+    });
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QJsonObject>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "polygon.h"
+#include "camera.h"
+#include "light.h"
+#include "scenegraph.h"
+
+// The objects listed in a scene JSON file, before any of them have been built, and its lights
+struct SceneFile
+{
+    QString localPath;  // the directory that object and texture paths are relative to
+    std::vector<QJsonObject> objects;
+    std::vector<Light> lights;
+    SceneGraph graph;
+    std::vector<int> objectNodes;  // the graph node of each object, -1 for none
+};
+
+// Reads and parses a scene JSON file. Returns false and fills *error on failure.
+// Besides "objects" it may have "lights", each of the form
+// {"type": "point" or "spot", "pos": [x,y,z], "color": [r,g,b], "intensity": i, "range": r}
+// where spot lights also take "direction": [x,y,z], and "angle" and "innerAngle" in degrees
+// off the axis for the edge of the cone and the start of its falloff. "shadows": true makes a
+// light cast shadows.
+// "nodes" builds a transform hierarchy, each node of the form
+// {"name": n, "parent": name, "translate": [x,y,z], "rotate": [x,y,z], "scale": [x,y,z] or s}
+// with the rotation in degrees, about x first and z last. All but the name are optional, and
+// the nodes may come in any order. An object with "node": name is placed by that node, and its
+// own coordinates are relative to it
+bool ReadSceneFile(const QString& filename, SceneFile* scene, QString* error = nullptr);
+
+// Builds the geometry of one scene object ("custom", "regular", "obj" or "gltf").
+// Textures that live in their own files are not loaded here, see ObjectTexturePath.
+// Safe to call from any thread.
+bool LoadObjectGeometry(const QJsonObject& obj, const QString& localPath, Polygon& p, QString* error = nullptr);
+
+// The texture and normal map files an object references, or an empty string if it has none
+QString ObjectTexturePath(const QJsonObject& obj, const QString& localPath);
+QString ObjectNormalMapPath(const QJsonObject& obj, const QString& localPath);
+
+// Loads every object of a scene file, building objects in parallel, and blocks until all are done.
+// Objects that fail to load are skipped and their errors appended to *errors.
+// Returns false only if the scene file itself can't be read. Its lights go to *lights, and its
+// nodes to *graph, if given. Without a graph the objects are left where their files put them.
+bool LoadScene(const QString& filename, std::vector<Polygon>* polygons, QString* errors = nullptr,
+               std::vector<Light>* lights = nullptr, SceneGraph* graph = nullptr);
+
+// Builds a camera from a JSON object of the form
+// {"eye": [x,y,z], "target": [x,y,z], "up": [x,y,z], "fov": degrees, "near": n, "far": f}.
+// Missing fields keep the default Camera's values
+Camera ReadCamera(const QJsonObject& obj, float aspectRatio = 1.f);
+
+// Loads a scene file in the background. The JSON, every object's geometry and every texture
+// are separate tasks on a private thread pool, so objects and textures decode concurrently.
+// All signals are emitted on the thread that owns the loader.
+class SceneLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SceneLoader(QObject* parent = nullptr);
+    ~SceneLoader();
+
+    // Starts loading filename. The results of any load still in flight are discarded
+    void Load(const QString& filename);
+
+    // Discards the results of the load in flight, if any
+    void Cancel();
+
+signals:
+    // Emitted first, as soon as the scene file is read
+    void lightsLoaded(std::vector<Light> lights);
+    // Emitted right after, with the scene's nodes. The objects refer to them by index
+    void sceneGraphLoaded(SceneGraph graph);
+
+    // Emitted once per object, in completion order, as soon as its geometry and textures are ready
+    void objectLoaded(std::shared_ptr<Polygon> polygon);
+
+    // done out of total tasks have finished
+    void progress(int done, int total);
+
+    // Emitted after the last object. errors is empty if everything loaded
+    void finished(QString errors);
+
+private:
+    struct PendingObject;
+
+    // runs fn on the loader's thread, unless a newer Load or Cancel has happened since generation gen
+    template <typename F>
+    void post(unsigned gen, F fn);
+
+    void startObjects(unsigned gen, const SceneFile& scene);
+    void taskDone(unsigned gen, const std::shared_ptr<PendingObject>& pending);
+
+    QThreadPool m_pool;
+    std::atomic<unsigned> m_generation;
+
+    // only touched on the loader's thread
+    int m_tasksDone;
+    int m_tasksTotal;
+    QString m_errors;
+};
@@ -0,0 +1,22 @@
+# Golden image and render time regression tests. Renders every scene under scenes/ from the
+# benchmark's orbit cameras and compares against golden/. Set RASTERIZER_UPDATE_GOLDEN=1 to
+# (re)record the goldens from the current build; a scene without its goldens fails.
+# Frame times are only checked on the hosts that recorded budgets for themselves in
+# budgets.json, with RASTERIZER_UPDATE_BUDGETS=1, and skipped everywhere else. Raise
+# RASTERIZER_BUDGET_MARGIN when a host gets noisier than it was when recording.
+# It also checks that every kernel variant transforms vertices like the scalar one.
+include(../rasterizer_core.pri)
+
+QT += testlib
+QT -= widgets
+
+TARGET = tst_golden
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+DEFINES += SCENES_DIR=\\\"$$PWD/../../scenes\\\" \
+           GOLDEN_DIR=\\\"$$PWD/golden\\\" \
+           BUDGETS_FILE=\\\"$$PWD/budgets.json\\\"
+
+SOURCES += tst_golden.cpp
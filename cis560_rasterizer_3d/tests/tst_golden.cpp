@@ -0,0 +1,327 @@
+#include <QtTest>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QImage>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <glm/gtc/constants.hpp>
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "cameraset.h"
+#include "kernels.h"
+#include "rasterizer.h"
+#include "sceneloader.h"
+
+// cameras per scene
+static constexpr int POSES = 4;
+// a pixel only counts as different if some channel is off by more than this
+static constexpr int PIXEL_TOLERANCE = 8;
+// and at most this fraction of the pixels may be different
+static constexpr double MAX_DIFFERENT_PIXELS = 0.002;
+// timed frames per pose. the fastest of them counts, which is far less noisy than the mean
+static constexpr int TIMED_FRAMES = 5;
+// cheap poses keep going until this long was spent on them, so their fastest frame is a steady one
+static constexpr double MIN_TIMED_MS = 50.0;
+// how far over budget a scene may go before failing, unless RASTERIZER_BUDGET_MARGIN says otherwise
+static constexpr double DEFAULT_BUDGET_MARGIN = 0.25;
+// but at least this much, since a scene of a couple of milliseconds is off by a fraction of one
+// from noise alone
+static constexpr double MIN_BUDGET_SLACK_MS = 0.75;
+// how far a unit normal may move through PackNormal and UnpackNormal, about three of the
+// 1/32767 steps its octahedral coordinates are stored in
+static constexpr float NORMAL_TOLERANCE = 1e-4f;
+
+class GoldenTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void render_data();
+    void render();
+    void transformTail();
+    void packNormal();
+    void packUV();
+    void cleanupTestCase();
+
+private:
+    bool m_update = false;         // recording the goldens
+    bool m_updateBudgets = false;  // recording this host's budgets
+    double m_margin = DEFAULT_BUDGET_MARGIN;
+    QString m_host;
+    QJsonObject m_budgets;  // this host's, by scene
+};
+
+// fraction of pixels where any channel differs by more than PIXEL_TOLERANCE, or 1 if the sizes differ
+static double differentPixels(const QImage& a, const QImage& b, QImage* diff)
+{
+    if(a.size() != b.size())
+    {
+        return 1.0;
+    }
+    *diff = QImage(a.size(), QImage::Format_RGB32);
+    long long different = 0;
+    for(int y = 0; y < a.height(); y++)
+    {
+        const QRgb* la = reinterpret_cast<const QRgb*>(a.constScanLine(y));
+        const QRgb* lb = reinterpret_cast<const QRgb*>(b.constScanLine(y));
+        QRgb* ld = reinterpret_cast<QRgb*>(diff->scanLine(y));
+        for(int x = 0; x < a.width(); x++)
+        {
+            const int d = std::max({std::abs(qRed(la[x]) - qRed(lb[x])),
+                                    std::abs(qGreen(la[x]) - qGreen(lb[x])),
+                                    std::abs(qBlue(la[x]) - qBlue(lb[x]))});
+            different += d > PIXEL_TOLERANCE;
+            ld[x] = d > PIXEL_TOLERANCE ? qRgb(255, 0, 0) : qRgb(d * 16, d * 16, d * 16);
+        }
+    }
+    return double(different) / (double(a.width()) * a.height());
+}
+
+void GoldenTest::initTestCase()
+{
+    m_update = qEnvironmentVariableIntValue("RASTERIZER_UPDATE_GOLDEN") != 0;
+    m_updateBudgets = qEnvironmentVariableIntValue("RASTERIZER_UPDATE_BUDGETS") != 0;
+    m_host = QSysInfo::machineHostName();
+    bool ok = false;
+    const double margin = qEnvironmentVariable("RASTERIZER_BUDGET_MARGIN").toDouble(&ok);
+    if(ok)
+    {
+        m_margin = margin;
+    }
+
+    QFile budgets(BUDGETS_FILE);
+    if(budgets.open(QIODevice::ReadOnly))
+    {
+        m_budgets = QJsonDocument::fromJson(budgets.readAll()).object()[m_host].toObject();
+    }
+    if(m_update)
+    {
+        QDir().mkpath(GOLDEN_DIR);
+    }
+}
+
+void GoldenTest::render_data()
+{
+    QTest::addColumn<QString>("scene");
+
+    const QDir scenes(SCENES_DIR);
+    QStringList files;
+    QDirIterator it(SCENES_DIR, QStringList({"*.json"}), QDir::Files, QDirIterator::Subdirectories);
+    while(it.hasNext())
+    {
+        files.append(scenes.relativeFilePath(it.next()));
+    }
+    std::sort(files.begin(), files.end());
+    for(const QString& file : files)
+    {
+        QTest::newRow(file.toUtf8().constData()) << file;
+    }
+}
+
+void GoldenTest::render()
+{
+    QFETCH(QString, scene);
+
+    auto polygons = std::make_shared<std::vector<Polygon>>();
+    std::vector<Light> lights;
+    SceneGraph graph;
+    QString errors;
+    QVERIFY2(LoadScene(QDir(SCENES_DIR).filePath(scene), polygons.get(), &errors, &lights, &graph), qPrintable(errors));
+    QVERIFY2(errors.isEmpty(), qPrintable(errors));
+
+    // golden files are named after the scene path, e.g. 0/axe.json pose 2 -> 0_axe_2.png
+    const QString stem = QString(scene).replace('/', '_').replace(".json", "");
+    Rasterizer rasterizer(polygons);
+    rasterizer.m_lights = lights;
+    rasterizer.m_sceneGraph = graph;
+    // render times only mean something against a budget recorded on the same machine
+    const bool timed = m_updateBudgets || m_budgets.contains(scene);
+    double sceneMs = 0;  // sum over the poses
+    int pose = 0;
+    for(const Camera& camera : OrbitCameraSet(*polygons, POSES, 1.f, &graph))
+    {
+        rasterizer.m_camera = camera;
+        const QImage image = rasterizer.RenderScene();
+
+        const QString golden = QDir(GOLDEN_DIR).filePath(QString("%1_%2.png").arg(stem).arg(pose++));
+        if(m_update)
+        {
+            QVERIFY2(image.save(golden), qPrintable(QString("Could not write %1").arg(golden)));
+        }
+        else if(!QFile::exists(golden))
+        {
+            // every scene needs its goldens, or a new scene would pass whatever it renders
+            QFAIL(qPrintable(QString("%1: no golden image %2, record it with RASTERIZER_UPDATE_GOLDEN=1")
+                             .arg(scene).arg(golden)));
+        }
+        else
+        {
+            QImage diff;
+            const double different = differentPixels(image, QImage(golden).convertToFormat(QImage::Format_RGB32), &diff);
+            if(different > MAX_DIFFERENT_PIXELS)
+            {
+                // keep the evidence next to the test binary
+                const QString base = QFileInfo(golden).completeBaseName();
+                image.save(base + "_actual.png");
+                diff.save(base + "_diff.png");
+                QFAIL(qPrintable(QString("%1: %2% of the pixels differ from %3")
+                                 .arg(scene).arg(different * 100, 0, 'f', 3).arg(golden)));
+            }
+        }
+
+        if(!timed)
+        {
+            continue;
+        }
+        double best = std::numeric_limits<double>::infinity();
+        double spent = 0;
+        for(int i = 0; i < TIMED_FRAMES || spent < MIN_TIMED_MS; i++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            rasterizer.RenderScene();
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best = std::min(best, ms);
+            spent += ms;
+        }
+        sceneMs += best;
+    }
+
+    if(m_updateBudgets)
+    {
+        m_budgets.insert(scene, sceneMs);
+        return;
+    }
+    if(!timed)
+    {
+        QSKIP(qPrintable(QString("no render time budget for %1 on %2, record one with RASTERIZER_UPDATE_BUDGETS=1")
+                         .arg(scene).arg(m_host)));
+    }
+#ifdef QT_DEBUG
+    QSKIP("render time budgets are only checked in release builds");
+#else
+    const double budget = m_budgets[scene].toDouble();
+    const double slack = std::max(budget * m_margin, MIN_BUDGET_SLACK_MS);
+    QVERIFY2(sceneMs <= budget + slack,
+             qPrintable(QString("%1: %2 ms for all poses, budget %3 ms + %4 ms")
+                        .arg(scene).arg(sceneMs, 0, 'f', 2).arg(budget, 0, 'f', 2).arg(slack, 0, 'f', 2)));
+#endif
+}
+
+// every variant's transform has to match the scalar one bit for bit, also for an odd vertex
+// count whose last position ends right before a page it may not read
+void GoldenTest::transformTail()
+{
+#ifdef Q_OS_UNIX
+    const size_t page = size_t(sysconf(_SC_PAGESIZE));
+    char* const mapping = static_cast<char*>(mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE,
+                                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    QVERIFY(mapping != MAP_FAILED);
+    QVERIFY(mprotect(mapping + page, page, PROT_NONE) == 0);
+
+    const glm::mat4 viewProj(glm::vec4(1.2f, 0.1f, 0.f, 0.f), glm::vec4(-0.3f, 0.9f, 0.2f, 0.f),
+                             glm::vec4(0.f, 0.4f, -1.1f, -1.f), glm::vec4(0.5f, -0.2f, 3.f, 4.f));
+    const char* const initial = Kernels().name;
+    for(size_t n = 1; n <= 9; n += 2)
+    {
+        glm::vec3* const positions = reinterpret_cast<glm::vec3*>(mapping + page) - n;
+        for(size_t i = 0; i < n; i++)
+        {
+            positions[i] = glm::vec3(0.25f * i - 1.f, 0.5f - 0.125f * i, 0.1f * i);
+        }
+        std::vector<glm::vec4> clip(n), screen(n), expectedClip(n), expectedScreen(n);
+        QVERIFY(SelectKernels("scalar"));
+        Kernels().transform(positions, n, viewProj, 640.f, 480.f, expectedClip.data(), expectedScreen.data());
+        for(const char* isa : SupportedKernelISAs())
+        {
+            QVERIFY(SelectKernels(isa));
+            Kernels().transform(positions, n, viewProj, 640.f, 480.f, clip.data(), screen.data());
+            QVERIFY2(std::memcmp(clip.data(), expectedClip.data(), n * sizeof(glm::vec4)) == 0 &&
+                     std::memcmp(screen.data(), expectedScreen.data(), n * sizeof(glm::vec4)) == 0,
+                     qPrintable(QString("%1 transforms %2 vertices differently").arg(isa).arg(n)));
+        }
+    }
+    SelectKernels(initial);
+    munmap(mapping, 2 * page);
+#else
+    QSKIP("needs a guard page after the positions");
+#endif
+}
+
+void GoldenTest::packNormal()
+{
+    // a grid over the sphere, both poles and the lower half that is folded over the upper one
+    // included, and the edges of the octahedron where the fold meets
+    std::vector<glm::vec3> normals = {glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0),
+                                      glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::normalize(glm::vec3(-1, 1, -1e-6f))};
+    for(int i = 1; i < 64; i++)
+    {
+        const float theta = glm::pi<float>() * i / 64;
+        for(int j = 0; j < 128; j++)
+        {
+            const float phi = 2 * glm::pi<float>() * j / 128;
+            normals.push_back(glm::vec3(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)));
+        }
+    }
+    for(const glm::vec3& n : normals)
+    {
+        const glm::vec3 decoded = UnpackNormal(PackNormal(n));
+        const bool sameSide = std::abs(n.z) <= NORMAL_TOLERANCE || (decoded.z < 0.f) == (n.z < 0.f);
+        QVERIFY2(glm::length(decoded - n) <= NORMAL_TOLERANCE && sameSide,
+                 qPrintable(QString("(%1, %2, %3) decodes to (%4, %5, %6)")
+                            .arg(n.x).arg(n.y).arg(n.z).arg(decoded.x).arg(decoded.y).arg(decoded.z)));
+    }
+
+    // meshes without normals keep the zero vector, which has no direction to project
+    QCOMPARE(UnpackNormal(PackNormal(glm::vec3(0.f))), glm::vec3(0.f));
+    QVERIFY(UnpackNormal(PackNormal(glm::vec3(0, 0, -1))).z == -1.f);
+}
+
+void GoldenTest::packUV()
+{
+    // half floats have 11 significant bits: in [0, 1] a uv moves by at most 1/4096, and the
+    // bound doubles with each power of two above that, to a whole texel of a 1024 texture in [2, 4)
+    for(int i = 0; i <= 4096; i++)
+    {
+        const float u = i / 4096.f + 0.3f / 8192;
+        const float inside = std::min(u, 1.f), outside = 2.f + 2.f * i / 4097;
+        const glm::vec2 decoded = UnpackUV(PackUV(glm::vec2(inside, outside)));
+        QVERIFY2(std::abs(decoded.x - inside) <= 1.f / 4096,
+                 qPrintable(QString("u %1 decodes to %2").arg(inside).arg(decoded.x)));
+        QVERIFY2(std::abs(decoded.y - outside) <= 1.f / 1024,
+                 qPrintable(QString("v %1 decodes to %2").arg(outside).arg(decoded.y)));
+    }
+    QCOMPARE(UnpackUV(PackUV(glm::vec2(0.f, 1.f))), glm::vec2(0.f, 1.f));
+    QCOMPARE(UnpackUV(PackUV(glm::vec2(-0.5f, 2.f))), glm::vec2(-0.5f, 2.f));
+}
+
+void GoldenTest::cleanupTestCase()
+{
+    if(!m_updateBudgets)
+    {
+        return;
+    }
+    // the other hosts' budgets stay as they are
+    QFile budgets(BUDGETS_FILE);
+    QJsonObject hosts;
+    if(budgets.open(QIODevice::ReadOnly))
+    {
+        hosts = QJsonDocument::fromJson(budgets.readAll()).object();
+        budgets.close();
+    }
+    hosts.insert(m_host, m_budgets);
+    QVERIFY(budgets.open(QIODevice::WriteOnly));
+    budgets.write(QJsonDocument(hosts).toJson(QJsonDocument::Indented));
+}
+
+QTEST_GUILESS_MAIN(GoldenTest)
+
+#include "tst_golden.moc"
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+
+// A single producer, single consumer mailbox that never blocks either side.
+// The producer fills Back() and publishes it, the consumer takes the newest published slot
+// with Acquire() and reads it through Front(). The three slots rotate through one atomic
+// index, so a slow consumer just skips the frames it missed and the producer never waits.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // producer side
+    T& Back() { return m_slots[m_back]; }
+    void Publish()
+    {
+        m_back = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // consumer side. returns false, leaving Front() alone, if nothing new was published
+    bool Acquire()
+    {
+        if(!(m_middle.load(std::memory_order_relaxed) & FRESH))
+        {
+            return false;
+        }
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    const T& Front() const { return m_slots[m_front]; }
+
+private:
+    static constexpr unsigned INDEX = 3;
+    static constexpr unsigned FRESH = 4;  // set while the middle slot holds an unread frame
+
+    T m_slots[3];
+    unsigned m_back = 0;                  // only touched by the producer
+    std::atomic<unsigned> m_middle{1};
+    unsigned m_front = 2;                 // only touched by the consumer
+};